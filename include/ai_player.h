@@ -0,0 +1,111 @@
+#ifndef AI_PLAYER_H
+#define AI_PLAYER_H
+
+#include <stdint.h>
+#include <iostream>
+#include <memory>
+
+#include "game_state.h"
+#include "search.h"
+#include "ai_task.h"
+#include "ponder.h"
+#include "nnue.h"
+#include "transposition.h"
+
+#define AI_MOVE_TIME_MS 1000
+
+// Computer opponent: a timed search per move, pondering on the opponent's
+// turn. All searching happens on the task runner's thread; beginMove() and
+// the poll functions return immediately so they can be called every frame.
+class AiPlayer
+{
+    TranspositionTable tt;
+    AiTaskRunner runner;
+    Ponderer ponderer;
+    int64_t moveTimeMs;
+    bool ponderEnabled;
+    bool thinking;
+    Move expectedReply;
+    std::unique_ptr<NnueNetwork> network;
+
+public:
+    AiPlayer(int64_t moveTime = AI_MOVE_TIME_MS, bool ponder = true, size_t ttMegabytes = TT_DEFAULT_MB)
+        : tt(ttMegabytes), runner(tt), ponderer(runner, tt), moveTimeMs(moveTime),
+          ponderEnabled(ponder), thinking(false), expectedReply(NULL_MOVE) {}
+
+    // Switch to the network evaluation; keeps the handcrafted one if `path` fails to load
+    int loadNetwork(const char *path) {
+        std::unique_ptr<NnueNetwork> net(new NnueNetwork());
+        if(net->load(path))
+            return -1;
+        cancel();
+        runner.setNetwork(net.get());
+        network = std::move(net);
+        return 0;
+    }
+
+    // The opponent is to move in `state`; use their thinking time. Only
+    // two-player games are pondered.
+    void opponentTurn(const GameState &state) {
+        if(ponderEnabled && !thinking && state.numPlayers == 2)
+            ponderer.start(state, expectedReply);
+    }
+
+    // Start thinking about our move in `state`, picking up a matching ponder search
+    void beginMove(const GameState &state) {
+        if(!ponderer.resolve(state, moveTimeMs))
+            runner.start(state, SearchLimits::timed(moveTimeMs));
+        thinking = true;
+    }
+
+    bool isThinking(void) const {
+        return thinking;
+    }
+
+    // True once, when the move started by beginMove() is ready
+    bool pollMove(SearchResult &out) {
+        if(!thinking || !runner.poll(out))
+            return false;
+        thinking = false;
+        expectedReply = (out.pvLength > 1) ? out.pv[1] : NULL_MOVE;
+        return true;
+    }
+
+    // True when a deeper iteration has finished since the last call
+    bool pollProgress(SearchResult &out) {
+        return thinking && runner.progress(out);
+    }
+
+    // Blocking version for tools without a frame loop
+    SearchResult chooseMove(const GameState &state) {
+        SearchResult r;
+        beginMove(state);
+        if(!runner.wait(r)) {
+            memset(&r, 0, sizeof(r));
+            r.best = NULL_MOVE;
+        }
+        thinking = false;
+        expectedReply = (r.pvLength > 1) ? r.pv[1] : NULL_MOVE;
+        return r;
+    }
+
+    // Drop any search in flight, e.g. on undo or quit
+    void cancel(void) {
+        ponderer.stop();
+        runner.cancel();
+        thinking = false;
+        expectedReply = NULL_MOVE;
+    }
+
+    const PonderStats &ponderStats(void) const {
+        return ponderer.getStats();
+    }
+
+    void printStats(void) const {
+        const PonderStats &s = ponderer.getStats();
+        std::cout<<"Ponder: "<<s.started<<" started, "<<s.hits<<" hits, "<<s.misses<<" misses ("
+                 <<(int)(s.hitRate() * 100.0)<<"% hit rate), "
+                 <<(int)s.savedPerMove()<<" ms saved per move"<<std::endl;
+    }
+};
+#endif
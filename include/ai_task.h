@@ -0,0 +1,196 @@
+#ifndef AI_TASK_H
+#define AI_TASK_H
+
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "game_state.h"
+#include "search.h"
+#include "multi_search.h"
+#include "transposition.h"
+
+// Runs searches on a dedicated worker thread so the render loop never waits on
+// the AI. Each start() is a new job; the loop polls for progress and the final
+// result once per frame. Starting a new job or cancelling drops the old one,
+// and nothing from a dropped job is ever reported. Positions with more than
+// two players go to MultiSearch, which has no ponder mode; time limits only
+// apply to two-player jobs while they run.
+class AiTaskRunner
+{
+    Search search;
+    MultiSearch multiSearch;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    bool quit;
+    bool pending;
+    uint32_t jobId;         // latest job handed out; older ids are stale
+    uint32_t runningId;     // job on the worker, 0 when idle
+    GameState jobState;
+    SearchLimits jobLimits;
+    const NnueNetwork *jobNetwork;
+
+    bool haveResult;
+    SearchResult result;
+    bool haveProgress;
+    SearchResult progressResult;
+
+public:
+    AiTaskRunner(TranspositionTable &tt) : search(tt), multiSearch(tt), quit(false), pending(false), jobId(0),
+                                           runningId(0), jobNetwork(NULL), haveResult(false), haveProgress(false) {
+        worker = std::thread(&AiTaskRunner::run, this);
+    }
+
+    ~AiTaskRunner() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+            stopSearch();
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    uint32_t start(const GameState &state, const SearchLimits &limits) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(runningId)
+            stopSearch();
+        jobId++;
+        jobState = state;
+        jobLimits = limits;
+        pending = true;
+        haveResult = false;
+        haveProgress = false;
+        wake.notify_one();
+        return jobId;
+    }
+
+    // Abandon the current job; its result will never be reported
+    void cancel(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(runningId)
+            stopSearch();
+        jobId++;
+        pending = false;
+        haveResult = false;
+        haveProgress = false;
+        finished.notify_all();
+    }
+
+    // End the current job early but still report its best move so far
+    void finish(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(pending) {
+            jobLimits.depth = 1;
+            jobLimits.ponder = false;
+        }
+        else if(runningId == jobId)
+            stopSearch();
+    }
+
+    // Give the current job a deadline measured from now (e.g. on a ponder hit)
+    void setTimeLimit(int64_t ms) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(pending) {
+            jobLimits.timeMs = ms;
+            jobLimits.ponder = false;
+        }
+        else if(runningId == jobId)
+            search.setTimeLimit(ms);
+    }
+
+    // Evaluate with `net` from the next job on; NULL for the handcrafted evaluation
+    void setNetwork(const NnueNetwork *net) {
+        std::lock_guard<std::mutex> guard(lock);
+        jobNetwork = net;
+    }
+
+    bool isBusy(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        return pending || runningId == jobId;
+    }
+
+    // Non-blocking: true once, when the current job has finished
+    bool poll(SearchResult &out) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!haveResult)
+            return false;
+        out = result;
+        haveResult = false;
+        return true;
+    }
+
+    // Non-blocking: true when a new iteration of the current job has completed
+    bool progress(SearchResult &out) {
+        std::lock_guard<std::mutex> guard(lock);
+        if(!haveProgress)
+            return false;
+        out = progressResult;
+        haveProgress = false;
+        return true;
+    }
+
+    // Blocking: false if the job was cancelled instead of finishing
+    bool wait(SearchResult &out) {
+        std::unique_lock<std::mutex> guard(lock);
+        uint32_t id = jobId;
+        finished.wait(guard, [&] { return haveResult || id != jobId || (!pending && runningId != id); });
+        if(!haveResult || id != jobId)
+            return false;
+        out = result;
+        haveResult = false;
+        return true;
+    }
+
+private:
+    void stopSearch(void) {
+        search.stop();
+        multiSearch.stop();
+    }
+
+    void run(void) {
+        TRACE_THREAD("ai search");
+        for(;;) {
+            GameState state;
+            SearchLimits limits;
+            uint32_t id;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this] { return quit || pending; });
+                if(quit)
+                    return;
+                state = jobState;
+                limits = jobLimits;
+                id = jobId;
+                pending = false;
+                runningId = id;
+                search.setNetwork(jobNetwork);
+                search.resetStop();
+                multiSearch.resetStop();
+            }
+
+            SearchCallback onIteration = [this, id](const SearchResult &p) {
+                std::lock_guard<std::mutex> guard(lock);
+                if(id == jobId) {
+                    progressResult = p;
+                    haveProgress = true;
+                }
+            };
+            SearchResult r = (state.numPlayers > 2) ? multiSearch.think(state, limits, onIteration)
+                                                    : search.think(state, limits, onIteration);
+
+            std::lock_guard<std::mutex> guard(lock);
+            runningId = 0;
+            if(id == jobId) {
+                result = r;
+                haveResult = true;
+            }
+            finished.notify_all();
+        }
+    }
+};
+#endif
@@ -0,0 +1,174 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+
+#include "shader.h"
+#include "stb_image.h"
+#include "startup.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+#define SHADER_VERTEX_PATH   "shaders/shader.vs"
+#define SHADER_FRAGMENT_PATH "shaders/shader.fs"
+#define BOARD_TEXTURE_PATH   "textures/board.png"
+#define WORKER_TEXTURE_PATH  "textures/awesomeface.png"
+
+// Drawn with until an image is uploaded: a plain light grey
+#define PLACEHOLDER_TEXEL { 200, 200, 200 }
+
+enum AssetImage
+{
+    IMAGE_BOARD,        // critical: the first frame waits for it
+    IMAGE_WORKER,       // towers and workers, swapped in when ready
+    NUM_IMAGES
+};
+
+// The shader and textures every board piece draws with, loaded once and
+// shared. PNGs are decoded on the thread pool, which needs no GL context,
+// so decoding can start before the window exists; uploads happen on the GL
+// thread as images become ready. Until then texture() hands out a
+// placeholder so the first frames can be drawn without waiting.
+class Assets
+{
+    struct Image
+    {
+        const char *path;
+        bool critical;
+        unsigned char *pixels;
+        int width, height, channels;
+        std::atomic<bool> decoded;
+        bool loaded;                // uploaded, or failed to decode
+        unsigned int texture;       // 0 until uploaded
+        int64_t decodeStartUs;
+        int64_t decodeEndUs;
+    };
+
+    Image images[NUM_IMAGES];
+    TaskGroup decoding[NUM_IMAGES];
+    Shader *sharedShader;
+    unsigned int placeholder;
+    int loadedCount;
+
+public:
+    Assets() : sharedShader(NULL), placeholder(0), loadedCount(0) {
+        static const char *paths[NUM_IMAGES] = { BOARD_TEXTURE_PATH, WORKER_TEXTURE_PATH };
+        for(int i = 0; i < NUM_IMAGES; i++) {
+            Image &image = images[i];
+            image.path = paths[i];
+            image.critical = (i == IMAGE_BOARD);
+            image.pixels = NULL;
+            image.width = image.height = image.channels = 0;
+            image.decoded = false;
+            image.loaded = false;
+            image.texture = 0;
+            image.decodeStartUs = image.decodeEndUs = 0;
+        }
+    }
+
+    Assets(const Assets &) = delete;
+    Assets &operator=(const Assets &) = delete;
+
+    ~Assets() {
+        for(int i = 0; i < NUM_IMAGES; i++) {
+            decoding[i].wait();
+            stbi_image_free(images[i].pixels);
+        }
+        delete sharedShader;
+    }
+
+    // Decodes every image on the pool; needs no GL context
+    void startDecoding(void) {
+        for(int i = 0; i < NUM_IMAGES; i++) {
+            Image *image = &images[i];
+            decoding[i].run([image] {
+                TRACE_ZONE("stbi_load");
+                image->decodeStartUs = StartupReport::nowUs();
+                image->pixels = stbi_load(image->path, &image->width, &image->height, &image->channels, 0);
+                image->decodeEndUs = StartupReport::nowUs();
+                image->decoded.store(true, std::memory_order_release);
+            });
+        }
+    }
+
+    // The rest need the GL context current on the calling thread
+
+    void loadShaders(void) {
+        sharedShader = new Shader(SHADER_VERTEX_PATH, SHADER_FRAGMENT_PATH);
+
+        static const unsigned char texel[3] = PLACEHOLDER_TEXEL;
+        glGenTextures(1, &placeholder);
+        glBindTexture(GL_TEXTURE_2D, placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    // Blocks until the critical images are decoded, helping with the
+    // decoding meanwhile, and uploads them
+    void waitCritical(void) {
+        for(int i = 0; i < NUM_IMAGES; i++)
+            if(images[i].critical) {
+                decoding[i].wait();
+                upload(images[i]);
+            }
+    }
+
+    // Uploads whatever has been decoded since the last call; call once a
+    // frame. True once every image is in.
+    bool update(void) {
+        for(int i = 0; i < NUM_IMAGES && loadedCount < NUM_IMAGES; i++)
+            if(!images[i].loaded && images[i].decoded.load(std::memory_order_acquire))
+                upload(images[i]);
+        return ready();
+    }
+
+    bool ready(void) const {
+        return loadedCount == NUM_IMAGES;
+    }
+
+    Shader *shader(void) const {
+        return sharedShader;
+    }
+
+    unsigned int texture(AssetImage id) const {
+        return images[id].texture ? images[id].texture : placeholder;
+    }
+
+    // Adds each image's decode time, for those decoded so far
+    void reportDecoding(StartupReport &report) const {
+        for(int i = 0; i < NUM_IMAGES; i++)
+            if(images[i].decoded.load(std::memory_order_acquire))
+                report.span(images[i].path, images[i].decodeStartUs, images[i].decodeEndUs);
+    }
+
+private:
+    void upload(Image &image) {
+        if(image.loaded)
+            return;
+        TRACE_ZONE("texture upload");
+        image.loaded = true;
+        loadedCount++;
+        GLenum format = (image.channels == 4) ? GL_RGBA : (image.channels == 3) ? GL_RGB : 0;
+        if(!image.pixels || !format) {
+            std::cout<<"Failed to load texture "<<image.path<<std::endl;
+            return;
+        }
+        glGenTextures(1, &image.texture);
+        glBindTexture(GL_TEXTURE_2D, image.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        // The GL has its own copy now
+        stbi_image_free(image.pixels);
+        image.pixels = NULL;
+    }
+};
+#endif
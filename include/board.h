@@ -6,25 +6,42 @@
 #include<glm/gtc/type_ptr.hpp>
 
 #include "game_defs.h"
+#include "trace.h"
+#include "game_state.h"
 #include "tower.h"
 #include "player.h"
-#include "stb_image.h"
+#include "assets.h"
 
 #define BOARD_TOP        0.0f
 #define BOARD_BOTTOM    -0.5f
 #define BOARD_LEFT      -3.5f
 #define BOARD_RIGHT      3.5f
 
-#define TEXTURE_PATH "textures/board.png"
+// Tower tints: squares the side to move can win on, and squares it must block
+#define WIN_TINT   glm::vec4(0.1f, 0.8f, 0.1f, 0.6f)
+#define BLOCK_TINT glm::vec4(0.9f, 0.1f, 0.1f, 0.6f)
+// Squares and workers under the mouse, and those picked for the move being
+// clicked together
+#define HOVER_TINT  glm::vec4(0.9f, 0.9f, 0.3f, 0.4f)
+#define SELECT_TINT glm::vec4(0.2f, 0.4f, 0.9f, 0.6f)
+// Board tints for a position proven won or lost by the side to move
+#define PROVEN_WIN_TINT  glm::vec4(0.1f, 0.8f, 0.1f, 0.3f)
+#define PROVEN_LOSS_TINT glm::vec4(0.9f, 0.1f, 0.1f, 0.3f)
 
 class Board
 {
     uint8_t numPlayers;
     Tower towers[BOARD_WIDTH][BOARD_WIDTH];
     Player *players;
-    Shader *boardShader;
+    uint32_t winSquares;
+    uint32_t blockSquares;
+    uint8_t hoverSquare;
+    int hoverFigure;            // index into players, -1 for none
+    uint32_t selectedSquares;
+    int selectedFigure;
+    glm::vec4 annotation;
+    const Assets *assets;
     unsigned int VAO, VBO;
-    unsigned int texture;
 
     const float vertices[36*5] = {
         BOARD_LEFT,   BOARD_BOTTOM, BOARD_LEFT,     0.0f, 0.0f,
@@ -71,10 +88,23 @@ class Board
     };
 
 public:
-    Board(uint8_t numPlayers = 2) {
+    // `shared` must be loaded (Assets::loadShaders) and outlive the board
+    Board(const Assets &shared, uint8_t numPlayers = 2) {
         Board::numPlayers = numPlayers;
-        Board::players = new Player[numPlayers];
-        Board::boardShader = new Shader("shaders/shader.vs", "shaders/shader.fs");
+        Board::players = new Player[numPlayers * WORKERS_PER_PLAYER];
+        Board::winSquares = 0;
+        Board::blockSquares = 0;
+        Board::hoverSquare = NO_SQUARE;
+        Board::hoverFigure = -1;
+        Board::selectedSquares = 0;
+        Board::selectedFigure = -1;
+        Board::annotation = glm::vec4(0.0f);
+        Board::assets = &shared;
+        for(int i = 0; i < BOARD_WIDTH; i++)
+            for(int j = 0; j < BOARD_WIDTH; j++)
+                towers[i][j].useAssets(&shared);
+        for(int i = 0; i < numPlayers * WORKERS_PER_PLAYER; i++)
+            players[i].useAssets(&shared);
 
         glGenBuffers(1, &(Board::VBO));
         glGenVertexArrays(1, &(Board::VAO));
@@ -89,32 +119,10 @@ public:
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
         glEnableVertexAttribArray(1);
-
-        glGenTextures(1, &(Board::texture));
-        glBindTexture(GL_TEXTURE_2D, Board::texture);
-        // set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // load and generate the texture
-        int width, height, nrChannels;
-        unsigned char *data = stbi_load(TEXTURE_PATH, &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        else
-        {
-            std::cout<<"Failed to load texture"<<std::endl;
-        }
-        stbi_image_free(data);
     }
 
     ~Board() {
-        delete Board::players;
-        delete Board::boardShader;
+        delete[] Board::players;
     }
 
     int updatePlayer(uint8_t player, uint8_t x, uint8_t y) {
@@ -125,6 +133,18 @@ public:
             return -1;
 
         players[player].setLocation(x, y);
+        return 0;
+    }
+
+    int updateWorker(uint8_t player, uint8_t worker, uint8_t x, uint8_t y, uint8_t level, bool slide = false) {
+        if(player >= numPlayers || worker >= WORKERS_PER_PLAYER)
+            return -1;
+
+        if(x >= BOARD_WIDTH || y >= BOARD_WIDTH)
+            return -1;
+
+        players[player * WORKERS_PER_PLAYER + worker].setLocation(x, y, level, slide);
+        return 0;
     }
 
     int updateTower(uint8_t x, uint8_t y) {
@@ -132,17 +152,80 @@ public:
             return -1;
 
         towers[x][y].incrementHeight();
+        return 0;
+    }
+
+    // Square masks (GameState numbering) of towers to tint when drawing
+    void setHighlights(uint32_t wins, uint32_t blocks) {
+        winSquares = wins;
+        blockSquares = blocks;
+    }
+
+    // What the mouse is over: a square, and the worker of `player` on it
+    // when that was hit rather than the square; NO_SQUARE for nothing
+    void setHover(uint8_t square, int player = -1, int worker = -1) {
+        hoverSquare = square;
+        hoverFigure = (player >= 0 && worker >= 0) ? player * WORKERS_PER_PLAYER + worker : -1;
+    }
+
+    // Square mask picked so far for a move, and the worker it is for
+    void setSelection(uint32_t squares, int player = -1, int worker = -1) {
+        selectedSquares = squares;
+        selectedFigure = (player >= 0 && worker >= 0) ? player * WORKERS_PER_PLAYER + worker : -1;
+    }
+
+    // Tint over the whole board, e.g. a proven result for the position shown;
+    // zero alpha for none
+    void setAnnotation(glm::vec4 tint) {
+        annotation = tint;
+    }
+
+    // Shows `state`: tower heights from its levels and one figure per worker.
+    // Eliminated workers are parked off the board. Immediate wins and threats
+    // to block are highlighted while the game is on. With `slide` moved
+    // workers hop to their new squares over the next frames.
+    int loadPosition(const GameState &state, bool slide = false) {
+        if(state.numPlayers != numPlayers)
+            return -1;
+
+        for(int sq = 0; sq < NUM_SQUARES; sq++)
+            towers[squareX(sq)][squareY(sq)].setHeight(state.heights[sq]);
+
+        for(int p = 0; p < numPlayers; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                uint8_t sq = state.workers[p][w];
+                if(sq == NO_SQUARE)
+                    players[p * WORKERS_PER_PLAYER + w].setLocation(BOARD_WIDTH + 1, p, 0, slide);
+                else
+                    updateWorker(p, w, squareX(sq), squareY(sq), state.heights[sq], slide);
+            }
+
+        annotation = glm::vec4(0.0f);
+        if(state.isOver())
+            setHighlights(0, 0);
+        else
+            setHighlights(state.winningSquares(state.toMove), state.squaresToBlock());
+        return 0;
+    }
+
+    // Moves sliding workers on by `seconds` of animation
+    void advance(float seconds) {
+        for(int i = 0; i < numPlayers * WORKERS_PER_PLAYER; i++)
+            players[i].advance(seconds);
     }
 
     void drawBoard(glm::mat4 model, glm::mat4 view, glm::mat4 projection) {
+        TRACE_ZONE("Board::drawBoard");
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, Board::texture);
+        glBindTexture(GL_TEXTURE_2D, Board::assets->texture(IMAGE_BOARD));
 
-        Board::boardShader->use();
+        Shader *boardShader = Board::assets->shader();
+        boardShader->use();
 
-        Board::boardShader->setMat4("model", model);
-        Board::boardShader->setMat4("view", view);
-        Board::boardShader->setMat4("projection", projection);
+        boardShader->setMat4("model", model);
+        boardShader->setMat4("view", view);
+        boardShader->setMat4("projection", projection);
+        boardShader->setVec4("tint", Board::annotation);
 
         glBindVertexArray(Board::VAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -152,19 +235,27 @@ public:
         float iOffset, jOffset;
         for(int i = 0; i < BOARD_WIDTH; i++)
             for(int j = 0; j < BOARD_WIDTH; j++) {
-                iOffset = i * 1.28f;
-                jOffset = j * 1.28f;
+                iOffset = i * TILE_SPACING;
+                jOffset = j * TILE_SPACING;
                 glm::mat4 towerModel =
-                    glm::translate(identity, glm::vec3(-2.55f + iOffset,
+                    glm::translate(identity, glm::vec3(-TILE_ORIGIN + iOffset,
                                                         0.0f,
-                                                        2.55f - jOffset));
+                                                        TILE_ORIGIN - jOffset));
 
-                towers[i][j].drawTower(towerModel, view, projection);
+                uint8_t sq = squareIndex(i, j);
+                uint32_t bit = 1u << sq;
+                glm::vec4 tint = (winSquares & bit) ? WIN_TINT : ((blockSquares & bit) ? BLOCK_TINT : glm::vec4(0.0f));
+                if(selectedSquares & bit)
+                    tint = SELECT_TINT;
+                else if(sq == hoverSquare && hoverFigure < 0)
+                    tint = HOVER_TINT;
+                towers[i][j].drawTower(towerModel, view, projection, tint);
             }
 
-        // Draw each player
-        for(int i = 0; i < numPlayers; i++)
-            players[i].drawPlayer(view, projection);
+        // Draw each worker
+        for(int i = 0; i < numPlayers * WORKERS_PER_PLAYER; i++)
+            players[i].drawPlayer(view, projection, (i == selectedFigure) ? SELECT_TINT :
+                                                    ((i == hoverFigure) ? HOVER_TINT : glm::vec4(0.0f)));
     }
 };
 #endif
@@ -0,0 +1,487 @@
+#ifndef DB_QUERY_H
+#define DB_QUERY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "game_state.h"
+#include "game_db.h"
+#include "eval_batch.h"
+#include "thread_pool.h"
+
+#define DB_BLOCK_ROWS 1024          // rows per pass through the program
+#define DB_CHUNK_ROWS (1 << 20)     // rows per thread pool task
+#define DB_MAX_STACK  16
+
+// Squares off the top and bottom edge in y, for shifting masks without wrapping
+#define DB_NOT_Y0 0x1EF7BDEu
+#define DB_NOT_Y4 0x0F7BDEFu
+
+// Position queries over a GameDb. A query is an expression over per-row
+// bitboards, for example
+//
+//   any(adj(mover & L2) & L3 & ~occ) and ply < 20
+//
+// Masks: L0 L1 L2 L3 L4 (exact levels, L4 = dome), mover, opp, occ, empty, all
+// Numbers: ply toMove players game, and integer literals
+// Operators: & | ^ ~ on masks, and/or/not (or & | ~) on conditions,
+//            == != < <= > >= on numbers
+// Functions: adj(mask) squares next to any square of the mask,
+//            any(mask) none(mask) count(mask)
+//
+// The expression is compiled to a small stack program that runs over a
+// block of rows at a time, one whole column per instruction, so each
+// instruction is a straight vector loop.
+enum DbOp {
+    DB_OP_LOAD,     // push column `arg`
+    DB_OP_CONST,    // push `arg` in every row
+    DB_OP_AND,
+    DB_OP_OR,
+    DB_OP_XOR,
+    DB_OP_NOT,      // xor with `arg`: the board mask for masks, all ones for conditions
+    DB_OP_ADJ,
+    DB_OP_ANY,      // mask != 0 as a condition (all ones or zero)
+    DB_OP_COUNT,
+    DB_OP_EQ,
+    DB_OP_LT,
+    DB_OP_GT
+};
+
+enum DbType {
+    DB_TYPE_MASK,
+    DB_TYPE_NUMBER,
+    DB_TYPE_BOOL
+};
+
+struct DbInstruction
+{
+    DbOp op;
+    uint32_t arg;
+};
+
+inline uint32_t adjacentSquares(uint32_t m) {
+    uint32_t up = m & DB_NOT_Y4, down = m & DB_NOT_Y0;
+    return ((m << 5) | (m >> 5) | (up << 1) | (down >> 1) |
+            (up << 6) | (up >> 4) | (down << 4) | (down >> 6)) & BOARD_MASK;
+}
+
+class DbQuery
+{
+    std::vector<DbInstruction> program;
+    std::string error;
+    const char *cursor;
+    int depth;
+    int maxDepth;
+
+public:
+    DbQuery() : cursor(NULL), depth(0), maxDepth(0) {}
+
+    // 0 on success; otherwise -1 and errorText() says what is wrong
+    int compile(const char *text) {
+        program.clear();
+        error.clear();
+        cursor = text;
+        depth = maxDepth = 0;
+
+        DbType type;
+        if(parseOr(type))
+            return -1;
+        skipSpace();
+        if(*cursor)
+            return fail("unexpected text");
+        if(type != DB_TYPE_BOOL)
+            return fail("the query must be a condition, e.g. any(...) or count(...) > 1");
+        if(maxDepth > DB_MAX_STACK)
+            return fail("expression is nested too deeply");
+        return 0;
+    }
+
+    const std::string &errorText(void) const {
+        return error;
+    }
+
+    size_t length(void) const {
+        return program.size();
+    }
+
+    // Number of matching rows. The first `limit` of them, in row order, go to
+    // `matches` if it is not NULL.
+    uint64_t run(const GameDb &db, ThreadPool &pool, std::vector<uint64_t> *matches, uint64_t limit) const {
+        uint64_t rows = db.rowCount();
+        size_t chunks = (rows + DB_CHUNK_ROWS - 1) / DB_CHUNK_ROWS;
+        std::vector<std::vector<uint64_t>> found(chunks);
+        std::atomic<uint64_t> total(0);
+
+        parallelFor(pool, chunks, 1, [&](size_t first, size_t last) {
+            for(size_t c = first; c < last; c++) {
+                uint64_t begin = c * (uint64_t)DB_CHUNK_ROWS;
+                uint64_t end = (begin + DB_CHUNK_ROWS < rows) ? begin + DB_CHUNK_ROWS : rows;
+                total += runRange(db, begin, end, matches ? &found[c] : NULL, limit);
+            }
+        });
+
+        if(matches) {
+            matches->clear();
+            for(size_t c = 0; c < chunks && matches->size() < limit; c++)
+                for(size_t i = 0; i < found[c].size() && matches->size() < limit; i++)
+                    matches->push_back(found[c][i]);
+        }
+        return total;
+    }
+
+    // Single threaded scan of rows [begin, end)
+    uint64_t runRange(const GameDb &db, uint64_t begin, uint64_t end, std::vector<uint64_t> *out, uint64_t limit) const {
+        static thread_local uint32_t *stack = NULL;
+        if(!stack)
+            stack = (uint32_t *)aligned_alloc(32, sizeof(uint32_t) * DB_MAX_STACK * DB_BLOCK_ROWS);
+
+        uint64_t count = 0;
+        for(uint64_t row = begin; row < end; row += DB_BLOCK_ROWS) {
+            int n = (end - row < DB_BLOCK_ROWS) ? (int)(end - row) : DB_BLOCK_ROWS;
+            runBlock(db, row, n, stack);
+            for(int i = 0; i < n; i++)
+                if(stack[i]) {
+                    count++;
+                    if(out && out->size() < limit)
+                        out->push_back(row + i);
+                }
+        }
+        return count;
+    }
+
+private:
+    // Every register is padded to whole vectors; rows past `n` hold zeros
+    void runBlock(const GameDb &db, uint64_t row, int n, uint32_t *stack) const {
+        int padded = (n + 7) & ~7;
+        int top = 0;
+        for(size_t i = 0; i < program.size(); i++) {
+            const DbInstruction &ins = program[i];
+            uint32_t *dst = stack + top * DB_BLOCK_ROWS;
+            if(ins.op == DB_OP_LOAD) {
+                loadColumn(db, ins.arg, row, n, padded, dst);
+                top++;
+                continue;
+            }
+            if(ins.op == DB_OP_CONST) {
+                for(int r = 0; r < padded; r++)
+                    dst[r] = ins.arg;
+                top++;
+                continue;
+            }
+
+            bool binary = ins.op == DB_OP_AND || ins.op == DB_OP_OR || ins.op == DB_OP_XOR ||
+                          ins.op == DB_OP_EQ || ins.op == DB_OP_LT || ins.op == DB_OP_GT;
+            uint32_t *a = stack + (top - (binary ? 2 : 1)) * DB_BLOCK_ROWS;
+            uint32_t *b = binary ? a + DB_BLOCK_ROWS : NULL;
+#ifdef EVAL_BATCH_X86
+            if(bestEvalKernel() == EVAL_KERNEL_AVX2)
+                applyAVX2(ins, a, b, padded);
+            else
+#endif
+                applyScalar(ins, a, b, padded);
+            if(binary)
+                top--;
+        }
+    }
+
+    static void loadColumn(const GameDb &db, int column, uint64_t row, int n, int padded, uint32_t *dst) {
+        int width = dbColumnInfo(column).width;
+        const uint8_t *src = db.column(column) + row * width;
+        if(width == 4)
+            memcpy(dst, src, n * 4);
+        else if(width == 2)
+            for(int r = 0; r < n; r++)
+                dst[r] = src[2*r] | (src[2*r + 1] << 8);
+        else
+            for(int r = 0; r < n; r++)
+                dst[r] = src[r];
+        for(int r = n; r < padded; r++)
+            dst[r] = 0;
+    }
+
+    // Result goes to `a`
+    static void applyScalar(const DbInstruction &ins, uint32_t *a, const uint32_t *b, int n) {
+        switch(ins.op) {
+            case DB_OP_AND:   for(int r = 0; r < n; r++) a[r] &= b[r]; break;
+            case DB_OP_OR:    for(int r = 0; r < n; r++) a[r] |= b[r]; break;
+            case DB_OP_XOR:   for(int r = 0; r < n; r++) a[r] ^= b[r]; break;
+            case DB_OP_NOT:   for(int r = 0; r < n; r++) a[r] ^= ins.arg; break;
+            case DB_OP_ADJ:   for(int r = 0; r < n; r++) a[r] = adjacentSquares(a[r]); break;
+            case DB_OP_ANY:   for(int r = 0; r < n; r++) a[r] = a[r] ? ~0u : 0; break;
+            case DB_OP_COUNT: for(int r = 0; r < n; r++) a[r] = __builtin_popcount(a[r]); break;
+            case DB_OP_EQ:    for(int r = 0; r < n; r++) a[r] = (a[r] == b[r]) ? ~0u : 0; break;
+            case DB_OP_LT:    for(int r = 0; r < n; r++) a[r] = ((int32_t)a[r] < (int32_t)b[r]) ? ~0u : 0; break;
+            case DB_OP_GT:    for(int r = 0; r < n; r++) a[r] = ((int32_t)a[r] > (int32_t)b[r]) ? ~0u : 0; break;
+            default: break;
+        }
+    }
+
+#ifdef EVAL_BATCH_X86
+    __attribute__((target("avx2")))
+    static __m256i adjacentAVX2(__m256i m) {
+        const __m256i board = _mm256_set1_epi32(BOARD_MASK);
+        __m256i up = _mm256_and_si256(m, _mm256_set1_epi32(DB_NOT_Y4));
+        __m256i down = _mm256_and_si256(m, _mm256_set1_epi32(DB_NOT_Y0));
+        __m256i r = _mm256_or_si256(_mm256_slli_epi32(m, 5), _mm256_srli_epi32(m, 5));
+        r = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(up, 1), _mm256_srli_epi32(down, 1)));
+        r = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(up, 6), _mm256_srli_epi32(up, 4)));
+        r = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(down, 4), _mm256_srli_epi32(down, 6)));
+        return _mm256_and_si256(r, board);
+    }
+
+    // Per-lane popcount: nibble lookup, then the four byte counts summed
+    __attribute__((target("avx2")))
+    static __m256i popcountAVX2(__m256i m) {
+        const __m256i table = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+        const __m256i low = _mm256_set1_epi8(0x0F);
+        __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(table, _mm256_and_si256(m, low)),
+                                        _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi32(m, 4), low)));
+        return _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+    }
+
+    __attribute__((target("avx2")))
+    static void applyAVX2(const DbInstruction &ins, uint32_t *a, const uint32_t *b, int n) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi32(-1);
+        const __m256i arg = _mm256_set1_epi32(ins.arg);
+        for(int r = 0; r < n; r += 8) {
+            __m256i x = _mm256_load_si256((const __m256i *)(a + r));
+            __m256i y = b ? _mm256_load_si256((const __m256i *)(b + r)) : zero;
+            switch(ins.op) {
+                case DB_OP_AND:   x = _mm256_and_si256(x, y); break;
+                case DB_OP_OR:    x = _mm256_or_si256(x, y); break;
+                case DB_OP_XOR:   x = _mm256_xor_si256(x, y); break;
+                case DB_OP_NOT:   x = _mm256_xor_si256(x, arg); break;
+                case DB_OP_ADJ:   x = adjacentAVX2(x); break;
+                case DB_OP_ANY:   x = _mm256_xor_si256(_mm256_cmpeq_epi32(x, zero), ones); break;
+                case DB_OP_COUNT: x = popcountAVX2(x); break;
+                case DB_OP_EQ:    x = _mm256_cmpeq_epi32(x, y); break;
+                case DB_OP_LT:    x = _mm256_cmpgt_epi32(y, x); break;
+                case DB_OP_GT:    x = _mm256_cmpgt_epi32(x, y); break;
+                default: break;
+            }
+            _mm256_store_si256((__m256i *)(a + r), x);
+        }
+    }
+#endif
+
+    int fail(const char *message) {
+        if(error.empty())
+            error = std::string(message) + ((cursor && *cursor) ? " at \"" + std::string(cursor) + "\"" : " at the end");
+        return -1;
+    }
+
+    void emit(DbOp op, uint32_t arg = 0) {
+        DbInstruction ins = { op, arg };
+        program.push_back(ins);
+        if(op == DB_OP_LOAD || op == DB_OP_CONST)
+            depth++;
+        else if(op == DB_OP_AND || op == DB_OP_OR || op == DB_OP_XOR ||
+                op == DB_OP_EQ || op == DB_OP_LT || op == DB_OP_GT)
+            depth--;
+        if(depth > maxDepth)
+            maxDepth = depth;
+    }
+
+    void skipSpace(void) {
+        while(isspace((unsigned char)*cursor))
+            cursor++;
+    }
+
+    // Consumes `token` if it comes next; words must end at a word boundary
+    bool accept(const char *token) {
+        skipSpace();
+        size_t len = strlen(token);
+        if(strncmp(cursor, token, len))
+            return false;
+        if(isalpha((unsigned char)token[0]) && (isalnum((unsigned char)cursor[len]) || cursor[len] == '_'))
+            return false;
+        cursor += len;
+        return true;
+    }
+
+    // `!` as negation, leaving `!=` alone
+    bool acceptBang(void) {
+        skipSpace();
+        if(cursor[0] != '!' || cursor[1] == '=')
+            return false;
+        cursor++;
+        return true;
+    }
+
+    int parseOr(DbType &type) {
+        if(parseXor(type))
+            return -1;
+        while(accept("or") || accept("|")) {
+            DbType rhs;
+            if(parseXor(rhs))
+                return -1;
+            if(rhs != type || type == DB_TYPE_NUMBER)
+                return fail("| needs two masks or two conditions");
+            emit(DB_OP_OR);
+        }
+        return 0;
+    }
+
+    int parseXor(DbType &type) {
+        if(parseAnd(type))
+            return -1;
+        while(accept("^")) {
+            DbType rhs;
+            if(parseAnd(rhs))
+                return -1;
+            if(rhs != type || type == DB_TYPE_NUMBER)
+                return fail("^ needs two masks or two conditions");
+            emit(DB_OP_XOR);
+        }
+        return 0;
+    }
+
+    int parseAnd(DbType &type) {
+        if(parseCompare(type))
+            return -1;
+        while(accept("and") || accept("&")) {
+            DbType rhs;
+            if(parseCompare(rhs))
+                return -1;
+            if(rhs != type || type == DB_TYPE_NUMBER)
+                return fail("& needs two masks or two conditions");
+            emit(DB_OP_AND);
+        }
+        return 0;
+    }
+
+    int parseCompare(DbType &type) {
+        if(parseUnary(type))
+            return -1;
+        static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+        for(int i = 0; i < 6; i++) {
+            if(!accept(ops[i]))
+                continue;
+            DbType rhs;
+            if(parseUnary(rhs))
+                return -1;
+            if(type != DB_TYPE_NUMBER || rhs != DB_TYPE_NUMBER)
+                return fail("comparisons need numbers, e.g. count(mask) or ply");
+            switch(i) {
+                case 0: emit(DB_OP_EQ); break;
+                case 1: emit(DB_OP_EQ); emit(DB_OP_NOT, ~0u); break;
+                case 2: emit(DB_OP_GT); emit(DB_OP_NOT, ~0u); break;
+                case 3: emit(DB_OP_LT); emit(DB_OP_NOT, ~0u); break;
+                case 4: emit(DB_OP_LT); break;
+                case 5: emit(DB_OP_GT); break;
+            }
+            type = DB_TYPE_BOOL;
+            break;
+        }
+        return 0;
+    }
+
+    int parseUnary(DbType &type) {
+        if(accept("~") || accept("not") || acceptBang()) {
+            if(parseUnary(type))
+                return -1;
+            if(type == DB_TYPE_NUMBER)
+                return fail("cannot negate a number");
+            emit(DB_OP_NOT, type == DB_TYPE_MASK ? BOARD_MASK : ~0u);
+            return 0;
+        }
+        return parsePrimary(type);
+    }
+
+    int parseArgument(DbType &type) {
+        if(!accept("("))
+            return fail("expected (");
+        if(parseOr(type))
+            return -1;
+        if(!accept(")"))
+            return fail("expected )");
+        return 0;
+    }
+
+    int parsePrimary(DbType &type) {
+        skipSpace();
+        if(isdigit((unsigned char)*cursor)) {
+            char *end;
+            unsigned long value = strtoul(cursor, &end, 10);
+            cursor = end;
+            emit(DB_OP_CONST, (uint32_t)value);
+            type = DB_TYPE_NUMBER;
+            return 0;
+        }
+        if(accept("(")) {
+            if(parseOr(type))
+                return -1;
+            return accept(")") ? 0 : fail("expected )");
+        }
+
+        static const struct { const char *name; DbOp op; DbType result; } functions[] = {
+            { "adj", DB_OP_ADJ, DB_TYPE_MASK },
+            { "any", DB_OP_ANY, DB_TYPE_BOOL },
+            { "none", DB_OP_ANY, DB_TYPE_BOOL },
+            { "count", DB_OP_COUNT, DB_TYPE_NUMBER }
+        };
+        for(int i = 0; i < 4; i++) {
+            if(!accept(functions[i].name))
+                continue;
+            DbType arg;
+            if(parseArgument(arg))
+                return -1;
+            if(arg != DB_TYPE_MASK)
+                return fail("expected a mask argument");
+            emit(functions[i].op);
+            if(!strcmp(functions[i].name, "none"))
+                emit(DB_OP_NOT, ~0u);
+            type = functions[i].result;
+            return 0;
+        }
+
+        static const struct { const char *name; int column; DbType type; } columns[] = {
+            { "L1", DB_L1, DB_TYPE_MASK }, { "L2", DB_L2, DB_TYPE_MASK }, { "L3", DB_L3, DB_TYPE_MASK },
+            { "L4", DB_DOME, DB_TYPE_MASK }, { "dome", DB_DOME, DB_TYPE_MASK },
+            { "mover", DB_MOVER, DB_TYPE_MASK }, { "opp", DB_OPP, DB_TYPE_MASK },
+            { "ply", DB_PLY, DB_TYPE_NUMBER }, { "toMove", DB_TO_MOVE, DB_TYPE_NUMBER },
+            { "players", DB_PLAYERS, DB_TYPE_NUMBER }, { "game", DB_GAME, DB_TYPE_NUMBER }
+        };
+        for(int i = 0; i < 11; i++)
+            if(accept(columns[i].name)) {
+                emit(DB_OP_LOAD, columns[i].column);
+                type = columns[i].type;
+                return 0;
+            }
+
+        // Masks derived from the stored columns
+        type = DB_TYPE_MASK;
+        if(accept("L0")) {
+            emit(DB_OP_LOAD, DB_L1);
+            emit(DB_OP_LOAD, DB_L2); emit(DB_OP_OR);
+            emit(DB_OP_LOAD, DB_L3); emit(DB_OP_OR);
+            emit(DB_OP_LOAD, DB_DOME); emit(DB_OP_OR);
+            emit(DB_OP_NOT, BOARD_MASK);
+            return 0;
+        }
+        if(accept("occ")) {
+            emit(DB_OP_LOAD, DB_MOVER);
+            emit(DB_OP_LOAD, DB_OPP); emit(DB_OP_OR);
+            return 0;
+        }
+        if(accept("empty")) {
+            emit(DB_OP_LOAD, DB_MOVER);
+            emit(DB_OP_LOAD, DB_OPP); emit(DB_OP_OR);
+            emit(DB_OP_LOAD, DB_DOME); emit(DB_OP_OR);
+            emit(DB_OP_NOT, BOARD_MASK);
+            return 0;
+        }
+        if(accept("all")) {
+            emit(DB_OP_CONST, BOARD_MASK);
+            return 0;
+        }
+        return fail("expected a mask, number or function");
+    }
+};
+#endif
@@ -0,0 +1,466 @@
+#ifndef DFPN_H
+#define DFPN_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "game_state.h"
+#include "search.h"
+#include "thread_pool.h"
+
+#define DFPN_INF          0x3FFFFFFFu
+#define DFPN_BUCKET       4
+#define DFPN_DEFAULT_MB   256
+
+// Proven outcome for the side to move; two player games only
+enum DfpnResult {
+    DFPN_UNKNOWN = 0,
+    DFPN_WIN,
+    DFPN_LOSS
+};
+
+inline const char *dfpnResultName(DfpnResult r) {
+    switch(r) {
+        case DFPN_WIN:  return "win";
+        case DFPN_LOSS: return "loss";
+        default:        return "unknown";
+    }
+}
+
+// Proof and disproof numbers of positions, shared by every solver thread.
+// Numbers are for the side to move: phi = 0 is a proven win, delta = 0 a
+// proven loss. Each bucket keeps the proven entries first, then the ones with
+// the most work behind them.
+// Like TranspositionTable, an entry stores its key xor its data, so a torn
+// read from a racing store fails the key check instead of returning garbage.
+class DfpnTable
+{
+    struct Entry {
+        std::atomic<uint64_t> key;      // position hash ^ data
+        std::atomic<uint64_t> data;     // phi << 32 | delta
+        std::atomic<uint64_t> work;     // nodes searched below; a hint for replacement
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    uint64_t bucketMask;
+
+public:
+    DfpnTable(size_t megabytes = DFPN_DEFAULT_MB) {
+        uint64_t buckets = 1;
+        while(buckets * 2 * DFPN_BUCKET * sizeof(Entry) <= megabytes * 1024 * 1024)
+            buckets *= 2;
+        entries.reset(new Entry[buckets * DFPN_BUCKET]);
+        bucketMask = buckets - 1;
+        clear();
+    }
+
+    void clear(void) {
+        for(uint64_t i = 0; i < (bucketMask + 1) * DFPN_BUCKET; i++) {
+            entries[i].key.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+            entries[i].work.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t entryCount(void) const {
+        return (bucketMask + 1) * DFPN_BUCKET;
+    }
+
+    bool probe(uint64_t key, uint32_t &phi, uint32_t &delta) const {
+        const Entry *e = &entries[(key & bucketMask) * DFPN_BUCKET];
+        for(int i = 0; i < DFPN_BUCKET; i++) {
+            uint64_t data = e[i].data.load(std::memory_order_relaxed);
+            if((e[i].key.load(std::memory_order_relaxed) ^ data) == key && data) {
+                phi = data >> 32;
+                delta = (uint32_t)data;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Updates the entry for `key`, or takes the slot of the least valuable
+    // entry in the bucket when the new one is worth at least as much;
+    // otherwise the new entry is dropped
+    void store(uint64_t key, uint32_t phi, uint32_t delta, uint64_t work) {
+        Entry *e = &entries[(key & bucketMask) * DFPN_BUCKET];
+        uint64_t data = ((uint64_t)phi << 32) | delta;
+        Entry *victim = NULL;
+        uint64_t victimValue = ~0ull;
+        for(int i = 0; i < DFPN_BUCKET; i++) {
+            uint64_t d = e[i].data.load(std::memory_order_relaxed);
+            if(!d || (e[i].key.load(std::memory_order_relaxed) ^ d) == key) {
+                victim = &e[i];
+                victimValue = 0;
+                break;
+            }
+            uint64_t v = value(d, e[i].work.load(std::memory_order_relaxed));
+            if(v < victimValue) {
+                victim = &e[i];
+                victimValue = v;
+            }
+        }
+        if(value(data, work) < victimValue)
+            return;
+        victim->key.store(key ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+        victim->work.store(work, std::memory_order_relaxed);
+    }
+
+private:
+    // Proven and disproven entries never need searching again, so they
+    // outrank any unproven one; within each kind, more work is worth more
+    static uint64_t value(uint64_t data, uint64_t work) {
+        bool proven = !(data >> 32) || !(uint32_t)data;
+        return ((uint64_t)proven << 63) | std::min(work, ((uint64_t)1 << 63) - 1);
+    }
+};
+
+// Depth-first proof-number search from one thread. Santorini has no cycles
+// (every turn that does not win builds a level), so no repetition handling
+// is needed and table entries are exact.
+class DfpnSolver
+{
+    DfpnTable *table;
+    const std::atomic<bool> *stopFlag;
+    uint64_t nodes;
+    uint64_t nodeLimit;
+    int64_t deadline;
+    bool aborted;
+
+public:
+    DfpnSolver(DfpnTable &t) : table(&t), stopFlag(NULL), nodes(0), nodeLimit(0),
+                               deadline(NO_DEADLINE), aborted(false) {}
+
+    // Works on `state` until it is proven, its numbers reach the thresholds,
+    // `maxNodes` (0 for no limit) have been searched, the deadline passes or
+    // `*stop` is set. Progress stays in the table, so calling again continues
+    // where this left off.
+    DfpnResult solve(const GameState &state, uint64_t maxNodes, int64_t deadlineMs,
+                     const std::atomic<bool> *stop = NULL,
+                     uint32_t thPhi = DFPN_INF, uint32_t thDelta = DFPN_INF) {
+        stopFlag = stop;
+        nodeLimit = maxNodes ? nodes + maxNodes : 0;
+        deadline = deadlineMs;
+        aborted = false;
+
+        uint32_t phi, delta;
+        if(terminal(state, phi, delta) || (table->probe(state.hash, phi, delta) && (!phi || !delta)))
+            return phi ? DFPN_LOSS : DFPN_WIN;
+        mid(state, thPhi, thDelta);
+        if(!table->probe(state.hash, phi, delta))
+            return DFPN_UNKNOWN;
+        return !phi ? DFPN_WIN : (!delta ? DFPN_LOSS : DFPN_UNKNOWN);
+    }
+
+    uint64_t nodeCount(void) const {
+        return nodes;
+    }
+
+    // Numbers for a position decided on the spot: the side to move can step
+    // up (win) or cannot move at all (loss)
+    static bool terminal(const GameState &state, uint32_t &phi, uint32_t &delta) {
+        if(state.winningSquares(state.toMove)) {
+            phi = 0;
+            delta = DFPN_INF;
+            return true;
+        }
+        if(!state.hasMoves()) {
+            phi = DFPN_INF;
+            delta = 0;
+            return true;
+        }
+        return false;
+    }
+
+private:
+    void checkLimits(void) {
+        if((nodeLimit && nodes >= nodeLimit) ||
+           (stopFlag && stopFlag->load(std::memory_order_relaxed)) ||
+           ((nodes & 1023) == 0 && nowMs() >= deadline))
+            aborted = true;
+    }
+
+    // Multiple iterative deepening: expand `state` until its phi or delta
+    // reaches the given threshold
+    void mid(const GameState &state, uint32_t thPhi, uint32_t thDelta) {
+        nodes++;
+        uint64_t startNodes = nodes;
+        checkLimits();
+
+        // Terminal children are settled once; the rest are read from the table
+        MoveList moves;
+        state.generateMoves(moves);
+        uint64_t childHash[MAX_MOVES];
+        uint32_t fixedPhi[MAX_MOVES], fixedDelta[MAX_MOVES];
+        bool fixed[MAX_MOVES];
+        for(int i = 0; i < moves.count; i++) {
+            GameState child = state;
+            child.apply(moves.moves[i]);
+            childHash[i] = child.hash;
+            fixed[i] = terminal(child, fixedPhi[i], fixedDelta[i]);
+        }
+
+        for(;;) {
+            // phi(n) = min delta(c), delta(n) = sum phi(c)
+            uint32_t phi = DFPN_INF, delta = 0;
+            uint32_t bestDelta = DFPN_INF, secondDelta = DFPN_INF, bestPhi = 0;
+            int best = -1;
+            for(int i = 0; i < moves.count; i++) {
+                uint32_t cPhi = fixedPhi[i], cDelta = fixedDelta[i];
+                if(!fixed[i] && !table->probe(childHash[i], cPhi, cDelta))
+                    cPhi = cDelta = 1;
+                if(cDelta < phi)
+                    phi = cDelta;
+                delta = (delta + cPhi >= DFPN_INF) ? DFPN_INF : delta + cPhi;
+                if(cDelta < bestDelta || best < 0) {
+                    secondDelta = bestDelta;
+                    bestDelta = cDelta;
+                    bestPhi = cPhi;
+                    best = i;
+                }
+                else if(cDelta < secondDelta)
+                    secondDelta = cDelta;
+            }
+
+            if(phi >= thPhi || delta >= thDelta || aborted || best < 0) {
+                table->store(state.hash, phi, delta, nodes - startNodes + 1);
+                return;
+            }
+
+            uint64_t childPhi = (uint64_t)thDelta - delta + bestPhi;
+            // 1+epsilon: let the child run a little past the runner-up before switching
+            uint64_t childDelta = (uint64_t)secondDelta + secondDelta / 4 + 1;
+            if(childDelta > thPhi)
+                childDelta = thPhi;
+            GameState child = state;
+            child.apply(moves.moves[best]);
+            mid(child, childPhi >= DFPN_INF ? DFPN_INF : (uint32_t)childPhi, (uint32_t)childDelta);
+        }
+    }
+};
+
+struct DfpnReport
+{
+    DfpnResult result;
+    Move best;              // a winning move, or NULL_MOVE
+    uint64_t nodes;
+    uint64_t proofSize;     // distinct positions in the proof tree
+    uint64_t proofMissing;  // proof positions no longer in the table
+    int64_t timeMs;
+};
+
+// Positions in the proof of `state`'s proven result, read back from the
+// table: one winning reply at each of the winner's turns, every reply at
+// the loser's
+inline void dfpnProofSize(const GameState &state, const DfpnTable &table, std::unordered_set<uint64_t> &seen,
+                          uint64_t &missing) {
+    if(!seen.insert(state.hash).second)
+        return;
+    uint32_t phi, delta;
+    if(DfpnSolver::terminal(state, phi, delta))
+        return;
+    if(!table.probe(state.hash, phi, delta) || (phi && delta)) {
+        missing++;
+        return;
+    }
+
+    MoveList moves;
+    state.generateMoves(moves);
+    for(int i = 0; i < moves.count; i++) {
+        GameState child = state;
+        child.apply(moves.moves[i]);
+        uint32_t cPhi, cDelta;
+        bool known = DfpnSolver::terminal(child, cPhi, cDelta) || table.probe(child.hash, cPhi, cDelta);
+        if(!phi) {
+            // Winner: follow one reply that leaves the opponent lost
+            if(known && !cDelta) {
+                dfpnProofSize(child, table, seen, missing);
+                return;
+            }
+        }
+        else
+            dfpnProofSize(child, table, seen, missing);
+    }
+    if(!phi)
+        missing++;
+}
+
+// Proves or disproves `root` for the side to move, with the pool's threads
+// working on different root moves and sharing one table. Stops once any
+// move is proven to win, or at `maxNodes` (0 = no limit), `timeMs` (0 = no
+// limit) or when `*stop` is set.
+inline DfpnReport dfpnSolve(const GameState &root, DfpnTable &table, ThreadPool &pool, uint64_t maxNodes,
+                            int64_t timeMs, const std::atomic<bool> *stop = NULL) {
+    DfpnReport report;
+    memset(&report, 0, sizeof(report));
+    report.best = NULL_MOVE;
+    int64_t start = nowMs();
+    int64_t deadline = timeMs > 0 ? start + timeMs : NO_DEADLINE;
+
+    if(root.numPlayers != 2)
+        return report;
+    if(root.isOver()) {
+        report.result = (root.winner == root.toMove) ? DFPN_WIN : DFPN_LOSS;
+        report.proofSize = 1;
+        return report;
+    }
+
+    uint32_t phi, delta;
+    MoveList moves;
+    root.generateMoves(moves);
+    if(DfpnSolver::terminal(root, phi, delta)) {
+        report.result = phi ? DFPN_LOSS : DFPN_WIN;
+        for(int i = 0; i < moves.count && !phi; i++)
+            if(moves.moves[i].isWin())
+                report.best = moves.moves[i];
+        report.proofSize = 1;
+        report.timeMs = nowMs() - start;
+        return report;
+    }
+
+    std::vector<std::unique_ptr<DfpnSolver>> solvers;
+    for(int i = 0; i < pool.size(); i++)
+        solvers.push_back(std::unique_ptr<DfpnSolver>(new DfpnSolver(table)));
+
+    std::vector<GameState> children(moves.count, root);
+    for(int i = 0; i < moves.count; i++)
+        children[i].apply(moves.moves[i]);
+
+    // Each round reads the root moves' numbers (for the opponent, who moves
+    // next) and hands the most promising ones, fewest disproofs needed first,
+    // to the pool. A thread works on its move until it is no longer among the
+    // best, which is the root expansion of df-pn spread over several moves.
+    std::vector<uint32_t> cPhi(moves.count), cDelta(moves.count);
+    std::vector<int> order(moves.count);
+    std::atomic<uint64_t> nodes(0);
+    int winner = -1;
+    for(;;) {
+        bool allWon = true;
+        int open = 0;
+        for(int i = 0; i < moves.count; i++) {
+            if(!DfpnSolver::terminal(children[i], cPhi[i], cDelta[i]) &&
+               !table.probe(children[i].hash, cPhi[i], cDelta[i]))
+                cPhi[i] = cDelta[i] = 1;
+            if(!cDelta[i] && winner < 0)
+                winner = i;
+            allWon = allWon && !cPhi[i];
+            if(cPhi[i] && cDelta[i])
+                order[open++] = i;
+        }
+        if(winner >= 0) {
+            report.result = DFPN_WIN;
+            report.best = moves.moves[winner];
+            break;
+        }
+        if(allWon) {
+            report.result = DFPN_LOSS;
+            break;
+        }
+        if((maxNodes && nodes >= maxNodes) || nowMs() >= deadline || (stop && *stop))
+            break;
+
+        std::sort(order.begin(), order.begin() + open, [&](int a, int b) { return cDelta[a] < cDelta[b]; });
+        int picked = std::min(open, pool.size());
+        uint32_t threshold = (picked < open) ? cDelta[order[picked]] + 1 : DFPN_INF;
+        TaskGroup round(pool);
+        for(int k = 0; k < picked; k++) {
+            int i = order[k];
+            uint32_t thDelta = std::max(threshold, cDelta[i] + 1);
+            round.run([&, i, thDelta] {
+                DfpnSolver &solver = *solvers[pool.currentIndex()];
+                uint64_t before = solver.nodeCount();
+                uint64_t allowed = 0;
+                if(maxNodes) {
+                    uint64_t used = nodes.load();
+                    allowed = (used >= maxNodes) ? 1 : maxNodes - used;
+                }
+                solver.solve(children[i], allowed, deadline, stop, DFPN_INF, thDelta);
+                nodes += solver.nodeCount() - before;
+            });
+        }
+        round.wait();
+    }
+    report.nodes = nodes;
+    report.timeMs = nowMs() - start;
+
+    if(report.result != DFPN_UNKNOWN) {
+        std::unordered_set<uint64_t> seen;
+        seen.insert(root.hash);
+        for(int i = 0; i < moves.count; i++) {
+            if(report.result == DFPN_WIN && i != winner)
+                continue;
+            GameState child = root;
+            child.apply(moves.moves[i]);
+            dfpnProofSize(child, table, seen, report.proofMissing);
+        }
+        report.proofSize = seen.size();
+    }
+    return report;
+}
+// Solves one position at a time on a background thread, for the UI: start()
+// a position, poll() once per frame for the report. The search itself runs
+// on `pool`, by default the process wide one.
+class DfpnAnalyzer
+{
+    DfpnTable table;
+    ThreadPool &pool;
+    std::thread worker;
+    std::atomic<bool> stopFlag;
+    std::atomic<bool> done;
+    GameState state;
+    DfpnReport report;
+
+public:
+    DfpnAnalyzer(size_t megabytes = DFPN_DEFAULT_MB, ThreadPool &threads = ThreadPool::shared())
+        : table(megabytes), pool(threads), stopFlag(false), done(false) {}
+
+    ~DfpnAnalyzer() {
+        cancel();
+    }
+
+    bool isBusy(void) const {
+        return worker.joinable();
+    }
+
+    // Ignored while a solve is running
+    void start(const GameState &position, int64_t timeMs) {
+        if(worker.joinable())
+            return;
+        state = position;
+        stopFlag = false;
+        done = false;
+        worker = std::thread([this, timeMs] {
+            report = dfpnSolve(state, table, pool, 0, timeMs, &stopFlag);
+            done = true;
+        });
+    }
+
+    // True once per finished solve, with the position it was for
+    bool poll(GameState &position, DfpnReport &out) {
+        if(!done)
+            return false;
+        worker.join();
+        done = false;
+        position = state;
+        out = report;
+        return true;
+    }
+
+    void cancel(void) {
+        if(!worker.joinable())
+            return;
+        stopFlag = true;
+        worker.join();
+        done = false;
+    }
+};
+#endif
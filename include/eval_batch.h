@@ -0,0 +1,141 @@
+#ifndef EVAL_BATCH_H
+#define EVAL_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "game_state.h"
+#include "evaluate.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EVAL_BATCH_X86 1
+#endif
+
+#define BOARD_MASK ((1u << NUM_SQUARES) - 1)
+
+enum EvalKernel {
+    EVAL_KERNEL_SCALAR = 0,
+    EVAL_KERNEL_SSE4   = 1,
+    EVAL_KERNEL_AVX2   = 2
+};
+
+inline const char *evalKernelName(EvalKernel k) {
+    switch(k) {
+        case EVAL_KERNEL_SCALAR: return "scalar";
+        case EVAL_KERNEL_SSE4:   return "sse4";
+        case EVAL_KERNEL_AVX2:   return "avx2";
+    }
+    return "?";
+}
+
+// Same terms as evaluate(), but worked from per-level square masks so each
+// worker costs a couple of popcounts instead of a walk over its neighbours.
+// `eq[l]` holds the squares at level l.
+__attribute__((always_inline))
+inline int scoreFromLevelMasks(const GameState &state, const uint32_t eq[DOME_LEVEL+1]) {
+    const Neighbours &adj = neighbours();
+    uint32_t atMost[WIN_LEVEL+1];
+    atMost[0] = eq[0];
+    for(int l = 1; l <= WIN_LEVEL; l++)
+        atMost[l] = atMost[l-1] | eq[l];
+    uint32_t open = ~state.occupied & ~eq[DOME_LEVEL] & BOARD_MASK;
+
+    int score = 0;
+    for(uint8_t p = 0; p < state.numPlayers; p++) {
+        int playerScore = 0;
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+            uint8_t sq = state.workers[p][w];
+            if(sq == NO_SQUARE)
+                continue;
+            int level = state.heights[sq];
+            int reach = (level + 1 > WIN_LEVEL) ? WIN_LEVEL : level + 1;
+            uint32_t steps = adj.mask[sq] & open & atMost[reach];
+
+            playerScore += EVAL_LEVEL[level] + EVAL_CENTRALITY[sq];
+            playerScore += __builtin_popcount(steps) * EVAL_MOBILITY;
+            if(level + 1 <= WIN_LEVEL)
+                playerScore += __builtin_popcount(steps & eq[level+1]) *
+                               ((level + 1 == WIN_LEVEL) ? EVAL_THREAT : EVAL_CLIMBABLE);
+        }
+        score += (p == state.toMove) ? playerScore : -playerScore;
+    }
+    return score;
+}
+
+inline void evaluateBatchScalar(const GameState *states, int count, int *scores) {
+    for(int i = 0; i < count; i++) {
+        uint32_t eq[DOME_LEVEL+1] = { 0, 0, 0, 0, 0 };
+        for(int sq = 0; sq < NUM_SQUARES; sq++)
+            eq[states[i].heights[sq]] |= 1u << sq;
+        scores[i] = scoreFromLevelMasks(states[i], eq);
+    }
+}
+
+#ifdef EVAL_BATCH_X86
+static_assert(offsetof(GameState, heights) == 0 && sizeof(GameState) >= 32,
+              "batch kernels load the height grid 32 bytes at a time");
+
+// The height grid is 25 bytes at the start of GameState, so one 32 byte load
+// (two 16 byte loads for SSE) picks up the whole board; the bytes past the
+// grid belong to the same struct and are masked off.
+
+__attribute__((target("sse4.2,popcnt")))
+inline void evaluateBatchSSE4(const GameState *states, int count, int *scores) {
+    __m128i level[DOME_LEVEL+1];
+    for(int l = 0; l <= DOME_LEVEL; l++)
+        level[l] = _mm_set1_epi8(l);
+
+    for(int i = 0; i < count; i++) {
+        const __m128i *grid = (const __m128i *)states[i].heights;
+        __m128i lo = _mm_loadu_si128(grid);
+        __m128i hi = _mm_loadu_si128(grid + 1);
+        uint32_t eq[DOME_LEVEL+1];
+        for(int l = 0; l <= DOME_LEVEL; l++)
+            eq[l] = ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, level[l])) |
+                     ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, level[l])) << 16)) & BOARD_MASK;
+        scores[i] = scoreFromLevelMasks(states[i], eq);
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+inline void evaluateBatchAVX2(const GameState *states, int count, int *scores) {
+    __m256i level[DOME_LEVEL+1];
+    for(int l = 0; l <= DOME_LEVEL; l++)
+        level[l] = _mm256_set1_epi8(l);
+
+    for(int i = 0; i < count; i++) {
+        __m256i grid = _mm256_loadu_si256((const __m256i *)states[i].heights);
+        uint32_t eq[DOME_LEVEL+1];
+        for(int l = 0; l <= DOME_LEVEL; l++)
+            eq[l] = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(grid, level[l])) & BOARD_MASK;
+        scores[i] = scoreFromLevelMasks(states[i], eq);
+    }
+}
+#endif
+
+// Best kernel this CPU supports, checked once
+inline EvalKernel bestEvalKernel(void) {
+#ifdef EVAL_BATCH_X86
+    static const EvalKernel kernel = __builtin_cpu_supports("avx2") ? EVAL_KERNEL_AVX2 :
+                                     __builtin_cpu_supports("sse4.2") ? EVAL_KERNEL_SSE4 :
+                                     EVAL_KERNEL_SCALAR;
+    return kernel;
+#else
+    return EVAL_KERNEL_SCALAR;
+#endif
+}
+
+// Static scores for `count` positions, each from its own side to move's point
+// of view; identical to calling evaluate() on each
+inline void evaluateBatch(const GameState *states, int count, int *scores,
+                          EvalKernel kernel = bestEvalKernel()) {
+    switch(kernel) {
+#ifdef EVAL_BATCH_X86
+        case EVAL_KERNEL_AVX2: evaluateBatchAVX2(states, count, scores); break;
+        case EVAL_KERNEL_SSE4: evaluateBatchSSE4(states, count, scores); break;
+#endif
+        default: evaluateBatchScalar(states, count, scores); break;
+    }
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "game_state.h"
+
+#define EVAL_MOBILITY   4
+#define EVAL_CLIMBABLE  12
+#define EVAL_THREAT     200
+
+const int EVAL_LEVEL[DOME_LEVEL+1] = { 0, 40, 150, 400, 0 };
+
+const int EVAL_CENTRALITY[NUM_SQUARES] = {
+    0,  4,  6,  4,  0,
+    4, 12, 14, 12,  4,
+    6, 14, 20, 14,  6,
+    4, 12, 14, 12,  4,
+    0,  4,  6,  4,  0
+};
+
+// Heuristic worth of one player's workers: height, mobility, squares to climb onto and centrality
+inline int evaluatePlayer(const GameState &state, uint8_t player) {
+    const Neighbours &adj = neighbours();
+    int score = 0;
+
+    for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+        uint8_t sq = state.workers[player][w];
+        if(sq == NO_SQUARE)
+            continue;
+        uint8_t level = state.heights[sq];
+
+        score += EVAL_LEVEL[level] + EVAL_CENTRALITY[sq];
+        for(int i = 0; i < adj.count[sq]; i++) {
+            uint8_t n = adj.list[sq][i];
+            uint8_t nLevel = state.heights[n];
+            if((state.occupied >> n) & 1 || nLevel == DOME_LEVEL || nLevel > level + 1)
+                continue;
+            score += EVAL_MOBILITY;
+            if(nLevel == level + 1)
+                score += (nLevel == WIN_LEVEL) ? EVAL_THREAT : EVAL_CLIMBABLE;
+        }
+    }
+    return score;
+}
+
+// Static score from the point of view of the side to move
+inline int evaluate(const GameState &state) {
+    int score = evaluatePlayer(state, state.toMove);
+    for(uint8_t p = 0; p < state.numPlayers; p++)
+        if(p != state.toMove)
+            score -= evaluatePlayer(state, p);
+    return score;
+}
+#endif
@@ -0,0 +1,144 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+
+#include "histogram.h"
+#include "input.h"
+
+#define FRAME_PACER_FENCES 8        // a power of two
+#define FRAME_PACER_WAIT_NS 100000000
+
+enum PresentMode
+{
+    PRESENT_DEFAULT,        // whatever the driver does
+    PRESENT_VSYNC,          // wait for vertical blank
+    PRESENT_ADAPTIVE,       // vsync, but tear rather than wait when late
+    PRESENT_UNCAPPED        // never wait
+};
+
+// 0 if `name` is vsync, adaptive or uncapped
+static inline int parsePresentMode(const char *name, PresentMode &mode) {
+    if(!strcmp(name, "vsync"))
+        mode = PRESENT_VSYNC;
+    else if(!strcmp(name, "adaptive"))
+        mode = PRESENT_ADAPTIVE;
+    else if(!strcmp(name, "uncapped"))
+        mode = PRESENT_UNCAPPED;
+    else
+        return -1;
+    return 0;
+}
+
+// Sets the swap interval for the current context. Adaptive sync needs the
+// swap_control_tear extension and falls back to vsync without it.
+static inline void applyPresentMode(PresentMode mode) {
+    if(mode == PRESENT_ADAPTIVE && !glfwExtensionSupported("GLX_EXT_swap_control_tear") &&
+       !glfwExtensionSupported("WGL_EXT_swap_control_tear")) {
+        std::cout<<"Adaptive sync not supported, using vsync"<<std::endl;
+        mode = PRESENT_VSYNC;
+    }
+    if(mode == PRESENT_VSYNC)
+        glfwSwapInterval(1);
+    else if(mode == PRESENT_ADAPTIVE)
+        glfwSwapInterval(-1);
+    else if(mode == PRESENT_UNCAPPED)
+        glfwSwapInterval(0);
+}
+
+// Measures input to photon, as near as the GL lets us: from when an input
+// event arrived to glfwSwapBuffers returning for the frame that showed its
+// result, and, with `gpuTiming`, to the GPU finishing that frame, seen
+// through a fence. Fences are checked once a frame, so the GPU figure is
+// an upper bound that is off by at most a frame.
+//
+// With `framesInFlight` the pacer also keeps the CPU from running ahead of
+// the GPU: beginFrame() waits until fewer than that many frames are queued.
+// One frame in flight, with input sampled right after the wait, is the low
+// latency mode: the GPU is idle when input is read, so what is read is
+// drawn and shown as soon as possible.
+class FramePacer
+{
+    struct Pending
+    {
+        GLsync fence;
+        int64_t inputUs;    // 0 for a frame that showed no input
+    };
+
+    Pending pending[FRAME_PACER_FENCES];
+    uint32_t head;
+    uint32_t tail;
+    int maxInFlight;        // 0 for no limit
+    bool gpuTiming;
+    Histogram toSwap;       // microseconds
+    Histogram toGpu;
+
+public:
+    FramePacer(int framesInFlight = 0, bool timeGpu = false)
+        : head(0), tail(0), maxInFlight(framesInFlight), gpuTiming(timeGpu) {
+        if(maxInFlight > FRAME_PACER_FENCES)
+            maxInFlight = FRAME_PACER_FENCES;
+    }
+
+    // Deletes the fences still queued; call while the context is current,
+    // before glfwTerminate
+    void release(void) {
+        while(head != tail)
+            glDeleteSync(pending[head++ & (FRAME_PACER_FENCES - 1)].fence);
+    }
+
+    // Before sampling input: retires frames the GPU has finished and waits
+    // for older ones while too many are queued
+    void beginFrame(void) {
+        retire(false);
+        while(maxInFlight && (int)(tail - head) >= maxInFlight)
+            retire(true);
+    }
+
+    // Right after glfwSwapBuffers returns. `inputUs` is when the oldest
+    // input shown in this frame arrived (InputQueue::nowUs), 0 for none.
+    void endFrame(int64_t inputUs) {
+        if(inputUs)
+            toSwap.record(InputQueue::nowUs() - inputUs);
+        if(!maxInFlight && !(gpuTiming && inputUs))
+            return;
+        if(tail - head == FRAME_PACER_FENCES)
+            retire(true);
+        Pending &p = pending[tail++ & (FRAME_PACER_FENCES - 1)];
+        p.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        p.inputUs = gpuTiming ? inputUs : 0;
+    }
+
+    void printStats(void) const {
+        if(toSwap.count())
+            toSwap.print("Input to swap", "ms", 1000.0);
+        if(toGpu.count())
+            toGpu.print("Input to GPU done", "ms", 1000.0);
+    }
+
+private:
+    // Drops the frames the GPU has finished, oldest first; with `wait`,
+    // waits for the oldest one instead and drops just that
+    void retire(bool wait) {
+        while(head != tail) {
+            Pending &p = pending[head & (FRAME_PACER_FENCES - 1)];
+            GLenum status = glClientWaitSync(p.fence, 0, 0);
+            if(status == GL_TIMEOUT_EXPIRED && !wait)
+                return;
+            while(status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(p.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_PACER_WAIT_NS);
+            if(p.inputUs)
+                toGpu.record(InputQueue::nowUs() - p.inputUs);
+            glDeleteSync(p.fence);
+            head++;
+            if(wait)
+                return;
+        }
+    }
+};
+#endif
@@ -0,0 +1,299 @@
+#ifndef GAME_DB_H
+#define GAME_DB_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+
+#include "game_state.h"
+#include "game_record.h"
+
+#define DB_VERSION 1
+#define DB_NO_WORKER 31
+
+// Every position of every game, one row each, stored column by column so a
+// query reads only the columns it uses and scans them sequentially. Bitboard
+// columns use the GameState square numbering; `mover` and `opp` are the
+// workers of the side to move and of everybody else.
+enum DbColumn {
+    DB_L1 = 0,      // squares at exactly level 1
+    DB_L2,
+    DB_L3,
+    DB_DOME,
+    DB_MOVER,
+    DB_OPP,
+    DB_GAME,        // game number, counting from 0 over all inputs
+    DB_PLY,         // turns played before this position
+    DB_TO_MOVE,
+    DB_PLAYERS,
+    DB_WORKERS,     // every worker's square, 5 bits each, for rebuilding positions
+    DB_NUM_COLUMNS
+};
+
+struct DbColumnInfo
+{
+    const char *name;
+    int width;      // bytes per row
+};
+
+inline const DbColumnInfo &dbColumnInfo(int column) {
+    static const DbColumnInfo info[DB_NUM_COLUMNS] = {
+        { "L1", 4 }, { "L2", 4 }, { "L3", 4 }, { "dome", 4 }, { "mover", 4 }, { "opp", 4 },
+        { "game", 4 }, { "ply", 2 }, { "toMove", 1 }, { "players", 1 },
+        { "workers", 8 }
+    };
+    return info[column];
+}
+
+inline std::string dbColumnPath(const std::string &dir, int column) {
+    return dir + "/" + dbColumnInfo(column).name + ".col";
+}
+
+inline std::string dbMetaPath(const std::string &dir) {
+    return dir + "/meta";
+}
+
+// Appends the positions of games to a new database directory
+class GameDbWriter
+{
+    std::string dir;
+    FILE *files[DB_NUM_COLUMNS];
+    uint64_t rows;
+    uint32_t games;
+
+public:
+    GameDbWriter() : rows(0), games(0) {
+        memset(files, 0, sizeof(files));
+    }
+
+    ~GameDbWriter() {
+        close();
+    }
+
+    int create(const char *path) {
+        dir = path;
+        mkdir(path, 0755);
+        for(int c = 0; c < DB_NUM_COLUMNS; c++) {
+            files[c] = fopen(dbColumnPath(dir, c).c_str(), "wb");
+            if(!files[c]) {
+                std::cout<<"Failed to create "<<dbColumnPath(dir, c)<<std::endl;
+                close();
+                return -1;
+            }
+        }
+        rows = 0;
+        games = 0;
+        return 0;
+    }
+
+    int addGame(const GameRecord &record) {
+        GameState state;
+        state.reset(record.numPlayers);
+        for(int ply = 0; ; ply++) {
+            GameRecord::skipStuckPlayers(state);
+            if(addPosition(state, games, ply))
+                return -1;
+            if(ply == record.plies)
+                break;
+            state.apply(record.moves[ply]);
+        }
+        games++;
+        return 0;
+    }
+
+    uint64_t rowCount(void) const {
+        return rows;
+    }
+
+    uint32_t gameCount(void) const {
+        return games;
+    }
+
+    // Flushes the columns and writes the row count; 0 on success
+    int close(void) {
+        if(!files[0])
+            return 0;
+        bool ok = true;
+        for(int c = 0; c < DB_NUM_COLUMNS; c++) {
+            if(files[c])
+                ok = (fclose(files[c]) == 0) && ok;
+            files[c] = NULL;
+        }
+        FILE *meta = fopen(dbMetaPath(dir).c_str(), "w");
+        if(!meta)
+            return -1;
+        fprintf(meta, "santorini-db %d\nrows %llu\ngames %u\n", DB_VERSION, (unsigned long long)rows, games);
+        ok = (fclose(meta) == 0) && ok;
+        return ok ? 0 : -1;
+    }
+
+    // One row; addGame adds one per ply
+    int addPosition(const GameState &state, uint32_t game, uint32_t ply) {
+        uint32_t level[DOME_LEVEL+1] = { 0, 0, 0, 0, 0 };
+        for(int sq = 0; sq < NUM_SQUARES; sq++)
+            level[state.heights[sq]] |= 1u << sq;
+        uint32_t mover = 0, opp = 0;
+        uint64_t squares = 0;
+        for(int p = 0; p < MAX_PLAYERS; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                uint8_t sq = state.workers[p][w];
+                squares |= (uint64_t)(sq == NO_SQUARE ? DB_NO_WORKER : sq) << (5 * (p*WORKERS_PER_PLAYER + w));
+                if(sq != NO_SQUARE)
+                    (p == state.toMove ? mover : opp) |= 1u << sq;
+            }
+
+        uint64_t values[DB_NUM_COLUMNS] = { level[1], level[2], level[3], level[DOME_LEVEL], mover, opp,
+                                            game, ply, state.toMove, state.numPlayers, squares };
+        for(int c = 0; c < DB_NUM_COLUMNS; c++)
+            if(!writeValue(files[c], values[c], dbColumnInfo(c).width))
+                return -1;
+        rows++;
+        return 0;
+    }
+
+private:
+    static bool writeValue(FILE *f, uint64_t value, int width) {
+        uint8_t bytes[8];
+        for(int i = 0; i < width; i++)
+            bytes[i] = (uint8_t)(value >> (8 * i));
+        return fwrite(bytes, width, 1, f) == 1;
+    }
+};
+
+// Read-only view of a database; every column is memory mapped
+class GameDb
+{
+    const uint8_t *columns[DB_NUM_COLUMNS];
+    size_t sizes[DB_NUM_COLUMNS];
+    uint64_t rows;
+    uint32_t games;
+
+public:
+    GameDb() : rows(0), games(0) {
+        memset(columns, 0, sizeof(columns));
+        memset(sizes, 0, sizeof(sizes));
+    }
+
+    ~GameDb() {
+        close();
+    }
+
+    GameDb(const GameDb &) = delete;
+    GameDb &operator=(const GameDb &) = delete;
+
+    int open(const char *path) {
+        close();
+        std::string dir = path;
+        FILE *meta = fopen(dbMetaPath(dir).c_str(), "r");
+        if(!meta) {
+            std::cout<<"Failed to open database "<<path<<std::endl;
+            return -1;
+        }
+        int version = 0;
+        unsigned long long rowCount = 0;
+        unsigned gameCount = 0;
+        bool ok = fscanf(meta, "santorini-db %d rows %llu games %u", &version, &rowCount, &gameCount) == 3;
+        fclose(meta);
+        if(!ok || version != DB_VERSION) {
+            std::cout<<"Database "<<path<<" has no usable meta file"<<std::endl;
+            return -1;
+        }
+        rows = rowCount;
+        games = gameCount;
+
+        for(int c = 0; c < DB_NUM_COLUMNS; c++) {
+            std::string file = dbColumnPath(dir, c);
+            sizes[c] = rows * dbColumnInfo(c).width;
+            if(!sizes[c])
+                continue;
+            int fd = ::open(file.c_str(), O_RDONLY);
+            struct stat st;
+            if(fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizes[c]) {
+                std::cout<<"Failed to open column "<<file<<std::endl;
+                if(fd >= 0)
+                    ::close(fd);
+                close();
+                return -1;
+            }
+            void *data = mmap(NULL, sizes[c], PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if(data == MAP_FAILED) {
+                std::cout<<"Failed to map column "<<file<<std::endl;
+                close();
+                return -1;
+            }
+            // Queries stream each column front to back
+            madvise(data, sizes[c], MADV_SEQUENTIAL);
+            columns[c] = (const uint8_t *)data;
+        }
+        return 0;
+    }
+
+    void close(void) {
+        for(int c = 0; c < DB_NUM_COLUMNS; c++) {
+            if(columns[c])
+                munmap((void *)columns[c], sizes[c]);
+            columns[c] = NULL;
+        }
+        rows = 0;
+        games = 0;
+    }
+
+    uint64_t rowCount(void) const {
+        return rows;
+    }
+
+    uint32_t gameCount(void) const {
+        return games;
+    }
+
+    const uint8_t *column(int c) const {
+        return columns[c];
+    }
+
+    uint64_t value(int c, uint64_t row) const {
+        const uint8_t *p = columns[c] + row * dbColumnInfo(c).width;
+        uint64_t v = 0;
+        for(int i = dbColumnInfo(c).width - 1; i >= 0; i--)
+            v = (v << 8) | p[i];
+        return v;
+    }
+
+    // The position in `row`; a finished game's final row does not carry the winner
+    GameState position(uint64_t row) const {
+        GameState state;
+        state.reset(value(DB_PLAYERS, row));
+        memset(state.heights, 0, sizeof(state.heights));
+        const uint8_t levels[4] = { 1, 2, 3, DOME_LEVEL };
+        for(int l = 0; l < 4; l++) {
+            uint32_t mask = value(DB_L1 + l, row);
+            for(int sq = 0; sq < NUM_SQUARES; sq++)
+                if((mask >> sq) & 1)
+                    state.heights[sq] = levels[l];
+        }
+
+        uint64_t squares = value(DB_WORKERS, row);
+        state.toMove = value(DB_TO_MOVE, row);
+        state.occupied = 0;
+        for(int p = 0; p < MAX_PLAYERS; p++) {
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                uint8_t sq = (squares >> (5 * (p*WORKERS_PER_PLAYER + w))) & 31;
+                state.workers[p][w] = (sq == DB_NO_WORKER) ? NO_SQUARE : sq;
+                if(sq != DB_NO_WORKER)
+                    state.occupied |= 1u << sq;
+            }
+            // Only eliminated players have workers off the board
+            if(p < state.numPlayers && state.workers[p][0] == NO_SQUARE)
+                state.eliminated |= 1 << p;
+        }
+        state.rehash();
+        return state;
+    }
+};
+#endif
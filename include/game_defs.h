@@ -2,5 +2,16 @@
 #define GAME_DEFS_H
 
 #define BOARD_WIDTH 5
+#define NUM_SQUARES (BOARD_WIDTH*BOARD_WIDTH)
+
+#define MAX_PLAYERS 4
+#define WORKERS_PER_PLAYER 2
+
+// World layout: square (x, y) is centred at
+// (-TILE_ORIGIN + x*TILE_SPACING, 0, TILE_ORIGIN - y*TILE_SPACING),
+// and each building level is LEVEL_HEIGHT tall
+#define TILE_ORIGIN  2.55f
+#define TILE_SPACING 1.28f
+#define LEVEL_HEIGHT 1.0f
 
 #endif
@@ -0,0 +1,240 @@
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "game_state.h"
+
+#define RECORD_MAGIC     "SGREC02"
+#define RECORD_MAX_PLIES 400
+
+// Worst case payload: every turn with the full MAX_MOVES choices
+#define RECORD_MAX_BITS  (RECORD_MAX_PLIES * 7)
+#define RECORD_LIMBS     ((RECORD_MAX_BITS + 31) / 32 + 1)
+
+#define GOD_NONE 0      // the rules engine has no god powers yet
+
+// One finished (or abandoned) game from the standard start. Only real turns
+// are stored; a player with no moves is eliminated automatically on replay.
+//
+// File layout: the 8 byte magic, then per game
+//   u8 header: players - 2 (bits 0-1), powers follow (bit 2),
+//              winner + 1 or 0 if cut off (bits 3-5)
+//   [u8 power per player], varint plies, varint payload bytes, payload
+// Each turn is stored as the index of the chosen move in generateMoves()
+// order, so the generator's ordering is part of the format. The indices
+// are packed into one mixed-radix number, little endian:
+//   payload = i0 + n0*(i1 + n1*(i2 + ...))
+// where n is the number of legal moves at that turn. That is arithmetic
+// coding with a flat model: log2(n) bits per turn, about six in a typical
+// position, with nothing spent on forced moves.
+struct GameRecord
+{
+    uint8_t numPlayers;
+    uint8_t powers[MAX_PLAYERS];
+    uint8_t winner;         // NO_PLAYER if the game was cut off
+    uint16_t plies;
+    Move moves[RECORD_MAX_PLIES];
+
+    void clear(uint8_t players) {
+        numPlayers = players;
+        memset(powers, GOD_NONE, sizeof(powers));
+        winner = NO_PLAYER;
+        plies = 0;
+    }
+
+    bool push(const Move &m) {
+        if(plies >= RECORD_MAX_PLIES)
+            return false;
+        moves[plies++] = m;
+        return true;
+    }
+
+    static int writeFileHeader(FILE *f) {
+        return fwrite(RECORD_MAGIC, 8, 1, f) == 1 ? 0 : -1;
+    }
+
+    // 0, or -1 if `f` is not a game record file
+    static int readFileHeader(FILE *f) {
+        char magic[8];
+        if(fread(magic, 8, 1, f) != 1 || memcmp(magic, RECORD_MAGIC, 8))
+            return -1;
+        return 0;
+    }
+
+    int write(FILE *f) const {
+        uint8_t buffer[16 + MAX_PLAYERS + RECORD_LIMBS*4];
+        int size = encode(buffer);
+        if(size < 0)
+            return -1;
+        return fwrite(buffer, size, 1, f) == 1 ? 0 : -1;
+    }
+
+    // 1 when a game was read, 0 at a clean end of file, -1 when the data is
+    // cut short or not a valid game
+    int read(FILE *f) {
+        int c = fgetc(f);
+        if(c == EOF)
+            return 0;
+        numPlayers = (c & 3) + 2;
+        int result = (c >> 3) & 7;
+        if(numPlayers > MAX_PLAYERS || result > numPlayers || (c >> 6))
+            return -1;
+        winner = result ? result - 1 : NO_PLAYER;
+        memset(powers, GOD_NONE, sizeof(powers));
+        if((c & 4) && fread(powers, numPlayers, 1, f) != 1)
+            return -1;
+        for(int p = 0; p < numPlayers; p++)
+            if(powers[p] != GOD_NONE)
+                return -1;
+
+        uint32_t count, bytes;
+        if(readVarint(f, count) || readVarint(f, bytes) || count > RECORD_MAX_PLIES || bytes > RECORD_LIMBS*4)
+            return -1;
+        uint32_t limbs[RECORD_LIMBS];
+        memset(limbs, 0, sizeof(limbs));
+        uint8_t payload[RECORD_LIMBS*4];
+        if(bytes && fread(payload, bytes, 1, f) != 1)
+            return -1;
+        for(uint32_t i = 0; i < bytes; i++)
+            limbs[i / 4] |= (uint32_t)payload[i] << (8 * (i % 4));
+        int used = (bytes + 3) / 4;
+
+        GameState state;
+        state.reset(numPlayers);
+        plies = count;
+        for(int i = 0; i < plies; i++) {
+            skipStuckPlayers(state);
+            if(state.isOver())
+                return -1;
+            MoveList list;
+            state.generateMoves(list);
+            uint32_t index = divideLimbs(limbs, used, list.count);
+            moves[i] = list.moves[index];
+            state.apply(moves[i]);
+        }
+        for(int i = 0; i < used; i++)
+            if(limbs[i])
+                return -1;
+        return 1;
+    }
+
+    // Position after the first `ply` turns (all of them by default)
+    GameState replay(int ply = -1) const {
+        GameState state;
+        state.reset(numPlayers);
+        if(ply < 0 || ply > plies)
+            ply = plies;
+        for(int i = 0; i < ply; i++) {
+            skipStuckPlayers(state);
+            state.apply(moves[i]);
+        }
+        if(ply == plies)
+            skipStuckPlayers(state);
+        return state;
+    }
+
+    static void skipStuckPlayers(GameState &state) {
+        while(!state.isOver() && !state.hasMoves())
+            state.eliminate();
+    }
+
+private:
+    // Bytes written to `out`, or -1 if a move is not legal where it was played
+    int encode(uint8_t *out) const {
+        uint8_t index[RECORD_MAX_PLIES], count[RECORD_MAX_PLIES];
+        GameState state;
+        state.reset(numPlayers);
+        for(int i = 0; i < plies; i++) {
+            skipStuckPlayers(state);
+            MoveList list;
+            state.generateMoves(list);
+            int found = -1;
+            for(int j = 0; j < list.count && found < 0; j++)
+                if(list.moves[j] == moves[i])
+                    found = j;
+            if(found < 0 || state.isOver())
+                return -1;
+            index[i] = found;
+            count[i] = list.count;
+            state.apply(moves[i]);
+        }
+
+        // Last turn is the most significant digit, so decoding runs forwards
+        uint32_t limbs[RECORD_LIMBS];
+        memset(limbs, 0, sizeof(limbs));
+        int used = 0;
+        for(int i = plies - 1; i >= 0; i--)
+            used = multiplyAddLimbs(limbs, used, count[i], index[i]);
+        int bytes = used*4;
+        while(bytes > 0 && !((limbs[(bytes - 1) / 4] >> (8 * ((bytes - 1) % 4))) & 0xFF))
+            bytes--;
+
+        bool anyPowers = false;
+        for(int p = 0; p < numPlayers; p++)
+            anyPowers = anyPowers || powers[p] != GOD_NONE;
+        int result = (winner == NO_PLAYER) ? 0 : winner + 1;
+
+        int size = 0;
+        out[size++] = (numPlayers - 2) | (anyPowers ? 4 : 0) | (result << 3);
+        if(anyPowers)
+            for(int p = 0; p < numPlayers; p++)
+                out[size++] = powers[p];
+        size += writeVarint(out + size, plies);
+        size += writeVarint(out + size, bytes);
+        for(int i = 0; i < bytes; i++)
+            out[size++] = limbs[i / 4] >> (8 * (i % 4));
+        return size;
+    }
+
+    // limbs = limbs * factor + add, where limbs[0..used) are the non-zero
+    // part; returns the new length
+    static int multiplyAddLimbs(uint32_t *limbs, int used, uint32_t factor, uint32_t add) {
+        uint64_t carry = add;
+        for(int i = 0; i < used; i++) {
+            uint64_t x = (uint64_t)limbs[i] * factor + carry;
+            limbs[i] = (uint32_t)x;
+            carry = x >> 32;
+        }
+        if(carry && used < RECORD_LIMBS)
+            limbs[used++] = (uint32_t)carry;
+        return used;
+    }
+
+    // limbs[0..used) /= divisor, returns the remainder
+    static uint32_t divideLimbs(uint32_t *limbs, int used, uint32_t divisor) {
+        uint64_t rem = 0;
+        for(int i = used - 1; i >= 0; i--) {
+            uint64_t x = (rem << 32) | limbs[i];
+            limbs[i] = (uint32_t)(x / divisor);
+            rem = x % divisor;
+        }
+        return (uint32_t)rem;
+    }
+
+    static int writeVarint(uint8_t *out, uint32_t value) {
+        int n = 0;
+        while(value >= 0x80) {
+            out[n++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        out[n++] = value;
+        return n;
+    }
+
+    static int readVarint(FILE *f, uint32_t &value) {
+        value = 0;
+        for(int shift = 0; shift < 32; shift += 7) {
+            int c = fgetc(f);
+            if(c == EOF)
+                return -1;
+            value |= (uint32_t)(c & 0x7F) << shift;
+            if(!(c & 0x80))
+                return 0;
+        }
+        return -1;
+    }
+};
+#endif
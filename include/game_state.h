@@ -0,0 +1,314 @@
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "game_defs.h"
+
+#define NO_SQUARE 0xFF
+#define NO_PLAYER 0xFF
+
+#define WIN_LEVEL  3
+#define DOME_LEVEL 4
+
+// Upper bound on (move, build) pairs: 2 workers * 8 steps * 8 builds
+#define MAX_MOVES 128
+
+inline uint8_t squareIndex(uint8_t x, uint8_t y) { return x * BOARD_WIDTH + y; }
+inline uint8_t squareX(uint8_t sq) { return sq / BOARD_WIDTH; }
+inline uint8_t squareY(uint8_t sq) { return sq % BOARD_WIDTH; }
+
+// Neighbour lists and masks for every square, built once on first use
+struct Neighbours
+{
+    uint8_t list[NUM_SQUARES][8];
+    uint8_t count[NUM_SQUARES];
+    uint32_t mask[NUM_SQUARES];
+
+    Neighbours() {
+        for(int sq = 0; sq < NUM_SQUARES; sq++) {
+            count[sq] = 0;
+            mask[sq] = 0;
+            for(int dx = -1; dx <= 1; dx++)
+                for(int dy = -1; dy <= 1; dy++) {
+                    int x = squareX(sq) + dx;
+                    int y = squareY(sq) + dy;
+                    if((!dx && !dy) || x < 0 || y < 0 || x >= BOARD_WIDTH || y >= BOARD_WIDTH)
+                        continue;
+                    list[sq][count[sq]++] = squareIndex(x, y);
+                    mask[sq] |= 1u << squareIndex(x, y);
+                }
+        }
+    }
+};
+
+inline const Neighbours &neighbours(void) {
+    static const Neighbours table;
+    return table;
+}
+
+// Random keys for incremental position hashing
+struct ZobristKeys
+{
+    uint64_t level[NUM_SQUARES][DOME_LEVEL+1];
+    uint64_t worker[MAX_PLAYERS][NUM_SQUARES];
+    uint64_t side[MAX_PLAYERS];
+
+    ZobristKeys() {
+        uint64_t seed = 0x5A4E0A1F2C3B4D5EULL;
+        for(int sq = 0; sq < NUM_SQUARES; sq++)
+            for(int l = 0; l <= DOME_LEVEL; l++)
+                level[sq][l] = next(seed);
+        for(int p = 0; p < MAX_PLAYERS; p++)
+            for(int sq = 0; sq < NUM_SQUARES; sq++)
+                worker[p][sq] = next(seed);
+        for(int p = 0; p < MAX_PLAYERS; p++)
+            side[p] = next(seed);
+    }
+
+private:
+    static uint64_t next(uint64_t &s) {
+        uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+inline const ZobristKeys &zobrist(void) {
+    static const ZobristKeys keys;
+    return keys;
+}
+
+// One turn: move a worker one step, then build next to where it landed
+struct Move
+{
+    uint8_t worker;
+    uint8_t from;
+    uint8_t to;
+    uint8_t build;      // NO_SQUARE when the step itself wins
+
+    bool isWin(void) const { return build == NO_SQUARE; }
+    bool isNull(void) const { return from == NO_SQUARE; }
+
+    bool operator==(const Move &o) const {
+        return worker == o.worker && from == o.from && to == o.to && build == o.build;
+    }
+    bool operator!=(const Move &o) const { return !(*this == o); }
+};
+
+const Move NULL_MOVE = { 0, NO_SQUARE, NO_SQUARE, NO_SQUARE };
+
+struct MoveList
+{
+    Move moves[MAX_MOVES];
+    int count;
+
+    MoveList() : count(0) {}
+
+    void push(uint8_t worker, uint8_t from, uint8_t to, uint8_t build) {
+        Move &m = moves[count++];
+        m.worker = worker;
+        m.from = from;
+        m.to = to;
+        m.build = build;
+    }
+};
+
+// Compact rules-only game state, independent of any rendering objects
+struct GameState
+{
+    uint8_t heights[NUM_SQUARES];
+    uint8_t workers[MAX_PLAYERS][WORKERS_PER_PLAYER];
+    uint8_t numPlayers;
+    uint8_t toMove;
+    uint8_t winner;
+    uint8_t eliminated;     // bitmask of players knocked out of a 3-4 player game
+    uint32_t occupied;
+    uint32_t levelMask[DOME_LEVEL+1];   // squares at each level, kept in step with heights
+    uint64_t hash;
+
+    void reset(uint8_t players = 2) {
+        // Fixed symmetric opening placement; the placement phase is not modelled
+        static const uint8_t start[MAX_PLAYERS][WORKERS_PER_PLAYER][2] = {
+            { {1, 1}, {3, 3} },
+            { {1, 3}, {3, 1} },
+            { {0, 2}, {4, 2} },
+            { {2, 0}, {2, 4} }
+        };
+
+        memset(this, 0, sizeof(*this));
+        numPlayers = (players < 2) ? 2 : (players > MAX_PLAYERS ? MAX_PLAYERS : players);
+        winner = NO_PLAYER;
+        for(int p = 0; p < MAX_PLAYERS; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                if(p < numPlayers) {
+                    workers[p][w] = squareIndex(start[p][w][0], start[p][w][1]);
+                    occupied |= 1u << workers[p][w];
+                }
+                else
+                    workers[p][w] = NO_SQUARE;
+            }
+        rehash();
+    }
+
+    // Recomputes the hash and level masks after heights or workers were set directly
+    void rehash(void) {
+        const ZobristKeys &keys = zobrist();
+        hash = keys.side[toMove];
+        memset(levelMask, 0, sizeof(levelMask));
+        for(int sq = 0; sq < NUM_SQUARES; sq++) {
+            hash ^= keys.level[sq][heights[sq]];
+            levelMask[heights[sq]] |= 1u << sq;
+        }
+        for(int p = 0; p < numPlayers; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+                if(workers[p][w] != NO_SQUARE)
+                    hash ^= keys.worker[p][workers[p][w]];
+    }
+
+    bool isOver(void) const {
+        return winner != NO_PLAYER;
+    }
+
+    uint8_t nextPlayer(void) const {
+        uint8_t p = toMove;
+        do {
+            p = (p + 1) % numPlayers;
+        } while(((eliminated >> p) & 1) && p != toMove);
+        return p;
+    }
+
+    int playersLeft(void) const {
+        int left = 0;
+        for(int p = 0; p < numPlayers; p++)
+            left += !((eliminated >> p) & 1);
+        return left;
+    }
+
+    void setToMove(uint8_t player) {
+        const ZobristKeys &keys = zobrist();
+        hash ^= keys.side[toMove] ^ keys.side[player];
+        toMove = player;
+    }
+
+    // Side to move cannot move. With two players left the other one wins,
+    // otherwise the stuck player's workers leave the board and play goes on.
+    void eliminate(void) {
+        const ZobristKeys &keys = zobrist();
+        uint8_t p = toMove;
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+            if(workers[p][w] == NO_SQUARE)
+                continue;
+            occupied &= ~(1u << workers[p][w]);
+            hash ^= keys.worker[p][workers[p][w]];
+            workers[p][w] = NO_SQUARE;
+        }
+        eliminated |= 1 << p;
+        setToMove(nextPlayer());
+        if(playersLeft() == 1)
+            winner = toMove;
+    }
+
+    void generateMoves(MoveList &list) const {
+        const Neighbours &adj = neighbours();
+        list.count = 0;
+
+        for(uint8_t w = 0; w < WORKERS_PER_PLAYER; w++) {
+            uint8_t from = workers[toMove][w];
+            if(from == NO_SQUARE)
+                continue;
+            uint8_t fromLevel = heights[from];
+
+            for(int i = 0; i < adj.count[from]; i++) {
+                uint8_t to = adj.list[from][i];
+                if((occupied >> to) & 1 || heights[to] == DOME_LEVEL || heights[to] > fromLevel + 1)
+                    continue;
+
+                // Stepping up onto the third level wins outright, no build follows
+                if(heights[to] == WIN_LEVEL && fromLevel < WIN_LEVEL) {
+                    list.push(w, from, to, NO_SQUARE);
+                    continue;
+                }
+
+                uint32_t occ = (occupied & ~(1u << from)) | (1u << to);
+                for(int j = 0; j < adj.count[to]; j++) {
+                    uint8_t build = adj.list[to][j];
+                    if((occ >> build) & 1 || heights[build] == DOME_LEVEL)
+                        continue;
+                    list.push(w, from, to, build);
+                }
+            }
+        }
+    }
+
+    // Empty level 3 squares `player` could step up onto right now, found from
+    // the adjacency and level masks without generating moves. Any bit set
+    // means an immediate win.
+    uint32_t winningSquares(uint8_t player) const {
+        const Neighbours &adj = neighbours();
+        uint32_t targets = levelMask[WIN_LEVEL] & ~occupied;
+        uint32_t wins = 0;
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+            uint8_t sq = workers[player][w];
+            if(sq != NO_SQUARE && heights[sq] == WIN_LEVEL - 1)
+                wins |= adj.mask[sq] & targets;
+        }
+        return wins;
+    }
+
+    // Squares the side to move has to dome (or win first) because the next
+    // player threatens to step up onto them. Two or more can't all be stopped.
+    // The side to move's own step and build can still change the threats.
+    uint32_t squaresToBlock(void) const {
+        return winningSquares(nextPlayer());
+    }
+
+    bool hasMoves(void) const {
+        const Neighbours &adj = neighbours();
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+            uint8_t from = workers[toMove][w];
+            if(from == NO_SQUARE)
+                continue;
+            for(int i = 0; i < adj.count[from]; i++) {
+                uint8_t to = adj.list[from][i];
+                // A legal step always has a build, at the very least back onto `from`
+                if(!((occupied >> to) & 1) && heights[to] != DOME_LEVEL && heights[to] <= heights[from] + 1)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void apply(const Move &m) {
+        const ZobristKeys &keys = zobrist();
+        uint8_t p = toMove;
+
+        workers[p][m.worker] = m.to;
+        occupied = (occupied & ~(1u << m.from)) | (1u << m.to);
+        hash ^= keys.worker[p][m.from] ^ keys.worker[p][m.to];
+
+        if(m.isWin()) {
+            winner = p;
+        }
+        else {
+            hash ^= keys.level[m.build][heights[m.build]];
+            levelMask[heights[m.build]] &= ~(1u << m.build);
+            heights[m.build]++;
+            levelMask[heights[m.build]] |= 1u << m.build;
+            hash ^= keys.level[m.build][heights[m.build]];
+        }
+
+        hash ^= keys.side[toMove];
+        toMove = nextPlayer();
+        hash ^= keys.side[toMove];
+    }
+
+    bool samePosition(const GameState &o) const {
+        return hash == o.hash && toMove == o.toMove && numPlayers == o.numPlayers &&
+               !memcmp(heights, o.heights, sizeof(heights)) &&
+               !memcmp(workers, o.workers, sizeof(workers));
+    }
+};
+#endif
@@ -0,0 +1,123 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BITS   5                              // 32 steps per power of two, ~3% error
+#define HISTOGRAM_SUB_COUNT  (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS    ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+// Log-linear histogram of nonnegative integer values, e.g. latencies in
+// microseconds, in the style of HdrHistogram: exact below 32, then 32
+// evenly spaced steps per power of two. Recording is an index computation
+// and an increment, so each thread keeps its own and they are merged for
+// reports.
+class Histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t maximum;
+
+public:
+    Histogram() {
+        clear();
+    }
+
+    void clear(void) {
+        memset(counts, 0, sizeof(counts));
+        total = sum = maximum = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        total++;
+        sum += value;
+        if(value > maximum)
+            maximum = value;
+    }
+
+    void merge(const Histogram &other) {
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        if(other.maximum > maximum)
+            maximum = other.maximum;
+    }
+
+    // Adds values kept elsewhere bucket by bucket, e.g. a shard another
+    // thread records into
+    void mergeCounts(const uint64_t *bucketCounts, uint64_t otherSum, uint64_t otherMax) {
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            counts[i] += bucketCounts[i];
+            total += bucketCounts[i];
+        }
+        sum += otherSum;
+        if(otherMax > maximum)
+            maximum = otherMax;
+    }
+
+    // Values recorded up to `value`, to the bucket's precision
+    uint64_t countAtMost(uint64_t value) const {
+        uint64_t n = 0;
+        for(int i = 0; i < HISTOGRAM_BUCKETS && highestIn(i) <= value; i++)
+            n += counts[i];
+        return n;
+    }
+
+    uint64_t count(void) const {
+        return total;
+    }
+
+    uint64_t valueSum(void) const {
+        return sum;
+    }
+
+    uint64_t max(void) const {
+        return maximum;
+    }
+
+    double mean(void) const {
+        return total ? (double)sum / total : 0.0;
+    }
+
+    // Highest value of the bucket holding the `fraction` quantile
+    uint64_t percentile(double fraction) const {
+        if(!total)
+            return 0;
+        uint64_t rank = (uint64_t)(fraction * (total - 1)) + 1, seen = 0;
+        for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += counts[i];
+            if(seen >= rank)
+                return highestIn(i) < maximum ? highestIn(i) : maximum;
+        }
+        return maximum;
+    }
+
+    // One line: count, mean and the usual percentiles, divided by `scale`
+    // (e.g. 1000 for microseconds shown as milliseconds)
+    void print(const char *name, const char *unit, double scale = 1.0) const {
+        printf("%s (%s): n %llu  mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n", name, unit,
+               (unsigned long long)total, mean() / scale, percentile(0.5) / scale, percentile(0.9) / scale,
+               percentile(0.99) / scale, percentile(0.999) / scale, maximum / scale);
+    }
+
+    static int bucketOf(uint64_t value) {
+        if(value < HISTOGRAM_SUB_COUNT)
+            return (int)value;
+        int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+        return (shift + 1) * HISTOGRAM_SUB_COUNT + (int)(value >> shift) - HISTOGRAM_SUB_COUNT;
+    }
+
+    static uint64_t highestIn(int bucket) {
+        if(bucket < HISTOGRAM_SUB_COUNT)
+            return bucket;
+        int shift = bucket / HISTOGRAM_SUB_COUNT - 1;
+        uint64_t top = HISTOGRAM_SUB_COUNT + bucket % HISTOGRAM_SUB_COUNT;
+        return ((top + 1) << shift) - 1;
+    }
+};
+#endif
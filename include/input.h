@@ -0,0 +1,120 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <GLFW/glfw3.h>
+
+#include <stdint.h>
+#include <time.h>
+
+#define INPUT_QUEUE_EVENTS 256      // a power of two
+
+enum InputType
+{
+    INPUT_KEY,
+    INPUT_MOUSE_BUTTON,
+    INPUT_CURSOR            // moved to (x, y); code, action and mods unused
+};
+
+struct InputEvent
+{
+    InputType type;
+    int code;           // GLFW key or mouse button
+    int action;         // GLFW_PRESS, GLFW_REPEAT or GLFW_RELEASE
+    int mods;
+    double x, y;        // cursor position in window coordinates
+    int64_t timeUs;     // when GLFW delivered it
+};
+
+// Key and mouse button events from the GLFW callbacks, in order and stamped
+// as they arrive, so a press shorter than a frame is not lost and a held key
+// is one press plus the keyboard's own repeats rather than one per frame.
+// GLFW calls back from glfwPollEvents on the thread that polls, so the
+// queue takes no lock. GLFW has no OS event times; the stamp is when
+// glfwPollEvents handed the event over.
+class InputQueue
+{
+    InputEvent events[INPUT_QUEUE_EVENTS];
+    uint32_t head;
+    uint32_t tail;
+    uint64_t dropped;
+
+public:
+    InputQueue() : head(0), tail(0), dropped(0) {}
+
+    // Sends the window's key, mouse button and cursor callbacks here; uses
+    // the window user pointer
+    void attach(GLFWwindow *window) {
+        glfwSetWindowUserPointer(window, this);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+        glfwSetCursorPosCallback(window, cursorCallback);
+    }
+
+    // Events that do not fit are dropped and counted. Cursor moves in a row
+    // collapse into the last one, keeping the first one's time.
+    void push(const InputEvent &event) {
+        if(event.type == INPUT_CURSOR && tail != head) {
+            InputEvent &last = events[(tail - 1) & (INPUT_QUEUE_EVENTS - 1)];
+            if(last.type == INPUT_CURSOR) {
+                last.x = event.x;
+                last.y = event.y;
+                return;
+            }
+        }
+        if(tail - head == INPUT_QUEUE_EVENTS) {
+            dropped++;
+            return;
+        }
+        events[tail++ & (INPUT_QUEUE_EVENTS - 1)] = event;
+    }
+
+    bool pop(InputEvent &event) {
+        if(head == tail)
+            return false;
+        event = events[head++ & (INPUT_QUEUE_EVENTS - 1)];
+        return true;
+    }
+
+    uint64_t droppedEvents(void) const {
+        return dropped;
+    }
+
+    static int64_t nowUs(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+private:
+    void add(GLFWwindow *window, InputType type, int code, int action, int mods) {
+        InputEvent event;
+        event.type = type;
+        event.code = code;
+        event.action = action;
+        event.mods = mods;
+        event.timeUs = nowUs();
+        glfwGetCursorPos(window, &event.x, &event.y);
+        push(event);
+    }
+
+    static void keyCallback(GLFWwindow *window, int key, int, int action, int mods) {
+        InputQueue *queue = (InputQueue *)glfwGetWindowUserPointer(window);
+        if(queue)
+            queue->add(window, INPUT_KEY, key, action, mods);
+    }
+
+    static void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
+        InputQueue *queue = (InputQueue *)glfwGetWindowUserPointer(window);
+        if(queue)
+            queue->add(window, INPUT_MOUSE_BUTTON, button, action, mods);
+    }
+
+    static void cursorCallback(GLFWwindow *window, double x, double y) {
+        InputQueue *queue = (InputQueue *)glfwGetWindowUserPointer(window);
+        if(!queue)
+            return;
+        InputEvent event = { INPUT_CURSOR, 0, 0, 0, x, y, nowUs() };
+        queue->push(event);
+    }
+};
+#endif
@@ -0,0 +1,277 @@
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "mpmc_queue.h"
+
+#define MATCH_BUCKET_WIDTH      100     // rating points per bucket
+#define MATCH_BUCKETS           32      // ratings 0 to 3199; others are clamped
+#define MATCH_BASE_WINDOW       50      // rating gap accepted at once
+#define MATCH_WIDEN_PER_SECOND  50      // and how fast it grows while waiting
+#define MATCH_MAX_WINDOW        400
+#define MATCH_PROBE             4       // candidates looked at per bucket
+#define MATCH_DEFAULT_TICKETS   (1 << 15)
+
+#define NO_TICKET 0
+#define MATCH_GENERATION_MASK ((1u << 29) - 1)
+
+// Two players paired by the Matchmaker, with how long each waited
+struct Match
+{
+    uint64_t players[2];
+    int ratings[2];
+    int64_t waitedUs[2];
+};
+
+// Pairs waiting players of similar rating. Waiting players sit in one
+// lock-free queue per rating bucket, oldest first, and the window of
+// ratings a player accepts widens the longer they wait. Any number of
+// threads can call join(), leave() and tick() at once; nothing takes a lock.
+//
+// join() looks for an opponent straight away and otherwise queues the
+// player. tick() goes over the queued players so that ones whose windows
+// have grown since they joined get paired; call it every few milliseconds
+// from any thread. Pairs come out of nextMatch(), which must be drained
+// regularly.
+//
+// Each ticket slot carries a generation and a state in one atomic word.
+// Whoever pops a slot from a queue holds it (HELD) until it is matched or
+// queued again; leave() only flips WAITING or HELD to CANCELLED and the
+// holder or the next popper frees the slot. leave() waits out the short
+// PAIRING step, so it never reports a match that did not happen.
+class Matchmaker
+{
+    enum TicketState
+    {
+        TICKET_FREE,
+        TICKET_WAITING,         // in a bucket queue
+        TICKET_HELD,            // popped by a thread looking for a pair
+        TICKET_PAIRING,         // held and about to be matched
+        TICKET_MATCHED,
+        TICKET_CANCELLED
+    };
+
+    struct Slot
+    {
+        std::atomic<uint32_t> state;    // generation << 3 | TicketState
+        uint64_t player;
+        int rating;
+        int64_t joinedUs;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    uint32_t capacity;
+    MpmcQueue<uint32_t> freeSlots;
+    std::vector<std::unique_ptr<MpmcQueue<uint32_t>>> buckets;
+    MpmcQueue<Match> matches;
+
+public:
+    Matchmaker(uint32_t maxTickets = MATCH_DEFAULT_TICKETS)
+        : slots(new Slot[maxTickets]), capacity(maxTickets), freeSlots(maxTickets), matches(maxTickets) {
+        for(uint32_t i = 0; i < maxTickets; i++) {
+            slots[i].state.store(TICKET_FREE, std::memory_order_relaxed);
+            freeSlots.push(i);
+        }
+        for(int b = 0; b < MATCH_BUCKETS; b++)
+            buckets.push_back(std::unique_ptr<MpmcQueue<uint32_t>>(new MpmcQueue<uint32_t>(maxTickets)));
+    }
+
+    static int64_t nowUs(void) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Rating gap a player who has waited `waitedUs` accepts
+    static int window(int64_t waitedUs) {
+        int64_t w = MATCH_BASE_WINDOW + waitedUs * MATCH_WIDEN_PER_SECOND / 1000000;
+        return w < MATCH_MAX_WINDOW ? (int)w : MATCH_MAX_WINDOW;
+    }
+
+    // Queues `player` or pairs them at once. Returns a ticket for leave(),
+    // or NO_TICKET when the matchmaker is full.
+    uint64_t join(uint64_t player, int rating) {
+        // A pop can miss while another thread is part way through freeing
+        // a slot; only give up when nothing is on its way back
+        uint32_t index;
+        while(!freeSlots.pop(index)) {
+            if(!freeSlots.approxSize())
+                return NO_TICKET;
+            std::this_thread::yield();
+        }
+        Slot &s = slots[index];
+        uint32_t generation = ((s.state.load(std::memory_order_relaxed) >> 3) + 1) & MATCH_GENERATION_MASK;
+        if(!generation)
+            generation = 1;
+        s.player = player;
+        s.rating = rating;
+        s.joinedUs = nowUs();
+        s.state.store(generation << 3 | TICKET_HELD, std::memory_order_release);
+        uint64_t ticket = (uint64_t)generation << 32 | index;
+        if(pairHeld(index, s.joinedUs) == 0)
+            requeue(index);
+        return ticket;
+    }
+
+    // Takes a waiting player out; -1 if they were already matched or gone
+    int leave(uint64_t ticket) {
+        uint32_t index = (uint32_t)ticket, generation = (uint32_t)(ticket >> 32);
+        if(index >= capacity)
+            return -1;
+        std::atomic<uint32_t> &state = slots[index].state;
+        uint32_t s = state.load(std::memory_order_acquire);
+        for(;;) {
+            if(s >> 3 == generation && (s & 7) == TICKET_PAIRING) {
+                std::this_thread::yield();
+                s = state.load(std::memory_order_acquire);
+                continue;
+            }
+            if(s >> 3 != generation || ((s & 7) != TICKET_WAITING && (s & 7) != TICKET_HELD))
+                return -1;
+            if(state.compare_exchange_weak(s, generation << 3 | TICKET_CANCELLED, std::memory_order_acq_rel))
+                return 0;
+        }
+    }
+
+    // One pass over the queued players, pairing those whose windows now
+    // reach an opponent. Returns the number of pairs made.
+    int tick(void) {
+        int made = 0;
+        int64_t now = nowUs();
+        for(int b = 0; b < MATCH_BUCKETS; b++) {
+            size_t waiting = buckets[b]->approxSize();
+            for(size_t i = 0; i < waiting; i++) {
+                uint32_t index;
+                if(!popHeld(b, index))
+                    break;
+                int paired = pairHeld(index, now);
+                if(paired > 0)
+                    made++;
+                else if(paired == 0)
+                    requeue(index);
+            }
+        }
+        return made;
+    }
+
+    // Next pair made by any thread; false if there is none
+    bool nextMatch(Match &out) {
+        return matches.pop(out);
+    }
+
+private:
+    static int bucketOf(int rating) {
+        int b = rating / MATCH_BUCKET_WIDTH;
+        return b < 0 ? 0 : (b >= MATCH_BUCKETS ? MATCH_BUCKETS - 1 : b);
+    }
+
+    void release(uint32_t index) {
+        std::atomic<uint32_t> &state = slots[index].state;
+        state.store((state.load(std::memory_order_relaxed) & ~7u) | TICKET_FREE, std::memory_order_release);
+        freeSlots.push(index);
+    }
+
+    // Queues a held slot again, or frees it if it was cancelled meanwhile
+    void requeue(uint32_t index) {
+        std::atomic<uint32_t> &state = slots[index].state;
+        uint32_t s = state.load(std::memory_order_acquire);
+        if((s & 7) != TICKET_HELD || !state.compare_exchange_strong(s, (s & ~7u) | TICKET_WAITING)) {
+            release(index);
+            return;
+        }
+        // Every slot is in at most one queue, so a full queue is only a
+        // popper that has not finished yet
+        MpmcQueue<uint32_t> &q = *buckets[bucketOf(slots[index].rating)];
+        while(!q.push(index))
+            std::this_thread::yield();
+    }
+
+    // Pops the oldest waiting slot of bucket `b` and holds it, freeing
+    // cancelled ones on the way
+    bool popHeld(int b, uint32_t &index) {
+        while(buckets[b]->pop(index)) {
+            std::atomic<uint32_t> &state = slots[index].state;
+            uint32_t s = state.load(std::memory_order_acquire);
+            if((s & 7) == TICKET_WAITING && state.compare_exchange_strong(s, (s & ~7u) | TICKET_HELD))
+                return true;
+            release(index);
+        }
+        return false;
+    }
+
+    // Looks for an opponent for held slot `index` in the buckets its window
+    // reaches, nearest first. A pair is made when the gap is within either
+    // player's window. Returns 1 once paired, -1 if `index` turned out to be
+    // cancelled (it is freed), 0 if it is still held with no opponent.
+    int pairHeld(uint32_t index, int64_t now) {
+        const Slot &s = slots[index];
+        int reach = window(now - s.joinedUs);
+        int home = bucketOf(s.rating);
+        int farthest = MATCH_MAX_WINDOW / MATCH_BUCKET_WIDTH + 1;
+        for(int d = 0; d <= farthest; d++)
+            for(int side = 0; side < (d ? 2 : 1); side++) {
+                int b = side ? home - d : home + d;
+                if(b < 0 || b >= MATCH_BUCKETS)
+                    continue;
+                uint32_t probed[MATCH_PROBE];
+                int count = 0;
+                int found = -1;
+                while(count < MATCH_PROBE && popHeld(b, probed[count])) {
+                    const Slot &o = slots[probed[count]];
+                    int gap = abs(o.rating - s.rating);
+                    count++;
+                    if(gap <= reach || gap <= window(now - o.joinedUs)) {
+                        found = count - 1;
+                        break;
+                    }
+                }
+                int result = (found >= 0) ? publish(index, probed[found], now) : 0;
+                for(int i = 0; i < count; i++)
+                    if(i != found || result != 1)
+                        requeue(probed[i]);
+                if(result)
+                    return result;
+            }
+        return 0;
+    }
+
+    // Matches held slots `a` and `b` and queues the pair: 1 if published,
+    // 0 if `b` was cancelled (left for the caller to free), -1 if `a` was
+    // cancelled (freed here, `b` held again)
+    int publish(uint32_t a, uint32_t b, int64_t now) {
+        std::atomic<uint32_t> &stateA = slots[a].state;
+        std::atomic<uint32_t> &stateB = slots[b].state;
+        uint32_t sb = stateB.load(std::memory_order_acquire);
+        if((sb & 7) != TICKET_HELD || !stateB.compare_exchange_strong(sb, (sb & ~7u) | TICKET_PAIRING))
+            return 0;
+        uint32_t sa = stateA.load(std::memory_order_acquire);
+        if((sa & 7) != TICKET_HELD || !stateA.compare_exchange_strong(sa, (sa & ~7u) | TICKET_MATCHED)) {
+            stateB.store((sb & ~7u) | TICKET_HELD, std::memory_order_release);
+            release(a);
+            return -1;
+        }
+        stateB.store((sb & ~7u) | TICKET_MATCHED, std::memory_order_release);
+
+        Match m;
+        const Slot *pair[2] = { &slots[a], &slots[b] };
+        for(int i = 0; i < 2; i++) {
+            m.players[i] = pair[i]->player;
+            m.ratings[i] = pair[i]->rating;
+            m.waitedUs[i] = now - pair[i]->joinedUs;
+            if(m.waitedUs[i] < 0)
+                m.waitedUs[i] = 0;
+        }
+        release(a);
+        release(b);
+        while(!matches.push(m))
+            std::this_thread::yield();
+        return 1;
+    }
+};
+#endif
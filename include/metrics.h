@@ -0,0 +1,199 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "histogram.h"
+
+#define METRICS_MAX_VALUES     32      // counters and gauges
+#define METRICS_MAX_HISTOGRAMS 8
+
+enum MetricKind
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+// Counters, gauges and histograms for a long running process, exported as
+// Prometheus text. Every thread records into its own shard with relaxed
+// loads and stores, so recording is a few instructions with no shared
+// cache lines and no locks; the shards are only summed when someone asks
+// for the text. Register all metrics before the threads start recording,
+// and keep one Metrics per process: a thread switching between two makes a
+// new shard at each switch.
+//
+// Histograms record integers (e.g. nanoseconds) and are exported with
+// `scale` applied (1e-9 to get seconds) at 1-2-5 bucket bounds between the
+// `low` and `high` given at registration.
+class Metrics
+{
+    struct Info
+    {
+        const char *name;
+        const char *help;
+        MetricKind kind;
+        int index;          // into the shard's values or histograms
+        double scale;
+        uint64_t low;
+        uint64_t high;
+    };
+
+    struct ShardHistogram
+    {
+        std::atomic<uint64_t> counts[HISTOGRAM_BUCKETS];
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> maximum;
+    };
+
+    struct Shard
+    {
+        std::atomic<int64_t> values[METRICS_MAX_VALUES];
+        ShardHistogram histograms[METRICS_MAX_HISTOGRAMS];
+
+        Shard() {
+            for(int i = 0; i < METRICS_MAX_VALUES; i++)
+                values[i].store(0, std::memory_order_relaxed);
+            for(int h = 0; h < METRICS_MAX_HISTOGRAMS; h++) {
+                for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+                    histograms[h].counts[i].store(0, std::memory_order_relaxed);
+                histograms[h].sum.store(0, std::memory_order_relaxed);
+                histograms[h].maximum.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::vector<Info> metrics;
+    int valueCount;
+    int histogramCount;
+    std::mutex lock;                            // guards `shards` only
+    std::vector<std::unique_ptr<Shard>> shards;
+
+public:
+    Metrics() : valueCount(0), histogramCount(0) {}
+
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    // Each returns the id to record with, or -1 when the table is full
+    int counter(const char *name, const char *help) {
+        return define(name, help, METRIC_COUNTER, 1.0, 0, 0);
+    }
+
+    int gauge(const char *name, const char *help) {
+        return define(name, help, METRIC_GAUGE, 1.0, 0, 0);
+    }
+
+    int histogram(const char *name, const char *help, double scale, uint64_t low, uint64_t high) {
+        return define(name, help, METRIC_HISTOGRAM, scale, low, high);
+    }
+
+    void add(int id, int64_t n = 1) {
+        std::atomic<int64_t> &v = local().values[metrics[id].index];
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Gauges are the sum over threads, so each thread sets its own part
+    void set(int id, int64_t value) {
+        local().values[metrics[id].index].store(value, std::memory_order_relaxed);
+    }
+
+    void record(int id, uint64_t value) {
+        ShardHistogram &h = local().histograms[metrics[id].index];
+        std::atomic<uint64_t> &c = h.counts[Histogram::bucketOf(value)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        h.sum.store(h.sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if(value > h.maximum.load(std::memory_order_relaxed))
+            h.maximum.store(value, std::memory_order_relaxed);
+    }
+
+    // Sum of a counter or gauge over all threads
+    int64_t value(int id) {
+        std::lock_guard<std::mutex> guard(lock);
+        int64_t total = 0;
+        for(size_t s = 0; s < shards.size(); s++)
+            total += shards[s]->values[metrics[id].index].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // All threads' values of histogram `id`
+    void snapshot(int id, Histogram &out) {
+        out.clear();
+        std::vector<uint64_t> counts(HISTOGRAM_BUCKETS);
+        std::lock_guard<std::mutex> guard(lock);
+        for(size_t s = 0; s < shards.size(); s++) {
+            const ShardHistogram &h = shards[s]->histograms[metrics[id].index];
+            for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+                counts[i] = h.counts[i].load(std::memory_order_relaxed);
+            out.mergeCounts(&counts[0], h.sum.load(std::memory_order_relaxed),
+                            h.maximum.load(std::memory_order_relaxed));
+        }
+    }
+
+    // Appends every metric in the Prometheus text exposition format
+    void format(std::string &out) {
+        char line[256];
+        for(size_t m = 0; m < metrics.size(); m++) {
+            const Info &info = metrics[m];
+            static const char *types[] = { "counter", "gauge", "histogram" };
+            snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", info.name, info.help, info.name,
+                     types[info.kind]);
+            out += line;
+            if(info.kind != METRIC_HISTOGRAM) {
+                snprintf(line, sizeof(line), "%s %lld\n", info.name, (long long)value((int)m));
+                out += line;
+                continue;
+            }
+            Histogram h;
+            snapshot((int)m, h);
+            for(uint64_t bound = info.low; bound <= info.high; bound = nextBound(bound)) {
+                snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", info.name, bound * info.scale,
+                         (unsigned long long)h.countAtMost(bound));
+                out += line;
+            }
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n", info.name,
+                     (unsigned long long)h.count(), info.name, h.valueSum() * info.scale, info.name,
+                     (unsigned long long)h.count());
+            out += line;
+        }
+    }
+
+private:
+    int define(const char *name, const char *help, MetricKind kind, double scale, uint64_t low, uint64_t high) {
+        int &used = (kind == METRIC_HISTOGRAM) ? histogramCount : valueCount;
+        if(used >= ((kind == METRIC_HISTOGRAM) ? METRICS_MAX_HISTOGRAMS : METRICS_MAX_VALUES))
+            return -1;
+        Info info = { name, help, kind, used++, scale, low ? low : 1, high };
+        metrics.push_back(info);
+        return (int)metrics.size() - 1;
+    }
+
+    // 1, 2, 5, 10, 20, 50, ...
+    static uint64_t nextBound(uint64_t bound) {
+        uint64_t decade = 1;
+        while(decade * 10 <= bound)
+            decade *= 10;
+        uint64_t step = bound / decade;
+        return (step < 2) ? 2 * decade : (step < 5) ? 5 * decade : 10 * decade;
+    }
+
+    // This thread's shard, made on its first use
+    Shard &local(void) {
+        thread_local Metrics *owner = NULL;
+        thread_local Shard *shard = NULL;
+        if(owner != this) {
+            std::lock_guard<std::mutex> guard(lock);
+            shards.push_back(std::unique_ptr<Shard>(new Shard()));
+            shard = shards.back().get();
+            owner = this;
+        }
+        return *shard;
+    }
+};
+#endif
@@ -0,0 +1,93 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Bounded lock-free queue for any number of producers and consumers. Each
+// cell carries a sequence number saying whose turn it is, so a push or pop
+// is one CAS on the shared index plus a store to the cell; nobody ever
+// waits on a lock held by a descheduled thread. Capacity is rounded up to a
+// power of two.
+template<typename T>
+class MpmcQueue
+{
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    Cell *cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head;     // next push
+    alignas(64) std::atomic<size_t> tail;     // next pop
+
+public:
+    MpmcQueue(size_t capacity) : head(0), tail(0) {
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        cells = new Cell[size];
+        mask = size - 1;
+        for(size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~MpmcQueue() {
+        delete[] cells;
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    // Number of items, exact only when no push or pop is in progress
+    size_t approxSize(void) const {
+        size_t h = head.load(std::memory_order_relaxed), t = tail.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+
+    // False when full
+    bool push(const T &value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for(;;) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0) {
+                if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+                return false;
+            else
+                pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    // False when empty
+    bool pop(T &value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0) {
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.data;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+                return false;
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+};
+#endif
@@ -0,0 +1,445 @@
+#ifndef MULTI_SEARCH_H
+#define MULTI_SEARCH_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "game_state.h"
+#include "evaluate.h"
+#include "search.h"
+#include "transposition.h"
+
+// Every max-n score vector sums to this, which is what makes shallow pruning valid
+#define MAXN_SUM 1000
+
+enum MultiAlgorithm {
+    MULTI_MAXN     = 0,     // each player maximises its own share
+    MULTI_PARANOID = 1,     // everyone else is assumed to gang up on the root player
+    MULTI_BRS      = 2      // best-reply search: only the strongest opponent reply is played
+};
+
+inline const char *multiAlgorithmName(MultiAlgorithm a) {
+    switch(a) {
+        case MULTI_MAXN:     return "max-n";
+        case MULTI_PARANOID: return "paranoid";
+        case MULTI_BRS:      return "best-reply";
+    }
+    return "?";
+}
+
+struct ScoreVector
+{
+    int v[MAX_PLAYERS];
+};
+
+// Search for 3 and 4 player games. Uses the same transposition table as the
+// two-player Search; paranoid and best-reply keys also fold in the root
+// player, since their scores are only meaningful from that seat.
+class MultiSearch
+{
+    TranspositionTable *tt;
+    MultiAlgorithm algorithm;
+    std::atomic<bool> stopFlag;
+    int64_t deadline;
+    uint64_t nodes;
+    bool aborted;
+    uint8_t rootPlayer;
+    uint64_t rootKey;
+
+public:
+    MultiSearch(TranspositionTable &table, MultiAlgorithm algo = MULTI_PARANOID)
+        : tt(&table), algorithm(algo), stopFlag(false), deadline(NO_DEADLINE),
+          nodes(0), aborted(false), rootPlayer(0), rootKey(0) {}
+
+    void setAlgorithm(MultiAlgorithm algo) {
+        algorithm = algo;
+    }
+
+    void stop(void) {
+        stopFlag.store(true);
+    }
+
+    void resetStop(void) {
+        stopFlag.store(false);
+    }
+
+    // Score is the root player's: a max-n share out of MAXN_SUM, otherwise a
+    // two-sided evaluation with the usual WIN_SCORE bounds
+    SearchResult think(const GameState &root, const SearchLimits &limits,
+                       const SearchCallback &onIteration = SearchCallback()) {
+        SearchResult result;
+        memset(&result, 0, sizeof(result));
+        result.best = NULL_MOVE;
+
+        int64_t startMs = nowMs();
+        deadline = limits.timeMs > 0 ? startMs + limits.timeMs : NO_DEADLINE;
+        nodes = 0;
+        aborted = false;
+        rootPlayer = root.toMove;
+        rootKey = zobrist().side[rootPlayer] * 0x9E3779B97F4A7C15ULL;
+
+        MoveList rootMoves;
+        root.generateMoves(rootMoves);
+        if(!rootMoves.count || root.isOver())
+            return result;
+        result.best = rootMoves.moves[0];
+
+        int maxDepth = (limits.depth < 1) ? 1 : (limits.depth >= MAX_PLY ? MAX_PLY - 1 : limits.depth);
+        for(int depth = 1; depth <= maxDepth; depth++) {
+            TRACE_ZONE("multi search iteration");
+            int64_t iterationStart = nowMs();
+            Move best = NULL_MOVE;
+            int score = rootSearch(root, rootMoves, depth, best);
+            if(aborted)
+                break;
+
+            result.best = best;
+            result.score = score;
+            result.depth = depth;
+            result.pv[0] = best;
+            result.pvLength = 1;
+            result.nodes = nodes;
+            result.timeMs = nowMs() - startMs;
+            if(onIteration)
+                onIteration(result);
+
+            bool proven = (algorithm == MULTI_MAXN) ? (score == MAXN_SUM)
+                                                    : (score >= WIN_BOUND || score <= -WIN_BOUND);
+            if(proven)
+                break;
+
+            int64_t now = nowMs();
+            if(deadline != NO_DEADLINE && deadline - now < now - iterationStart)
+                break;
+        }
+
+        result.nodes = nodes;
+        result.timeMs = nowMs() - startMs;
+        return result;
+    }
+
+private:
+    void checkTime(void) {
+        if(stopFlag.load(std::memory_order_relaxed) || nowMs() >= deadline)
+            aborted = true;
+    }
+
+    bool countNode(void) {
+        if((++nodes & 1023) == 0)
+            checkTime();
+        return !aborted;
+    }
+
+    Move hashMove(uint64_t key) const {
+        TTHit hit;
+        return tt->probe(key, hit) ? hit.move : NULL_MOVE;
+    }
+
+    // Hash move first, then wins, then climbing steps
+    static void orderMoves(const GameState &state, MoveList &list, const Move &first) {
+        int keys[MAX_MOVES];
+        for(int i = 0; i < list.count; i++) {
+            const Move &m = list.moves[i];
+            keys[i] = (m == first) ? (1 << 20) : m.isWin() ? (1 << 19)
+                    : (state.heights[m.to] - state.heights[m.from]) * 16 + state.heights[m.build];
+        }
+        for(int i = 1; i < list.count; i++) {
+            Move m = list.moves[i];
+            int k = keys[i];
+            int j = i - 1;
+            while(j >= 0 && keys[j] < k) {
+                list.moves[j+1] = list.moves[j];
+                keys[j+1] = keys[j];
+                j--;
+            }
+            list.moves[j+1] = m;
+            keys[j+1] = k;
+        }
+    }
+
+    int rootSearch(const GameState &root, MoveList &moves, int depth, Move &best) {
+        uint64_t key = (algorithm == MULTI_MAXN) ? root.hash : (root.hash ^ rootKey);
+        orderMoves(root, moves, hashMove(key));
+
+        int bestScore = -INF_SCORE;
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            int score;
+            if(m.isWin()) {
+                score = (algorithm == MULTI_MAXN) ? MAXN_SUM : WIN_SCORE - 1;
+            }
+            else {
+                GameState child = root;
+                child.apply(m);
+                if(algorithm == MULTI_MAXN)
+                    score = maxn(child, depth - 1, bestScore < 0 ? 0 : bestScore).v[rootPlayer];
+                else if(algorithm == MULTI_PARANOID)
+                    score = paranoid(child, depth - 1, bestScore, INF_SCORE, 1);
+                else
+                    score = brsMin(child, depth - 1, bestScore, INF_SCORE, 1);
+            }
+            if(aborted)
+                return bestScore;
+            if(score > bestScore) {
+                bestScore = score;
+                best = m;
+            }
+        }
+        tt->store(key, best, 0, depth, TT_NONE);
+        return bestScore;
+    }
+
+    /*** Max-n ***/
+
+    ScoreVector shares(const GameState &state) const {
+        ScoreVector s;
+        int raw[MAX_PLAYERS];
+        int total = 0;
+        for(int p = 0; p < MAX_PLAYERS; p++) {
+            s.v[p] = 0;
+            raw[p] = 0;
+            if(p >= state.numPlayers || ((state.eliminated >> p) & 1))
+                continue;
+            raw[p] = evaluatePlayer(state, p) + 1;
+            total += raw[p];
+        }
+        for(int p = 0; p < state.numPlayers; p++)
+            s.v[p] = raw[p] * MAXN_SUM / total;
+        return s;
+    }
+
+    static ScoreVector winFor(uint8_t player) {
+        ScoreVector s;
+        for(int p = 0; p < MAX_PLAYERS; p++)
+            s.v[p] = (p == player) ? MAXN_SUM : 0;
+        return s;
+    }
+
+    // `parentBest` is the parent mover's best share so far. Once our mover
+    // secures more than MAXN_SUM - parentBest the parent can't prefer this
+    // line, so the remaining siblings are skipped (shallow pruning).
+    ScoreVector maxn(const GameState &state, int depth, int parentBest) {
+        if(!countNode())
+            return shares(state);
+        if(state.isOver())
+            return winFor(state.winner);
+        if(depth <= 0)
+            return shares(state);
+
+        MoveList moves;
+        state.generateMoves(moves);
+        if(!moves.count) {
+            GameState child = state;
+            child.eliminate();
+            return child.isOver() ? winFor(child.winner) : maxn(child, depth - 1, 0);
+        }
+
+        uint8_t me = state.toMove;
+        orderMoves(state, moves, hashMove(state.hash));
+
+        ScoreVector best;
+        memset(&best, 0, sizeof(best));
+        best.v[me] = -1;
+        Move bestMove = moves.moves[0];
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            ScoreVector s;
+            if(m.isWin()) {
+                s = winFor(me);
+            }
+            else {
+                GameState child = state;
+                child.apply(m);
+                s = maxn(child, depth - 1, best.v[me]);
+            }
+            if(aborted)
+                return best;
+            if(s.v[me] > best.v[me]) {
+                best = s;
+                bestMove = m;
+            }
+            if(best.v[me] >= MAXN_SUM - parentBest)
+                break;
+        }
+        tt->store(state.hash, bestMove, 0, depth, TT_NONE);
+        return best;
+    }
+
+    /*** Paranoid ***/
+
+    int paranoidEval(const GameState &state) const {
+        int score = evaluatePlayer(state, rootPlayer);
+        for(uint8_t p = 0; p < state.numPlayers; p++)
+            if(p != rootPlayer && !((state.eliminated >> p) & 1))
+                score -= evaluatePlayer(state, p);
+        return score;
+    }
+
+    // Alpha-beta from the root player's seat; every other seat minimises
+    int paranoid(const GameState &state, int depth, int alpha, int beta, int ply) {
+        if(!countNode())
+            return 0;
+        if(state.isOver())
+            return (state.winner == rootPlayer) ? WIN_SCORE - ply : -(WIN_SCORE - ply);
+        if(depth <= 0 || ply >= MAX_PLY - 1)
+            return paranoidEval(state);
+
+        MoveList moves;
+        state.generateMoves(moves);
+        if(!moves.count) {
+            if(state.toMove == rootPlayer)
+                return -(WIN_SCORE - ply);
+            GameState child = state;
+            child.eliminate();
+            return paranoid(child, depth - 1, alpha, beta, ply + 1);
+        }
+
+        bool maximising = (state.toMove == rootPlayer);
+        uint64_t key = state.hash ^ rootKey;
+        TTHit hit;
+        Move first = NULL_MOVE;
+        if(tt->probe(key, hit)) {
+            first = hit.move;
+            if(hit.depth >= depth && hit.bound != TT_NONE) {
+                int s = hit.score;
+                if(s >= WIN_BOUND) s -= ply;
+                else if(s <= -WIN_BOUND) s += ply;
+                if(hit.bound == TT_EXACT ||
+                   (hit.bound == TT_LOWER && s >= beta) ||
+                   (hit.bound == TT_UPPER && s <= alpha))
+                    return s;
+            }
+        }
+        orderMoves(state, moves, first);
+
+        int origAlpha = alpha, origBeta = beta;
+        int best = maximising ? -INF_SCORE : INF_SCORE;
+        Move bestMove = moves.moves[0];
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            int s;
+            if(m.isWin()) {
+                s = maximising ? WIN_SCORE - ply - 1 : -(WIN_SCORE - ply - 1);
+            }
+            else {
+                GameState child = state;
+                child.apply(m);
+                s = paranoid(child, depth - 1, alpha, beta, ply + 1);
+            }
+            if(aborted)
+                return 0;
+
+            if(maximising ? (s > best) : (s < best)) {
+                best = s;
+                bestMove = m;
+            }
+            if(maximising && best > alpha) alpha = best;
+            if(!maximising && best < beta) beta = best;
+            if(alpha >= beta)
+                break;
+        }
+
+        TTBound bound = (best <= origAlpha) ? TT_UPPER : (best >= origBeta ? TT_LOWER : TT_EXACT);
+        int stored = (best >= WIN_BOUND) ? best + ply : (best <= -WIN_BOUND ? best - ply : best);
+        tt->store(key, bestMove, stored, depth, bound);
+        return best;
+    }
+
+    /*** Best-reply search ***/
+
+    // Root player's layer
+    int brsMax(const GameState &state, int depth, int alpha, int beta, int ply) {
+        if(!countNode())
+            return 0;
+        if(depth <= 0 || ply >= MAX_PLY - 1)
+            return paranoidEval(state);
+
+        MoveList moves;
+        state.generateMoves(moves);
+        if(!moves.count)
+            return -(WIN_SCORE - ply);
+
+        uint64_t key = state.hash ^ rootKey;
+        orderMoves(state, moves, hashMove(key));
+
+        int best = -INF_SCORE;
+        Move bestMove = moves.moves[0];
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            int s;
+            if(m.isWin()) {
+                s = WIN_SCORE - ply - 1;
+            }
+            else {
+                GameState child = state;
+                child.apply(m);
+                s = brsMin(child, depth - 1, alpha, beta, ply + 1);
+            }
+            if(aborted)
+                return 0;
+            if(s > best) {
+                best = s;
+                bestMove = m;
+            }
+            if(best > alpha)
+                alpha = best;
+            if(alpha >= beta)
+                break;
+        }
+        tt->store(key, bestMove, 0, depth, TT_NONE);
+        return best;
+    }
+
+    // All opponents' moves form one layer; only the single best reply is
+    // played and the other opponents pass
+    int brsMin(const GameState &state, int depth, int alpha, int beta, int ply) {
+        if(!countNode())
+            return 0;
+        if(depth <= 0 || ply >= MAX_PLY - 1)
+            return paranoidEval(state);
+
+        int best = INF_SCORE;
+        bool anyMove = false;
+        for(uint8_t p = 0; p < state.numPlayers && alpha < beta; p++) {
+            if(p == rootPlayer || ((state.eliminated >> p) & 1))
+                continue;
+
+            GameState opp = state;
+            opp.setToMove(p);
+            MoveList moves;
+            opp.generateMoves(moves);
+            orderMoves(opp, moves, NULL_MOVE);
+
+            for(int i = 0; i < moves.count; i++) {
+                const Move &m = moves.moves[i];
+                anyMove = true;
+                int s;
+                if(m.isWin()) {
+                    s = -(WIN_SCORE - ply - 1);
+                }
+                else {
+                    GameState child = opp;
+                    child.apply(m);
+                    child.setToMove(rootPlayer);
+                    s = brsMax(child, depth - 1, alpha, beta, ply + 1);
+                }
+                if(aborted)
+                    return 0;
+                if(s < best)
+                    best = s;
+                if(best < beta)
+                    beta = best;
+                if(alpha >= beta)
+                    break;
+            }
+        }
+
+        if(!anyMove) {
+            GameState child = state;
+            child.setToMove(rootPlayer);
+            return brsMax(child, depth - 1, alpha, beta, ply + 1);
+        }
+        return best;
+    }
+};
+#endif
@@ -0,0 +1,278 @@
+#ifndef NET_H
+#define NET_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <deque>
+#include <memory>
+#include <string>
+
+#define NET_BACKLOG       4096
+#define NET_READ_CHUNK    16384
+#define NET_MAX_LINE      4096      // longer lines close the connection
+#define NET_MAX_IOV       64        // segments handed to one writev
+
+// Nonblocking socket helpers for the line based network tools. Addresses are
+// "host:port" for TCP or "unix:/path" for a Unix socket. Everything returns
+// a file descriptor, or -1 after printing why.
+
+inline int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+// Lets one process hold tens of thousands of connections
+inline void raiseFileLimit(void) {
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// Resolves `address` into `storage`; returns the socket family or -1
+inline int parseAddress(const char *address, struct sockaddr_storage &storage, socklen_t &length) {
+    memset(&storage, 0, sizeof(storage));
+    if(!strncmp(address, "unix:", 5)) {
+        struct sockaddr_un *un = (struct sockaddr_un *)&storage;
+        if(strlen(address + 5) >= sizeof(un->sun_path)) {
+            printf("Socket path too long: %s\n", address + 5);
+            return -1;
+        }
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, address + 5);
+        length = sizeof(struct sockaddr_un);
+        return AF_UNIX;
+    }
+    const char *colon = strrchr(address, ':');
+    if(!colon) {
+        printf("Expected host:port or unix:/path, got %s\n", address);
+        return -1;
+    }
+    std::string host(address, colon - address);
+    struct addrinfo hints, *found = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host.empty() ? NULL : host.c_str(), colon + 1, &hints, &found) || !found) {
+        printf("Cannot resolve %s\n", address);
+        return -1;
+    }
+    memcpy(&storage, found->ai_addr, found->ai_addrlen);
+    length = found->ai_addrlen;
+    freeaddrinfo(found);
+    return AF_INET;
+}
+
+inline int listenOn(const char *address) {
+    struct sockaddr_storage storage;
+    socklen_t length;
+    int family = parseAddress(address, storage, length);
+    if(family < 0)
+        return -1;
+    int fd = socket(family, SOCK_STREAM, 0);
+    if(fd < 0) {
+        printf("Failed to create a socket: %s\n", strerror(errno));
+        return -1;
+    }
+    int on = 1;
+    if(family == AF_UNIX)
+        unlink(((struct sockaddr_un *)&storage)->sun_path);
+    else
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(bind(fd, (struct sockaddr *)&storage, length) || listen(fd, NET_BACKLOG) || setNonBlocking(fd)) {
+        printf("Failed to listen on %s: %s\n", address, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Blocking connect; the socket is made nonblocking afterwards
+inline int connectTo(const char *address) {
+    struct sockaddr_storage storage;
+    socklen_t length;
+    int family = parseAddress(address, storage, length);
+    if(family < 0)
+        return -1;
+    int fd = socket(family, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr *)&storage, length) || setNonBlocking(fd)) {
+        printf("Failed to connect to %s: %s\n", address, strerror(errno));
+        if(fd >= 0)
+            close(fd);
+        return -1;
+    }
+    if(family != AF_UNIX) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+// Immutable bytes that many connections can queue without copying, e.g.
+// one move broadcast to every spectator of a game
+typedef std::shared_ptr<const std::string> SharedBytes;
+
+inline SharedBytes makeShared(const char *text, size_t length) {
+    return std::make_shared<const std::string>(text, length);
+}
+
+// Line framing over a nonblocking socket: bytes read are split into lines
+// without the newline, and bytes to send are queued and written as far as
+// the socket takes them. Text queued with queue() is gathered into one
+// private segment; shared segments are queued by reference and written
+// with writev.
+class LineConnection
+{
+    struct Segment
+    {
+        SharedBytes bytes;
+        size_t offset;
+    };
+
+    std::string input;
+    size_t inputStart;
+    std::string pending;            // private text not yet made a segment
+    std::deque<Segment> segments;
+    size_t queuedBytes;
+
+public:
+    int fd;
+
+    LineConnection(int socket = -1) : inputStart(0), queuedBytes(0), fd(socket) {}
+
+    // Reads what is available and calls onLine(line, length) for each
+    // complete line. Returns -1 when the peer closed, on an error or on an
+    // overlong line.
+    template<typename Fn>
+    int receive(Fn onLine) {
+        char chunk[NET_READ_CHUNK];
+        for(;;) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if(n > 0) {
+                input.append(chunk, n);
+                if((size_t)n < sizeof(chunk))
+                    break;
+                continue;
+            }
+            if(n == 0)
+                return -1;
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return -1;
+        }
+
+        for(;;) {
+            size_t end = input.find('\n', inputStart);
+            if(end == std::string::npos)
+                break;
+            size_t length = end - inputStart;
+            if(length && input[end - 1] == '\r')
+                length--;
+            input[inputStart + length] = 0;
+            onLine(&input[inputStart], length);
+            inputStart = end + 1;
+        }
+        input.erase(0, inputStart);
+        inputStart = 0;
+        return (input.size() > NET_MAX_LINE) ? -1 : 0;
+    }
+
+    void queue(const char *text, size_t length) {
+        pending.append(text, length);
+        queuedBytes += length;
+    }
+
+    void queueLine(const char *text) {
+        queue(text, strlen(text));
+        queue("\n", 1);
+    }
+
+    void queueShared(const SharedBytes &bytes) {
+        sealPending();
+        Segment s = { bytes, 0 };
+        segments.push_back(s);
+        queuedBytes += bytes->size();
+    }
+
+    // Drops queued segments that have not started going out, keeping a
+    // partly written one so the peer never sees half a line
+    void dropUnsent(void) {
+        sealPending();
+        size_t keep = (!segments.empty() && segments.front().offset) ? 1 : 0;
+        while(segments.size() > keep) {
+            queuedBytes -= segments.back().bytes->size();
+            segments.pop_back();
+        }
+    }
+
+    // Writes queued bytes; 1 if some are still waiting, 0 when all are out,
+    // -1 on an error
+    int flush(void) {
+        sealPending();
+        while(!segments.empty()) {
+            struct iovec iov[NET_MAX_IOV];
+            int count = 0;
+            for(size_t i = 0; i < segments.size() && count < NET_MAX_IOV; i++, count++) {
+                const Segment &s = segments[i];
+                iov[count].iov_base = (void *)(s.bytes->data() + s.offset);
+                iov[count].iov_len = s.bytes->size() - s.offset;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                    return 1;
+                return -1;
+            }
+            queuedBytes -= n;
+            while(n > 0) {
+                Segment &s = segments.front();
+                size_t left = s.bytes->size() - s.offset;
+                if((size_t)n < left) {
+                    s.offset += n;
+                    return 1;
+                }
+                n -= left;
+                segments.pop_front();
+            }
+        }
+        return 0;
+    }
+
+    bool hasOutput(void) const {
+        return queuedBytes > 0;
+    }
+
+    size_t pendingBytes(void) const {
+        return queuedBytes;
+    }
+
+private:
+    void sealPending(void) {
+        if(pending.empty())
+            return;
+        Segment s = { std::make_shared<const std::string>(std::move(pending)), 0 };
+        segments.push_back(s);
+        pending.clear();
+    }
+};
+#endif
@@ -0,0 +1,350 @@
+#ifndef NET_CLIENT_H
+#define NET_CLIENT_H
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "game_state.h"
+#include "game_record.h"
+#include "notation.h"
+#include "mpmc_queue.h"
+#include "net.h"
+
+#define NET_CLIENT_LINE  256     // longer lines from the server are cut short
+#define NET_CLIENT_QUEUE 1024
+
+struct NetLine
+{
+    char text[NET_CLIENT_LINE];
+};
+
+// Connection to santorini_server for the windowed client. All socket I/O,
+// and optionally reading move lines typed on stdin, happens on one I/O
+// thread blocked in poll(); the render thread only pushes and pops lock-free
+// queues, so a slow network never holds up a frame. An eventfd wakes the
+// I/O thread when there is something to send.
+class NetClient
+{
+    LineConnection conn;
+    int wakeFd;
+    bool readConsole;
+    std::string consoleInput;
+    std::thread io;
+    std::atomic<bool> quit;
+    std::atomic<bool> closed;
+    MpmcQueue<NetLine> inbox;
+    MpmcQueue<NetLine> outbox;
+    MpmcQueue<NetLine> console;
+
+public:
+    NetClient() : wakeFd(-1), readConsole(false), quit(false), closed(false),
+                  inbox(NET_CLIENT_QUEUE), outbox(NET_CLIENT_QUEUE), console(16) {}
+
+    ~NetClient() {
+        stop();
+    }
+
+    // Connects (blocking) and starts the I/O thread. With `stdinLines`,
+    // lines typed on stdin come back through readLine().
+    int connect(const char *address, bool stdinLines = false) {
+        int fd = connectTo(address);
+        if(fd < 0)
+            return -1;
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        if(wakeFd < 0) {
+            std::cout<<"Failed to create an eventfd: "<<strerror(errno)<<std::endl;
+            ::close(fd);
+            return -1;
+        }
+        conn.fd = fd;
+        readConsole = stdinLines;
+        io = std::thread(&NetClient::run, this);
+        return 0;
+    }
+
+    // Sends what is queued and closes the connection
+    void stop(void) {
+        if(!io.joinable())
+            return;
+        quit = true;
+        wake();
+        io.join();
+        ::close(conn.fd);
+        ::close(wakeFd);
+    }
+
+    // Queues one line for the server; false if the queue is full
+    bool send(const char *line) {
+        NetLine l;
+        strncpy(l.text, line, sizeof(l.text) - 1);
+        l.text[sizeof(l.text) - 1] = 0;
+        if(!outbox.push(l))
+            return false;
+        wake();
+        return true;
+    }
+
+    // Next line from the server, without waiting
+    bool receive(NetLine &line) {
+        return inbox.pop(line);
+    }
+
+    // Next line typed on stdin, without waiting
+    bool readLine(NetLine &line) {
+        return console.pop(line);
+    }
+
+    // The server closed the connection or it failed
+    bool isClosed(void) const {
+        return closed;
+    }
+
+private:
+    void wake(void) {
+        uint64_t one = 1;
+        if(write(wakeFd, &one, sizeof(one)) < 0) {}
+    }
+
+    // The render thread drains the inbox every frame, so a full one only
+    // means a stalled frame; wait for it rather than drop a move
+    void deliver(MpmcQueue<NetLine> &queue, const char *text, size_t length) {
+        NetLine l;
+        if(length >= sizeof(l.text))
+            length = sizeof(l.text) - 1;
+        memcpy(l.text, text, length);
+        l.text[length] = 0;
+        while(!queue.push(l) && !quit)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    void run(void) {
+        bool failed = false;
+        while(!failed) {
+            bool stopping = quit;
+            NetLine l;
+            while(outbox.pop(l))
+                conn.queueLine(l.text);
+            if(conn.hasOutput() && conn.flush() < 0)
+                break;
+            if(stopping)
+                break;
+
+            struct pollfd fds[3];
+            int count = 2;
+            fds[0].fd = conn.fd;
+            fds[0].events = POLLIN | (conn.hasOutput() ? POLLOUT : 0);
+            fds[1].fd = wakeFd;
+            fds[1].events = POLLIN;
+            if(readConsole) {
+                fds[2].fd = STDIN_FILENO;
+                fds[2].events = POLLIN;
+                count = 3;
+            }
+            if(poll(fds, count, -1) < 0) {
+                if(errno == EINTR)
+                    continue;
+                break;
+            }
+
+            if(fds[1].revents & POLLIN) {
+                uint64_t n;
+                if(read(wakeFd, &n, sizeof(n)) < 0) {}
+            }
+            if(fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+                failed = conn.receive([this](char *line, size_t length) { deliver(inbox, line, length); }) < 0;
+            if(count == 3 && (fds[2].revents & (POLLIN | POLLHUP)))
+                readStdin();
+        }
+        closed = true;
+    }
+
+    void readStdin(void) {
+        char chunk[256];
+        ssize_t n = read(STDIN_FILENO, chunk, sizeof(chunk));
+        if(n <= 0) {
+            readConsole = false;
+            return;
+        }
+        consoleInput.append(chunk, n);
+        size_t end;
+        while((end = consoleInput.find('\n')) != std::string::npos) {
+            deliver(console, consoleInput.data(), end);
+            consoleInput.erase(0, end + 1);
+        }
+    }
+};
+
+// One seat of a networked game on top of NetClient. `shown` is what the
+// player sees: the server's position plus our own move while it is on its
+// way, so the board answers a move at once instead of a round trip later.
+// The server echoes every move it accepts; if it refuses ours, `shown`
+// falls back to the last confirmed position.
+class NetPlay
+{
+    NetClient client;
+    GameState confirmed;
+    bool predicting;
+    bool lostReported;
+
+public:
+    GameState shown;
+    int seat;               // -1 until the server seats us
+    uint32_t gameId;
+    bool started;
+    bool over;
+    int winner;             // -1 until the game is over
+
+    NetPlay() : predicting(false), lostReported(false), seat(-1), gameId(0), started(false), over(false),
+                winner(-1) {
+        confirmed.reset(2);
+        shown = confirmed;
+    }
+
+    // Opens a new game and waits in seat 1 for an opponent
+    int host(const char *address, bool stdinMoves = false) {
+        if(client.connect(address, stdinMoves))
+            return -1;
+        client.send("create");
+        return 0;
+    }
+
+    int join(const char *address, uint32_t id, bool stdinMoves = false) {
+        if(client.connect(address, stdinMoves))
+            return -1;
+        char line[32];
+        snprintf(line, sizeof(line), "join %u", id);
+        client.send(line);
+        return 0;
+    }
+
+    // Handles what the server sent since the last call; true if `shown`
+    // changed. Call once a frame.
+    bool update(void) {
+        bool changed = false;
+        NetLine l;
+        while(client.receive(l))
+            changed |= handle(l.text);
+        if(client.isClosed() && !lostReported) {
+            lostReported = true;
+            if(!over)
+                std::cout<<"Lost the connection to the server"<<std::endl;
+        }
+        return changed;
+    }
+
+    bool myTurn(void) const {
+        return started && !over && !predicting && seat == shown.toMove && !shown.isOver() && !client.isClosed();
+    }
+
+    // Plays `m` from `shown` at once and sends it; -1 if it is not our turn
+    // or the move is not legal
+    int play(const Move &m) {
+        char text[24] = "move ";
+        *moveName(m, text + 5) = 0;
+        Move legal;
+        if(!myTurn() || parseMove(shown, text + 5, legal) || legal != m)
+            return -1;
+        if(!client.send(text))
+            return -1;
+        shown.apply(m);
+        GameRecord::skipStuckPlayers(shown);
+        predicting = true;
+        return 0;
+    }
+
+    // A move typed on stdin, checked against `shown`; false if none is waiting
+    bool readMove(Move &m) {
+        NetLine l;
+        while(client.readLine(l)) {
+            if(!myTurn())
+                std::cout<<"Not your turn"<<std::endl;
+            else if(parseMove(shown, l.text, m))
+                std::cout<<"Not a legal move: "<<l.text<<std::endl;
+            else
+                return true;
+        }
+        return false;
+    }
+
+    void resign(void) {
+        client.send("resign");
+    }
+
+    void leave(void) {
+        client.send("quit");
+        client.stop();
+    }
+
+private:
+    bool handle(const char *line) {
+        if(!strncmp(line, "move ", 5)) {
+            int mover = line[5] - '1';
+            Move m;
+            if(parseMove(confirmed, line + 7, m)) {
+                // Out of step with the server; ask for its position
+                client.send("position");
+                return false;
+            }
+            confirmed.apply(m);
+            GameRecord::skipStuckPlayers(confirmed);
+            if(predicting && mover == seat) {
+                predicting = false;
+                if(shown.hash == confirmed.hash)
+                    return false;
+            }
+            shown = confirmed;
+            return true;
+        }
+        if(!strncmp(line, "game ", 5)) {
+            int s = 0;
+            sscanf(line + 5, "%u seat %d", &gameId, &s);
+            seat = s - 1;
+            if(seat == 0)
+                std::cout<<"Game "<<gameId<<" open, waiting for an opponent to join"<<std::endl;
+            return false;
+        }
+        if(!strncmp(line, "start ", 6) || !strncmp(line, "position ", 9)) {
+            const char *text = strchr(line, ' ') + 1;
+            if(parsePosition(text, confirmed)) {
+                std::cout<<"Failed to read position from the server: "<<text<<std::endl;
+                return false;
+            }
+            if(line[0] == 's') {
+                started = true;
+                std::cout<<"Game "<<gameId<<" started, you are player "<<seat + 1<<std::endl;
+            }
+            predicting = false;
+            shown = confirmed;
+            return true;
+        }
+        if(!strncmp(line, "over ", 5)) {
+            over = true;
+            winner = atoi(line + 5) - 1;
+            const char *reason = strchr(line + 5, ' ');
+            std::cout<<(winner == seat ? "You win" : "You lose");
+            if(reason)
+                std::cout<<" ("<<reason + 1<<")";
+            std::cout<<std::endl;
+            return false;
+        }
+        if(!strncmp(line, "error ", 6)) {
+            std::cout<<"Server: "<<line + 6<<std::endl;
+            if(predicting) {
+                predicting = false;
+                shown = confirmed;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+#endif
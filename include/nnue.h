@@ -0,0 +1,312 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+#include "game_state.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86 1
+#endif
+
+// Inputs seen from one player's seat: the level of every square, and that
+// player's workers and everybody else's by square and the level they stand on
+#define NNUE_HEIGHT_FEATURES (NUM_SQUARES*(DOME_LEVEL+1))
+#define NNUE_WORKER_FEATURES (NUM_SQUARES*DOME_LEVEL)
+#define NNUE_OWN_WORKER      NNUE_HEIGHT_FEATURES
+#define NNUE_OTHER_WORKER    (NNUE_HEIGHT_FEATURES + NNUE_WORKER_FEATURES)
+#define NNUE_INPUTS          (NNUE_HEIGHT_FEATURES + 2*NNUE_WORKER_FEATURES)
+
+#define NNUE_HIDDEN   32        // accumulator width per perspective
+#define NNUE_L2       8         // a multiple of eight
+#define NNUE_PERSPECTIVES 2
+#define NNUE_L2_INPUTS (NNUE_PERSPECTIVES*NNUE_HIDDEN)
+
+// Quantisation: accumulator values are activations * 127, layer weights * 64
+#define NNUE_FT_SCALE     127
+#define NNUE_WEIGHT_SHIFT 6
+#define NNUE_WEIGHT_SCALE (1 << NNUE_WEIGHT_SHIFT)
+#define NNUE_OUTPUT_SCALE 600   // evaluation units per unit of network output
+
+#define NNUE_MAGIC "SNNUE02"
+#define NNUE_DEFAULT_PATH "santorini.nnue"
+
+inline int nnueHeightFeature(uint8_t sq, uint8_t level) { return sq * (DOME_LEVEL+1) + level; }
+inline int nnueWorkerFeature(bool own, uint8_t sq, uint8_t level) {
+    return (own ? NNUE_OWN_WORKER : NNUE_OTHER_WORKER) + sq * DOME_LEVEL + level;
+}
+
+// Where the vector kernel keeps second layer weight (output, input): in
+// blocks of eight outputs by four inputs, the order it reads them in
+inline int nnueL2Block(int output, int input) {
+    return ((output / 8) * (NNUE_L2_INPUTS / 4) + input / 4) * 32 + (output % 8) * 4 + input % 4;
+}
+
+// First layer output for both seats, updated move by move
+struct NnueAccumulator
+{
+    alignas(32) int16_t v[NNUE_PERSPECTIVES][NNUE_HIDDEN];
+};
+
+struct NnueFileHeader
+{
+    char magic[8];
+    uint32_t inputs;
+    uint32_t hidden;
+    uint32_t l2;
+};
+
+// Two player network: 325 sparse inputs -> 2x32 accumulator -> 8 -> 1.
+// The first layer is int16, the rest int8 with int32 biases. Only the first
+// layer depends on the position, and a turn changes at most four of its
+// inputs per seat (the worker's square and level before and after, and the
+// built square's old and new level), so search keeps one accumulator per
+// ply and adjusts it instead of recomputing.
+class NnueNetwork
+{
+public:
+    alignas(32) int16_t ftWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    alignas(32) int16_t ftBias[NNUE_HIDDEN];
+    alignas(32) int8_t l2Weights[NNUE_L2][NNUE_L2_INPUTS];
+    alignas(32) int8_t l2Blocks[NNUE_L2*NNUE_L2_INPUTS];      // l2Weights reordered, see blockWeights()
+    int32_t l2Bias[NNUE_L2];
+    alignas(32) int8_t outWeights[NNUE_L2];
+    int32_t outBias;
+
+    NnueNetwork() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    int load(const char *path) {
+        FILE *f = fopen(path, "rb");
+        if(!f) {
+            std::cout<<"Failed to open network "<<path<<std::endl;
+            return -1;
+        }
+
+        NnueFileHeader header;
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+                  !memcmp(header.magic, NNUE_MAGIC, 8) && header.inputs == NNUE_INPUTS &&
+                  header.hidden == NNUE_HIDDEN && header.l2 == NNUE_L2;
+        ok = ok && fread(ftWeights, sizeof(ftWeights), 1, f) == 1
+                && fread(ftBias, sizeof(ftBias), 1, f) == 1
+                && fread(l2Weights, sizeof(l2Weights), 1, f) == 1
+                && fread(l2Bias, sizeof(l2Bias), 1, f) == 1
+                && fread(outWeights, sizeof(outWeights), 1, f) == 1
+                && fread(&outBias, sizeof(outBias), 1, f) == 1;
+        fclose(f);
+
+        if(!ok) {
+            std::cout<<"Network "<<path<<" is not a "<<NNUE_MAGIC<<" file of the expected shape"<<std::endl;
+            return -1;
+        }
+        blockWeights();
+        return 0;
+    }
+
+    // Copies l2Weights into the vector kernel's order; load() does this,
+    // anything else that writes the weights has to call it
+    void blockWeights(void) {
+        for(int o = 0; o < NNUE_L2; o++)
+            for(int i = 0; i < NNUE_L2_INPUTS; i++)
+                l2Blocks[nnueL2Block(o, i)] = l2Weights[o][i];
+    }
+
+    int save(const char *path) const {
+        FILE *f = fopen(path, "wb");
+        if(!f)
+            return -1;
+
+        NnueFileHeader header;
+        memcpy(header.magic, NNUE_MAGIC, 8);
+        header.inputs = NNUE_INPUTS;
+        header.hidden = NNUE_HIDDEN;
+        header.l2 = NNUE_L2;
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1
+               && fwrite(ftWeights, sizeof(ftWeights), 1, f) == 1
+               && fwrite(ftBias, sizeof(ftBias), 1, f) == 1
+               && fwrite(l2Weights, sizeof(l2Weights), 1, f) == 1
+               && fwrite(l2Bias, sizeof(l2Bias), 1, f) == 1
+               && fwrite(outWeights, sizeof(outWeights), 1, f) == 1
+               && fwrite(&outBias, sizeof(outBias), 1, f) == 1;
+        fclose(f);
+        return ok ? 0 : -1;
+    }
+
+    // Build both seats' accumulators from scratch
+    void refresh(const GameState &state, NnueAccumulator &acc) const {
+        for(int persp = 0; persp < NNUE_PERSPECTIVES; persp++) {
+            int16_t *v = acc.v[persp];
+            memcpy(v, ftBias, sizeof(ftBias));
+            for(uint8_t sq = 0; sq < NUM_SQUARES; sq++)
+                addFeature(v, nnueHeightFeature(sq, state.heights[sq]));
+            for(int p = 0; p < NNUE_PERSPECTIVES; p++)
+                for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+                    if(state.workers[p][w] != NO_SQUARE) {
+                        uint8_t sq = state.workers[p][w];
+                        addFeature(v, nnueWorkerFeature(p == persp, sq, state.heights[sq]));
+                    }
+        }
+    }
+
+    // `out` = `in` after the side to move in `before` plays `m`
+    void update(const NnueAccumulator &in, const GameState &before, const Move &m,
+                NnueAccumulator &out) const {
+        for(int persp = 0; persp < NNUE_PERSPECTIVES; persp++) {
+            bool own = (persp == before.toMove);
+            const int16_t *add[2] = { ftWeights[nnueWorkerFeature(own, m.to, before.heights[m.to])], NULL };
+            const int16_t *sub[2] = { ftWeights[nnueWorkerFeature(own, m.from, before.heights[m.from])], NULL };
+            if(!m.isWin()) {
+                uint8_t level = before.heights[m.build];
+                add[1] = ftWeights[nnueHeightFeature(m.build, level + 1)];
+                sub[1] = ftWeights[nnueHeightFeature(m.build, level)];
+            }
+#ifdef NNUE_X86
+            if(hasAVX2()) {
+                updateAVX2(in.v[persp], add, sub, out.v[persp]);
+                continue;
+            }
+#endif
+            for(int i = 0; i < NNUE_HIDDEN; i++) {
+                int x = in.v[persp][i] + add[0][i] - sub[0][i];
+                if(add[1])
+                    x += add[1][i] - sub[1][i];
+                out.v[persp][i] = x;
+            }
+        }
+    }
+
+    // Score from the side to move's point of view, in evaluate() units
+    int evaluate(const NnueAccumulator &acc, uint8_t toMove) const {
+        alignas(32) uint8_t input[NNUE_L2_INPUTS];
+#ifdef NNUE_X86
+        if(hasAVX2()) {
+            clippedInputAVX2(acc, toMove, input);
+            return outputAVX2(input);
+        }
+#endif
+        clippedInput(acc, toMove, input);
+        return outputScalar(input);
+    }
+
+    int evaluate(const GameState &state) const {
+        NnueAccumulator acc;
+        refresh(state, acc);
+        return evaluate(acc, state.toMove);
+    }
+
+    // Portable forward pass, also used to check the vector kernel
+    int outputScalar(const uint8_t *input) const {
+        int32_t out = outBias;
+        for(int o = 0; o < NNUE_L2; o++) {
+            int32_t sum = l2Bias[o];
+            for(int i = 0; i < NNUE_L2_INPUTS; i++)
+                sum += input[i] * l2Weights[o][i];
+            out += clip(sum / NNUE_WEIGHT_SCALE) * outWeights[o];
+        }
+        return scaleOutput(out);
+    }
+
+#ifdef NNUE_X86
+    static bool hasAVX2(void) {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+    }
+
+    // Eight outputs per register: each step broadcasts four inputs against
+    // their weights for the eight outputs, so no horizontal adds are needed
+    // until the single output
+    __attribute__((target("avx2")))
+    int outputAVX2(const uint8_t *input) const {
+        const __m256i ones = _mm256_set1_epi16(1);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i top = _mm256_set1_epi32(NNUE_FT_SCALE);
+        const int steps = NNUE_L2_INPUTS / 4;
+        __m256i out = zero;
+        for(int o = 0; o < NNUE_L2; o += 8) {
+            const __m256i *w = (const __m256i *)l2Blocks + (o / 8) * steps;
+            __m256i even = _mm256_loadu_si256((const __m256i *)&l2Bias[o]);
+            __m256i odd = zero;
+            for(int k = 0; k < steps; k += 2) {
+                int32_t a, b;
+                memcpy(&a, input + 4*k, 4);
+                memcpy(&b, input + 4*k + 4, 4);
+                // u8 x i8 pairs into i16 (127*127*2 cannot saturate), then into i32
+                even = _mm256_add_epi32(even, _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_set1_epi32(a), _mm256_load_si256(w + k)), ones));
+                odd = _mm256_add_epi32(odd, _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_set1_epi32(b), _mm256_load_si256(w + k + 1)), ones));
+            }
+            // Negative sums clip to 0 whichever way the shift rounds them
+            __m256i hidden = _mm256_srai_epi32(_mm256_add_epi32(even, odd), NNUE_WEIGHT_SHIFT);
+            hidden = _mm256_min_epi32(_mm256_max_epi32(hidden, zero), top);
+            __m256i weights = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)&outWeights[o]));
+            out = _mm256_add_epi32(out, _mm256_mullo_epi32(hidden, weights));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(out), _mm256_extracti128_si256(out, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        return scaleOutput(outBias + _mm_cvtsi128_si32(sum));
+    }
+
+    __attribute__((target("avx2")))
+    static void clippedInputAVX2(const NnueAccumulator &acc, uint8_t toMove, uint8_t *input) {
+        const int16_t *halves[NNUE_PERSPECTIVES] = { acc.v[toMove], acc.v[toMove ^ 1] };
+        const __m256i zero = _mm256_setzero_si256();
+        for(int h = 0; h < NNUE_PERSPECTIVES; h++)
+            for(int i = 0; i < NNUE_HIDDEN; i += 32) {
+                __m256i a = _mm256_load_si256((const __m256i *)(halves[h] + i));
+                __m256i b = _mm256_load_si256((const __m256i *)(halves[h] + i + 16));
+                // Saturating pack to [-128, 127] interleaves 128 bit lanes; undo that, then floor at 0
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+                _mm256_store_si256((__m256i *)(input + h*NNUE_HIDDEN + i), _mm256_max_epi8(packed, zero));
+            }
+    }
+
+    __attribute__((target("avx2")))
+    static void updateAVX2(const int16_t *in, const int16_t *const add[2], const int16_t *const sub[2], int16_t *out) {
+        for(int i = 0; i < NNUE_HIDDEN; i += 16) {
+            __m256i x = _mm256_load_si256((const __m256i *)(in + i));
+            x = _mm256_add_epi16(x, _mm256_load_si256((const __m256i *)(add[0] + i)));
+            x = _mm256_sub_epi16(x, _mm256_load_si256((const __m256i *)(sub[0] + i)));
+            if(add[1]) {
+                x = _mm256_add_epi16(x, _mm256_load_si256((const __m256i *)(add[1] + i)));
+                x = _mm256_sub_epi16(x, _mm256_load_si256((const __m256i *)(sub[1] + i)));
+            }
+            _mm256_store_si256((__m256i *)(out + i), x);
+        }
+    }
+#endif
+
+private:
+    void addFeature(int16_t *v, int feature) const {
+        const int16_t *w = ftWeights[feature];
+        for(int i = 0; i < NNUE_HIDDEN; i++)
+            v[i] += w[i];
+    }
+
+    void subFeature(int16_t *v, int feature) const {
+        const int16_t *w = ftWeights[feature];
+        for(int i = 0; i < NNUE_HIDDEN; i++)
+            v[i] -= w[i];
+    }
+
+    static int clip(int32_t x) {
+        return x < 0 ? 0 : (x > NNUE_FT_SCALE ? NNUE_FT_SCALE : x);
+    }
+
+    static int scaleOutput(int32_t out) {
+        return (int)((int64_t)out * NNUE_OUTPUT_SCALE / (NNUE_FT_SCALE * NNUE_WEIGHT_SCALE));
+    }
+
+    // Side to move's half first, clipped to [0, 127]
+    static void clippedInput(const NnueAccumulator &acc, uint8_t toMove, uint8_t *input) {
+        const int16_t *halves[NNUE_PERSPECTIVES] = { acc.v[toMove], acc.v[toMove ^ 1] };
+        for(int h = 0; h < NNUE_PERSPECTIVES; h++)
+            for(int i = 0; i < NNUE_HIDDEN; i++)
+                input[h*NNUE_HIDDEN + i] = clip(halves[h][i]);
+    }
+};
+#endif
@@ -0,0 +1,217 @@
+#ifndef NOTATION_H
+#define NOTATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "game_state.h"
+
+#define POSITION_TEXT_MAX 64    // longest formatted position plus the terminator
+#define POWER_NONE_TEXT   "-"
+
+// One line position notation, four space separated fields:
+//
+//   0000D/01200/00300/01000/00000 b2d4/d2b4 1 -
+//
+// 1. Levels, rank 5 down to rank 1, files a to e within a rank, '/' between
+//    ranks; '0'-'3' are building levels and 'D' a dome. Square "b4" is
+//    x = 1 (file b), y = 3 (rank 4), the same naming as move text.
+// 2. Workers, one group per player in seat order, '/' between groups; a
+//    group is both worker squares, or '-' for a player who has been
+//    eliminated. The number of groups is the number of players.
+// 3. Side to move, 1 to 4.
+// 4. God powers, one per player separated by ','; '-' alone means nobody
+//    has one. The rules engine has no powers yet, so only '-' is accepted.
+//
+// The winner is not written: it is the last player left, or whoever has a
+// worker standing on level 3. Parsing and formatting work on caller buffers
+// and never allocate.
+
+inline char *squareName(uint8_t sq, char *out) {
+    out[0] = 'a' + squareX(sq);
+    out[1] = '1' + squareY(sq);
+    return out + 2;
+}
+
+// Square from two characters, or NO_SQUARE
+inline uint8_t parseSquare(const char *text) {
+    unsigned file = (unsigned char)text[0] - 'a';
+    if(file >= BOARD_WIDTH)
+        return NO_SQUARE;
+    unsigned rank = (unsigned char)text[1] - '1';
+    if(rank >= BOARD_WIDTH)
+        return NO_SQUARE;
+    return squareIndex(file, rank);
+}
+
+// Moves are "from-to,build", or "from-to#" for a step up that wins.
+// Writes no terminator; returns the end of the text.
+inline char *moveName(const Move &m, char *out) {
+    out = squareName(m.from, out);
+    *out++ = '-';
+    out = squareName(m.to, out);
+    if(m.isWin())
+        *out++ = '#';
+    else {
+        *out++ = ',';
+        out = squareName(m.build, out);
+    }
+    return out;
+}
+
+// Reads one move at the start of `text` and checks it is legal in `state`.
+// Returns 0 and points `end` (if given) past it, or -1.
+inline int parseMove(const GameState &state, const char *text, Move &move, const char **end = NULL) {
+    uint8_t from = parseSquare(text);
+    if(from == NO_SQUARE || text[2] != '-')
+        return -1;
+    uint8_t to = parseSquare(text + 3);
+    if(to == NO_SQUARE)
+        return -1;
+    const char *p = text + 5;
+    uint8_t build = NO_SQUARE;
+    if(*p == ',') {
+        build = parseSquare(p + 1);
+        if(build == NO_SQUARE)
+            return -1;
+        p += 3;
+    }
+    else if(*p == '#')
+        p++;
+    else
+        return -1;
+
+    MoveList list;
+    state.generateMoves(list);
+    for(int i = 0; i < list.count; i++) {
+        const Move &m = list.moves[i];
+        if(m.from == from && m.to == to && m.build == build) {
+            move = m;
+            if(end)
+                *end = p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Writes `state` and a terminating NUL to `out`; returns the length, or -1
+// if `size` is too small
+inline int formatPosition(const GameState &state, char *out, size_t size) {
+    if(size < POSITION_TEXT_MAX)
+        return -1;
+    char *p = out;
+    for(int rank = BOARD_WIDTH - 1; rank >= 0; rank--) {
+        for(int file = 0; file < BOARD_WIDTH; file++) {
+            uint8_t level = state.heights[squareIndex(file, rank)];
+            *p++ = (level == DOME_LEVEL) ? 'D' : '0' + level;
+        }
+        *p++ = rank ? '/' : ' ';
+    }
+    for(int pl = 0; pl < state.numPlayers; pl++) {
+        if(pl)
+            *p++ = '/';
+        if(state.workers[pl][0] == NO_SQUARE)
+            *p++ = '-';
+        else
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+                p = squareName(state.workers[pl][w], p);
+    }
+    *p++ = ' ';
+    *p++ = '1' + state.toMove;
+    *p++ = ' ';
+    memcpy(p, POWER_NONE_TEXT, sizeof(POWER_NONE_TEXT) - 1);
+    p += sizeof(POWER_NONE_TEXT) - 1;
+    *p = 0;
+    return (int)(p - out);
+}
+
+// Reads one position from `text` into `state`. Returns 0 and points `end`
+// (if given) just past the position, or -1 if the text is not a legal
+// position; `state` is only written on success.
+inline int parsePosition(const char *text, GameState &state, const char **end = NULL) {
+    const char *p = text;
+    while(*p == ' ' || *p == '\t')
+        p++;
+
+    uint8_t heights[NUM_SQUARES];
+    for(int rank = BOARD_WIDTH - 1; rank >= 0; rank--) {
+        for(int file = 0; file < BOARD_WIDTH; file++) {
+            char c = *p++;
+            if(c >= '0' && c <= '3')
+                heights[squareIndex(file, rank)] = c - '0';
+            else if(c == 'D')
+                heights[squareIndex(file, rank)] = DOME_LEVEL;
+            else
+                return -1;
+        }
+        if(*p++ != (rank ? '/' : ' '))
+            return -1;
+    }
+
+    uint8_t workers[MAX_PLAYERS][WORKERS_PER_PLAYER];
+    int players = 0;
+    uint8_t eliminated = 0;
+    uint32_t occupied = 0;
+    for(;;) {
+        if(players == MAX_PLAYERS)
+            return -1;
+        if(*p == '-') {
+            workers[players][0] = workers[players][1] = NO_SQUARE;
+            eliminated |= 1 << players;
+            p++;
+        }
+        else
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++, p += 2) {
+                uint8_t sq = parseSquare(p);
+                if(sq == NO_SQUARE || ((occupied >> sq) & 1) || heights[sq] == DOME_LEVEL)
+                    return -1;
+                workers[players][w] = sq;
+                occupied |= 1u << sq;
+            }
+        players++;
+        if(*p != '/')
+            break;
+        p++;
+    }
+    if(players < 2 || players - __builtin_popcount(eliminated) < 1 || *p++ != ' ')
+        return -1;
+
+    unsigned toMove = (unsigned char)*p++ - '1';
+    if(toMove >= (unsigned)players || ((eliminated >> toMove) & 1))
+        return -1;
+
+    // Powers are optional at the end of the line
+    if(*p == ' ') {
+        while(*p == ' ')
+            p++;
+        if(*p == '-')
+            p++;
+        else if(*p && *p != '\n' && *p != '\r')
+            return -1;
+    }
+    if(*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+        return -1;
+
+    state.reset(players);
+    memcpy(state.heights, heights, sizeof(heights));
+    for(int pl = 0; pl < players; pl++)
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+            state.workers[pl][w] = workers[pl][w];
+    state.eliminated = eliminated;
+    state.occupied = occupied;
+    state.toMove = toMove;
+    for(int pl = 0; pl < players; pl++) {
+        if(players - __builtin_popcount(eliminated) == 1 && !((eliminated >> pl) & 1))
+            state.winner = pl;
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+            if(workers[pl][w] != NO_SQUARE && heights[workers[pl][w]] == 3)
+                state.winner = pl;
+    }
+    state.rehash();
+    if(end)
+        *end = p;
+    return 0;
+}
+#endif
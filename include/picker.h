@@ -0,0 +1,113 @@
+#ifndef PICKER_H
+#define PICKER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <float.h>
+#include <stdint.h>
+
+#include "game_defs.h"
+#include "game_state.h"
+#include "board.h"
+
+#define PICK_BOXES          (NUM_SQUARES + MAX_PLAYERS * WORKERS_PER_PLAYER)
+#define PICK_TILE_THICKNESS 0.05f       // an empty square is a thin slab on the board top
+
+struct PickResult
+{
+    uint8_t square;     // NO_SQUARE when the ray missed the board
+    int8_t player;      // whose worker was hit; -1 for the square itself
+    int8_t worker;
+};
+
+// Finds what is under the cursor by casting a ray on the CPU, so picking
+// never waits on the GPU. Each square is one box as tall as its building,
+// and each worker one box standing on its square, laid out as flat arrays
+// per coordinate so the slab test over all of them is a couple of plain
+// loops. load() rebuilds the boxes from a position; the layout is the one
+// Board::drawBoard draws.
+class BoardPicker
+{
+    float minX[PICK_BOXES], minY[PICK_BOXES], minZ[PICK_BOXES];
+    float maxX[PICK_BOXES], maxY[PICK_BOXES], maxZ[PICK_BOXES];
+    float hitDistance[PICK_BOXES];
+    uint8_t squares[PICK_BOXES];
+    int8_t players[PICK_BOXES];
+    int8_t workers[PICK_BOXES];
+    int count;
+
+public:
+    BoardPicker() : count(0) {}
+
+    void load(const GameState &state) {
+        count = 0;
+        for(int sq = 0; sq < NUM_SQUARES; sq++) {
+            float top = state.heights[sq] ? state.heights[sq] * LEVEL_HEIGHT : BOARD_TOP;
+            add(sq, -1, -1, TILE_SPACING / 2, BOARD_TOP - PICK_TILE_THICKNESS, top);
+        }
+        for(int p = 0; p < state.numPlayers; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                uint8_t sq = state.workers[p][w];
+                if(sq == NO_SQUARE)
+                    continue;
+                float level = state.heights[sq] * LEVEL_HEIGHT;
+                add(sq, p, w, PLAYER_RIGHT, level + PLAYER_BOTTOM, level + PLAYER_TOP);
+            }
+    }
+
+    // The nearest box the ray from `origin` along `direction` enters
+    PickResult pick(glm::vec3 origin, glm::vec3 direction) {
+        glm::vec3 inverse = 1.0f / direction;
+        for(int i = 0; i < count; i++) {
+            float x1 = (minX[i] - origin.x) * inverse.x, x2 = (maxX[i] - origin.x) * inverse.x;
+            float y1 = (minY[i] - origin.y) * inverse.y, y2 = (maxY[i] - origin.y) * inverse.y;
+            float z1 = (minZ[i] - origin.z) * inverse.z, z2 = (maxZ[i] - origin.z) * inverse.z;
+            float enter = glm::max(glm::max(glm::min(x1, x2), glm::min(y1, y2)), glm::max(glm::min(z1, z2), 0.0f));
+            float leave = glm::min(glm::min(glm::max(x1, x2), glm::max(y1, y2)), glm::max(z1, z2));
+            hitDistance[i] = (enter <= leave) ? enter : FLT_MAX;
+        }
+        int nearest = -1;
+        float best = FLT_MAX;
+        for(int i = 0; i < count; i++)
+            if(hitDistance[i] < best) {
+                best = hitDistance[i];
+                nearest = i;
+            }
+        PickResult result = { NO_SQUARE, -1, -1 };
+        if(nearest >= 0) {
+            result.square = squares[nearest];
+            result.player = players[nearest];
+            result.worker = workers[nearest];
+        }
+        return result;
+    }
+
+    // The world space ray through window point (x, y), y counting down as
+    // GLFW's cursor positions do, of a window `width` by `height`
+    static void cursorRay(double x, double y, int width, int height, const glm::mat4 &view,
+                          const glm::mat4 &projection, glm::vec3 &origin, glm::vec3 &direction) {
+        glm::vec4 viewport(0.0f, 0.0f, (float)width, (float)height);
+        glm::vec3 window((float)x, (float)(height - y), 0.0f);
+        origin = glm::unProject(window, view, projection, viewport);
+        window.z = 1.0f;
+        direction = glm::normalize(glm::unProject(window, view, projection, viewport) - origin);
+    }
+
+private:
+    void add(uint8_t sq, int player, int worker, float halfWidth, float bottom, float top) {
+        float x = -TILE_ORIGIN + squareX(sq) * TILE_SPACING;
+        float z = TILE_ORIGIN - squareY(sq) * TILE_SPACING;
+        minX[count] = x - halfWidth;
+        maxX[count] = x + halfWidth;
+        minY[count] = bottom;
+        maxY[count] = top;
+        minZ[count] = z - halfWidth;
+        maxZ[count] = z + halfWidth;
+        squares[count] = sq;
+        players[count] = (int8_t)player;
+        workers[count] = (int8_t)worker;
+        count++;
+    }
+};
+#endif
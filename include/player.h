@@ -2,20 +2,25 @@
 #define PLAYER_H
 
 #include "game_defs.h"
+#include "assets.h"
 
 #define PLAYER_TOP 0.75f
 #define PLAYER_BOTTOM 0.01f
 #define PLAYER_CENTER 0.0f
 #define PLAYER_RIGHT 0.25f
 #define PLAYER_LEFT -0.25f
+#define PLAYER_SLIDE_SECONDS 0.25f
+#define PLAYER_HOP_HEIGHT 0.6f
 
 class Player
 {
     uint8_t x, y;
+    uint8_t level;
+    glm::vec3 from, to;     // slide from the last square to the current one
+    float progress;         // 0 to 1
     glm::mat4 model;
-    Shader *playerShader;
+    const Assets *assets;
     unsigned int VAO, VBO;
-    unsigned int texture;
 
     const float vertices[18*5] = {
         // Top faces
@@ -49,9 +54,12 @@ public:
     Player(uint8_t X = 0, uint8_t Y = 0) {
         x = X;
         y = Y;
+        level = 0;
+        to = from = squarePosition();
+        progress = 1.0f;
         model = glm::mat4(1.0f);
 
-        playerShader = new Shader("shaders/shader.vs", "shaders/shader.fs");
+        assets = NULL;
 
         glGenBuffers(1, &(VBO));
         glGenVertexArrays(1, &(VAO));
@@ -66,45 +74,52 @@ public:
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
         glEnableVertexAttribArray(1);
-
-        glGenTextures(1, &(texture));
-        glBindTexture(GL_TEXTURE_2D, texture);
-        // set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // load and generate the texture
-        int width, height, nrChannels;
-        unsigned char *data = stbi_load("textures/awesomeface.png", &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        stbi_image_free(data);
     }
 
-    ~Player() {
-        delete playerShader;
+    // The shader and texture to draw with, shared by every piece
+    void useAssets(const Assets *shared) {
+        assets = shared;
     }
 
-    void setLocation(uint8_t newX, uint8_t newY) {
+    // With `slide` the figure hops over from where it is drawn now instead
+    // of jumping there
+    void setLocation(uint8_t newX, uint8_t newY, uint8_t newLevel = 0, bool slide = false) {
+        if(newX == x && newY == y && newLevel == level)
+            return;
         x = newX;
         y = newY;
+        level = newLevel;
+        from = slide ? drawnPosition() : squarePosition();
+        to = squarePosition();
+        progress = slide ? 0.0f : 1.0f;
+    }
+
+    void advance(float seconds) {
+        progress = glm::min(1.0f, progress + seconds / PLAYER_SLIDE_SECONDS);
+    }
+
+    glm::vec3 squarePosition(void) const {
+        return glm::vec3(-TILE_ORIGIN + x * TILE_SPACING, level * LEVEL_HEIGHT, TILE_ORIGIN - y * TILE_SPACING);
+    }
+
+    glm::vec3 drawnPosition(void) const {
+        glm::vec3 p = glm::mix(from, to, progress);
+        p.y += PLAYER_HOP_HEIGHT * 4.0f * progress * (1.0f - progress);
+        return p;
     }
 
-    void drawPlayer(glm::mat4 view, glm::mat4 projection) {
+    void drawPlayer(glm::mat4 view, glm::mat4 projection, glm::vec4 tint = glm::vec4(0.0f)) {
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindTexture(GL_TEXTURE_2D, assets->texture(IMAGE_WORKER));
 
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, y));
+        model = glm::translate(glm::mat4(1.0f), drawnPosition());
 
-        playerShader->use();
-        playerShader->setMat4("model", model);
-        playerShader->setMat4("view", view);
-        playerShader->setMat4("projection", projection);
+        assets->shader()->use();
+        assets->shader()->setMat4("model", model);
+        assets->shader()->setMat4("view", view);
+        assets->shader()->setMat4("projection", projection);
+        assets->shader()->setVec4("tint", tint);
 
         glBindVertexArray(VAO);
         glDrawArrays(GL_TRIANGLES, 0, 18);
@@ -0,0 +1,123 @@
+#ifndef PONDER_H
+#define PONDER_H
+
+#include <stdint.h>
+
+#include "game_state.h"
+#include "search.h"
+#include "ai_task.h"
+#include "transposition.h"
+
+// Depth of the quick search used to guess a reply when no PV move is known
+#define PONDER_PREDICT_DEPTH 2
+
+struct PonderStats
+{
+    uint32_t started;
+    uint32_t hits;
+    uint32_t misses;
+    int64_t savedMs;    // clock time the hits did not have to spend
+
+    double hitRate(void) const {
+        return (hits + misses) ? (double)hits / (hits + misses) : 0.0;
+    }
+    double savedPerMove(void) const {
+        return (hits + misses) ? (double)savedMs / (hits + misses) : 0.0;
+    }
+};
+
+// Thinks on the opponent's time. While the opponent is to move we guess their
+// reply and search the resulting position as a job on the task runner,
+// sharing the transposition table with the main search. If the guess was
+// right the running job is handed the remaining clock (a ponder hit);
+// otherwise it is dropped and the warmed table is all that carries over.
+class Ponderer
+{
+    AiTaskRunner *runner;
+    Search predictor;
+
+    GameState opponentRoot;
+    GameState expected;
+    bool active;
+    int64_t ponderStart;
+    PonderStats stats;
+
+public:
+    Ponderer(AiTaskRunner &taskRunner, TranspositionTable &tt)
+        : runner(&taskRunner), predictor(tt), active(false), ponderStart(0) {
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    bool isPondering(void) const {
+        return active;
+    }
+
+    const PonderStats &getStats(void) const {
+        return stats;
+    }
+
+    // Opponent is to move in `state`. `predicted` may be NULL_MOVE, in which
+    // case a shallow search (well under a frame) picks their likely reply.
+    void start(const GameState &state, const Move &predicted) {
+        if(active && opponentRoot.samePosition(state))
+            return;
+        stop();
+        if(state.isOver())
+            return;
+
+        MoveList moves;
+        state.generateMoves(moves);
+        bool legal = false;
+        for(int i = 0; i < moves.count && !legal; i++)
+            legal = (moves.moves[i] == predicted);
+
+        Move reply = predicted;
+        if(!legal) {
+            predictor.resetStop();
+            reply = predictor.think(state, SearchLimits::fixedDepth(PONDER_PREDICT_DEPTH)).best;
+        }
+        if(reply.isNull() || reply.isWin())
+            return;
+
+        opponentRoot = state;
+        expected = state;
+        expected.apply(reply);
+        runner->start(expected, SearchLimits::pondering());
+        active = true;
+        ponderStart = nowMs();
+        stats.started++;
+    }
+
+    // The opponent has moved and `actual` is now our position. On a ponder hit
+    // the running job keeps going with what is left of `budgetMs` and the
+    // caller collects it from the runner; on a miss the job is cancelled.
+    bool resolve(const GameState &actual, int64_t budgetMs) {
+        if(!active)
+            return false;
+        active = false;
+
+        if(!expected.samePosition(actual)) {
+            runner->cancel();
+            stats.misses++;
+            return false;
+        }
+
+        int64_t pondered = nowMs() - ponderStart;
+        if(pondered >= budgetMs)
+            runner->finish();
+        else
+            runner->setTimeLimit(budgetMs - pondered);
+
+        stats.hits++;
+        stats.savedMs += (pondered < budgetMs) ? pondered : budgetMs;
+        return true;
+    }
+
+    void stop(void) {
+        if(!active)
+            return;
+        runner->cancel();
+        active = false;
+    }
+};
+#endif
@@ -0,0 +1,202 @@
+#ifndef PUZZLE_H
+#define PUZZLE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+
+#include "game_state.h"
+#include "notation.h"
+
+#define MATE_TABLE_BITS 18
+#define PUZZLE_MAX_MATE 7
+#define PUZZLE_LINE_MAX (POSITION_TEXT_MAX + 32)
+
+// Exact bounded forced-win search for two player positions. "Mate in n"
+// means the side to move steps onto level 3 on its n-th turn at the latest,
+// or leaves the opponent without a move before that turn, whatever the
+// opponent plays.
+//
+// Only moves that leave the opponent without an immediate win are tried,
+// and an opponent reply only has to fail once, so lost lines are dropped
+// after one refutation and the search stays cheap on ordinary positions.
+class MateSearch
+{
+    // A position's known bounds: a forced win within `win` turns (0 if none
+    // is known) and none within `noWin` turns
+    struct Entry
+    {
+        uint64_t key;
+        uint8_t win;
+        uint8_t noWin;
+    };
+
+    std::vector<Entry> table;
+    uint64_t mask;
+
+public:
+    uint64_t nodes;
+
+    MateSearch() : table(1u << MATE_TABLE_BITS), mask((1u << MATE_TABLE_BITS) - 1), nodes(0) {
+        clear();
+    }
+
+    void clear(void) {
+        memset(&table[0], 0, table.size() * sizeof(Entry));
+    }
+
+    // Does the side to move force a win within `n` of its own turns?
+    bool winsWithin(const GameState &state, int n) {
+        nodes++;
+        if(state.winningSquares(state.toMove))
+            return true;
+        if(n <= 1)
+            return false;
+
+        Entry &e = table[state.hash & mask];
+        if(e.key == state.hash) {
+            if(e.win && e.win <= n)
+                return true;
+            if(e.noWin >= n)
+                return false;
+        }
+
+        MoveList list;
+        state.generateMoves(list);
+        bool found = false;
+        for(int i = 0; i < list.count && !found; i++)
+            found = forcesWin(state, list.moves[i], n);
+
+        if(e.key != state.hash) {
+            e.key = state.hash;
+            e.win = e.noWin = 0;
+        }
+        if(found)
+            e.win = (e.win && e.win < n) ? e.win : n;
+        else if(n > e.noWin)
+            e.noWin = n;
+        return found;
+    }
+
+    // Does playing `m` win within `n` turns, counting this one?
+    bool forcesWin(const GameState &state, const Move &m, int n) {
+        if(m.isWin())
+            return true;
+        if(n <= 1)
+            return false;
+        GameState child = state;
+        child.apply(m);
+        if(child.winningSquares(child.toMove))
+            return false;
+
+        // Replies never change our workers' levels, so without one on level
+        // 2 the last turn can only win by the opponent being stuck
+        if(n == 2 && !onLevel(child, state.toMove, WIN_LEVEL - 1))
+            return !child.hasMoves();
+
+        // No reply at all loses for the opponent
+        MoveList replies;
+        child.generateMoves(replies);
+        for(int i = 0; i < replies.count; i++) {
+            GameState next = child;
+            next.apply(replies.moves[i]);
+            if(!winsWithin(next, n - 1))
+                return false;
+        }
+        return true;
+    }
+
+    // Is a worker of `player` standing on `level`?
+    static bool onLevel(const GameState &state, uint8_t player, uint8_t level) {
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+            uint8_t sq = state.workers[player][w];
+            if(sq != NO_SQUARE && state.heights[sq] == level)
+                return true;
+        }
+        return false;
+    }
+
+    // Shortest forced win up to `maxN` turns, or 0 if there is none
+    int mateIn(const GameState &state, int maxN) {
+        for(int n = 1; n <= maxN; n++)
+            if(winsWithin(state, n))
+                return n;
+        return 0;
+    }
+
+    // Moves that win within `n` turns; stops counting at `limit`
+    int winningMoves(const GameState &state, int n, Move &first, int limit = 2) {
+        MoveList list;
+        state.generateMoves(list);
+        int found = 0;
+        for(int i = 0; i < list.count && found < limit; i++)
+            if(forcesWin(state, list.moves[i], n)) {
+                if(!found)
+                    first = list.moves[i];
+                found++;
+            }
+        return found;
+    }
+};
+
+// One line of a puzzle file: the position, the mate length and the only
+// first move that wins in that many turns,
+//
+//   00000/01200/00300/01000/00000 b2d4/d2b4 1 - mate 2 b2-c3,c4
+struct Puzzle
+{
+    GameState state;
+    int mate;
+    Move solution;
+};
+
+inline int formatPuzzle(const Puzzle &puzzle, char *out, size_t size) {
+    if(size < PUZZLE_LINE_MAX)
+        return -1;
+    int length = formatPosition(puzzle.state, out, size);
+    char *p = out + length;
+    p += sprintf(p, " mate %d ", puzzle.mate);
+    p = moveName(puzzle.solution, p);
+    *p = 0;
+    return (int)(p - out);
+}
+
+inline int parsePuzzle(const char *text, Puzzle &puzzle) {
+    const char *p;
+    if(parsePosition(text, puzzle.state, &p))
+        return -1;
+    int mate, used = 0;
+    if(sscanf(p, " mate %d %n", &mate, &used) != 1 || !used || mate < 1 || mate > PUZZLE_MAX_MATE)
+        return -1;
+    if(parseMove(puzzle.state, p + used, puzzle.solution))
+        return -1;
+    puzzle.mate = mate;
+    return 0;
+}
+
+// Reads puzzle number `index` (from 1) of a puzzle file
+inline int loadPuzzle(const char *path, int index, Puzzle &puzzle) {
+    FILE *f = fopen(path, "r");
+    if(!f) {
+        std::cout<<"Failed to open puzzle file "<<path<<std::endl;
+        return -1;
+    }
+    char line[PUZZLE_LINE_MAX + 2];
+    int n = 0;
+    while(fgets(line, sizeof(line), f))
+        if(++n == index)
+            break;
+    fclose(f);
+    if(n != index || index < 1) {
+        std::cout<<path<<" has no puzzle "<<index<<std::endl;
+        return -1;
+    }
+    if(parsePuzzle(line, puzzle)) {
+        std::cout<<"Failed to read puzzle "<<index<<" of "<<path<<std::endl;
+        return -1;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,390 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "game_state.h"
+#include "evaluate.h"
+#include "eval_batch.h"
+#include "nnue.h"
+#include "transposition.h"
+#include "trace.h"
+
+#define MAX_PLY     64
+#define WIN_SCORE   30000
+#define WIN_BOUND   (WIN_SCORE - MAX_PLY)
+#define INF_SCORE   32000
+#define NO_DEADLINE INT64_MAX
+
+inline int64_t nowMs(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct SearchLimits
+{
+    int depth;
+    int64_t timeMs;     // 0 for no time limit
+    bool ponder;        // deadline is left to setTimeLimit() while running
+
+    static SearchLimits fixedDepth(int depth) { SearchLimits l = { depth, 0, false }; return l; }
+    static SearchLimits timed(int64_t ms) { SearchLimits l = { MAX_PLY - 1, ms, false }; return l; }
+    static SearchLimits infinite(void) { SearchLimits l = { MAX_PLY - 1, 0, false }; return l; }
+    static SearchLimits pondering(void) { SearchLimits l = { MAX_PLY - 1, 0, true }; return l; }
+};
+
+struct SearchResult
+{
+    Move best;
+    int score;
+    int depth;
+    uint64_t nodes;
+    int64_t timeMs;
+    Move pv[MAX_PLY];
+    int pvLength;
+};
+
+typedef std::function<void(const SearchResult &)> SearchCallback;
+
+// Iterative deepening alpha-beta for two players, sharing a transposition table
+class Search
+{
+    TranspositionTable *tt;
+    std::atomic<bool> stopFlag;
+    std::atomic<int64_t> deadline;
+    int64_t startMs;
+    uint64_t nodes;
+    bool aborted;
+
+    const NnueNetwork *network;
+    bool useNetwork;
+    NnueAccumulator accStack[MAX_PLY + 1];
+
+public:
+    Search(TranspositionTable &table) : tt(&table), stopFlag(false), deadline(NO_DEADLINE),
+                                        startMs(0), nodes(0), aborted(false),
+                                        network(NULL), useNetwork(false) {}
+
+    // Evaluate with a network instead of the handcrafted terms; NULL to go back
+    void setNetwork(const NnueNetwork *net) {
+        network = net;
+    }
+
+    // Request the running think() to return as soon as possible. The request
+    // sticks until resetStop(), so it cannot be lost between two think() calls.
+    void stop(void) {
+        stopFlag.store(true);
+    }
+
+    void resetStop(void) {
+        stopFlag.store(false);
+        deadline.store(NO_DEADLINE);
+    }
+
+    // Replace the deadline of a running search, measured from now
+    void setTimeLimit(int64_t ms) {
+        deadline.store(ms > 0 ? nowMs() + ms : NO_DEADLINE);
+    }
+
+    SearchResult think(const GameState &root, const SearchLimits &limits,
+                       const SearchCallback &onIteration = SearchCallback()) {
+        SearchResult result;
+        memset(&result, 0, sizeof(result));
+        result.best = NULL_MOVE;
+        result.score = -WIN_SCORE;
+
+        startMs = nowMs();
+        nodes = 0;
+        aborted = false;
+        if(!limits.ponder)
+            deadline.store(limits.timeMs > 0 ? startMs + limits.timeMs : NO_DEADLINE);
+
+        MoveList rootMoves;
+        root.generateMoves(rootMoves);
+        if(!rootMoves.count || root.isOver())
+            return result;
+        result.best = rootMoves.moves[0];
+
+        useNetwork = network && root.numPlayers == NNUE_PERSPECTIVES;
+        if(useNetwork)
+            network->refresh(root, accStack[0]);
+
+        int maxDepth = (limits.depth < 1) ? 1 : (limits.depth >= MAX_PLY ? MAX_PLY - 1 : limits.depth);
+        for(int depth = 1; depth <= maxDepth; depth++) {
+            TRACE_ZONE("search iteration");
+            int64_t iterationStart = nowMs();
+            checkTime();
+            if(aborted)
+                break;
+
+            Move best = NULL_MOVE;
+            int score = rootSearch(root, rootMoves, depth, best);
+            if(aborted)
+                break;
+
+            result.best = best;
+            result.score = score;
+            result.depth = depth;
+            result.nodes = nodes;
+            result.timeMs = nowMs() - startMs;
+            extractPV(root, result);
+            if(onIteration)
+                onIteration(result);
+
+            // A proven result will not change with more depth
+            if(score >= WIN_BOUND || score <= -WIN_BOUND)
+                break;
+
+            // Don't start an iteration we expect to be cut off halfway through
+            int64_t now = nowMs();
+            int64_t end = deadline.load();
+            if(end != NO_DEADLINE && end - now < now - iterationStart)
+                break;
+        }
+
+        result.nodes = nodes;
+        result.timeMs = nowMs() - startMs;
+        return result;
+    }
+
+private:
+    void checkTime(void) {
+        if(stopFlag.load(std::memory_order_relaxed) || nowMs() >= deadline.load(std::memory_order_relaxed))
+            aborted = true;
+    }
+
+    static int scoreToTT(int score, int ply) {
+        if(score >= WIN_BOUND) return score + ply;
+        if(score <= -WIN_BOUND) return score - ply;
+        return score;
+    }
+
+    static int scoreFromTT(int score, int ply) {
+        if(score >= WIN_BOUND) return score - ply;
+        if(score <= -WIN_BOUND) return score + ply;
+        return score;
+    }
+
+    // Order the list in place: hash move, then wins, then climbing steps
+    static void orderMoves(const GameState &state, MoveList &list, const Move &hashMove) {
+        int keys[MAX_MOVES];
+        for(int i = 0; i < list.count; i++) {
+            const Move &m = list.moves[i];
+            if(m == hashMove)
+                keys[i] = 1 << 20;
+            else if(m.isWin())
+                keys[i] = 1 << 19;
+            else
+                keys[i] = (state.heights[m.to] - state.heights[m.from]) * 16 + state.heights[m.build];
+        }
+        // Insertion sort; lists are short and often nearly ordered
+        for(int i = 1; i < list.count; i++) {
+            Move m = list.moves[i];
+            int k = keys[i];
+            int j = i - 1;
+            while(j >= 0 && keys[j] < k) {
+                list.moves[j+1] = list.moves[j];
+                keys[j+1] = keys[j];
+                j--;
+            }
+            list.moves[j+1] = m;
+            keys[j+1] = k;
+        }
+    }
+
+    int rootSearch(const GameState &root, MoveList &moves, int depth, Move &best) {
+        TTHit hit;
+        Move hashMove = tt->probe(root.hash, hit) ? hit.move : NULL_MOVE;
+        orderMoves(root, moves, hashMove);
+
+        int alpha = -INF_SCORE;
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            int score;
+            if(m.isWin()) {
+                score = WIN_SCORE - 1;
+            }
+            else {
+                GameState child = root;
+                child.apply(m);
+                if(child.winningSquares(child.toMove))
+                    score = -(WIN_SCORE - 2);
+                else {
+                    pushAccumulator(root, m, 0);
+                    score = -negamax(child, depth - 1, -INF_SCORE, -alpha, 1);
+                }
+            }
+            if(aborted)
+                return alpha;
+            if(score > alpha) {
+                alpha = score;
+                best = m;
+            }
+        }
+        tt->store(root.hash, best, scoreToTT(alpha, 0), depth, TT_EXACT);
+        return alpha;
+    }
+
+    int negamax(const GameState &state, int depth, int alpha, int beta, int ply) {
+        if((++nodes & 1023) == 0)
+            checkTime();
+        if(aborted)
+            return 0;
+
+        if(depth <= 0 || ply >= MAX_PLY - 1)
+            return staticEval(state, ply);
+
+        Move hashMove = NULL_MOVE;
+        TTHit hit;
+        if(tt->probe(state.hash, hit)) {
+            hashMove = hit.move;
+            if(hit.depth >= depth) {
+                int s = scoreFromTT(hit.score, ply);
+                if(hit.bound == TT_EXACT ||
+                   (hit.bound == TT_LOWER && s >= beta) ||
+                   (hit.bound == TT_UPPER && s <= alpha))
+                    return s;
+            }
+        }
+
+        // A step up onto level 3 ends the game; no need to generate moves
+        if(state.winningSquares(state.toMove))
+            return WIN_SCORE - ply - 1;
+
+        MoveList moves;
+        state.generateMoves(moves);
+        if(!moves.count)
+            return -(WIN_SCORE - ply);
+
+        if(depth == 1)
+            return frontier(state, moves, ply);
+
+        orderMoves(state, moves, hashMove);
+
+        int origAlpha = alpha;
+        int bestScore = -INF_SCORE;
+        Move best = moves.moves[0];
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            int score;
+            if(m.isWin()) {
+                score = WIN_SCORE - ply - 1;
+            }
+            else {
+                GameState child = state;
+                child.apply(m);
+                // Leaving a step up open for the opponent (not blocking) loses at once
+                if(child.winningSquares(child.toMove))
+                    score = -(WIN_SCORE - ply - 2);
+                else {
+                    pushAccumulator(state, m, ply);
+                    score = -negamax(child, depth - 1, -beta, -alpha, ply + 1);
+                }
+            }
+            if(aborted)
+                return 0;
+
+            if(score > bestScore) {
+                bestScore = score;
+                best = m;
+            }
+            if(score > alpha)
+                alpha = score;
+            if(alpha >= beta)
+                break;
+        }
+
+        TTBound bound = (bestScore >= beta) ? TT_LOWER : (bestScore > origAlpha ? TT_EXACT : TT_UPPER);
+        tt->store(state.hash, best, scoreToTT(bestScore, ply), depth, bound);
+        return bestScore;
+    }
+
+    int staticEval(const GameState &state, int ply) const {
+        return useNetwork ? network->evaluate(accStack[ply], state.toMove) : evaluate(state);
+    }
+
+    // Child accumulator for `m` played from `state` at `ply`
+    void pushAccumulator(const GameState &state, const Move &m, int ply) {
+        if(useNetwork)
+            network->update(accStack[ply], state, m, accStack[ply + 1]);
+    }
+
+    // Every child of a depth 1 node is a leaf, so score them all in one batch
+    // rather than recursing per move; cutoffs would only have saved evaluations
+    int frontier(const GameState &state, const MoveList &moves, int ply) {
+        GameState children[MAX_MOVES];
+        int scores[MAX_MOVES];
+
+        for(int i = 0; i < moves.count; i++) {
+            if(moves.moves[i].isWin()) {
+                tt->store(state.hash, moves.moves[i], scoreToTT(WIN_SCORE - ply - 1, ply), 1, TT_EXACT);
+                return WIN_SCORE - ply - 1;
+            }
+            children[i] = state;
+            children[i].apply(moves.moves[i]);
+        }
+
+        uint64_t before = nodes;
+        nodes += moves.count;
+        if((before >> 10) != (nodes >> 10))
+            checkTime();
+
+        // The network scores one child at a time, so it skips those the next
+        // loop marks lost
+        bool lost[MAX_MOVES];
+        for(int i = 0; i < moves.count; i++)
+            lost[i] = children[i].winningSquares(children[i].toMove);
+        if(useNetwork) {
+            for(int i = 0; i < moves.count; i++) {
+                scores[i] = 0;
+                if(lost[i])
+                    continue;
+                pushAccumulator(state, moves.moves[i], ply);
+                scores[i] = staticEval(children[i], ply + 1);
+            }
+        }
+        else
+            evaluateBatch(children, moves.count, scores);
+
+        // Children where the opponent can step up are lost, whatever the evaluation says
+        for(int i = 0; i < moves.count; i++)
+            if(lost[i])
+                scores[i] = WIN_SCORE - ply - 2;
+
+        int best = 0;
+        for(int i = 1; i < moves.count; i++)
+            if(scores[i] < scores[best])
+                best = i;
+        int bestScore = -scores[best];
+
+        // Nothing was cut off, so the score is exact whatever the window
+        tt->store(state.hash, moves.moves[best], scoreToTT(bestScore, ply), 1, TT_EXACT);
+        return bestScore;
+    }
+
+    void extractPV(const GameState &root, SearchResult &result) {
+        GameState state = root;
+        result.pvLength = 0;
+        result.pv[result.pvLength++] = result.best;
+        if(result.best.isWin())
+            return;
+        state.apply(result.best);
+
+        TTHit hit;
+        while(result.pvLength < result.depth && !state.isOver() && tt->probe(state.hash, hit)) {
+            MoveList moves;
+            state.generateMoves(moves);
+            bool legal = false;
+            for(int i = 0; i < moves.count && !legal; i++)
+                legal = (moves.moves[i] == hit.move);
+            if(!legal)
+                break;
+            result.pv[result.pvLength++] = hit.move;
+            state.apply(hit.move);
+        }
+    }
+};
+#endif
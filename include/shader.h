@@ -9,6 +9,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "trace.h"
+
 class Shader
 {
 public:
@@ -17,6 +19,7 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
+        TRACE_ZONE("Shader::Shader");
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -0,0 +1,68 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define STARTUP_MAX_PHASES 32
+
+// Where the time from launch to a fully loaded client went. The main thread
+// marks the end of each phase as it goes; work done on other threads, e.g.
+// decoding textures, is added as a span with its own start and end so the
+// report shows what overlapped what.
+class StartupReport
+{
+    struct Phase
+    {
+        const char *name;
+        int64_t startUs;
+        int64_t endUs;
+        bool worker;
+    };
+
+    Phase phases[STARTUP_MAX_PHASES];
+    int count;
+    int64_t originUs;
+    int64_t lastUs;
+
+public:
+    StartupReport() : count(0), originUs(nowUs()), lastUs(originUs) {}
+
+    // Ends the phase the main thread has been in since the last mark
+    void mark(const char *name) {
+        int64_t now = nowUs();
+        add(name, lastUs, now, false);
+        lastUs = now;
+    }
+
+    // Work that ran on another thread, timed with nowUs()
+    void span(const char *name, int64_t startUs, int64_t endUs) {
+        add(name, startUs, endUs, true);
+    }
+
+    void print(void) const {
+        printf("Startup (ms since launch)\n");
+        printf("  %-24s %8s %8s %8s\n", "phase", "start", "end", "took");
+        for(int i = 0; i < count; i++) {
+            const Phase &p = phases[i];
+            printf("  %-24s %8.1f %8.1f %8.1f%s\n", p.name, (p.startUs - originUs) / 1000.0,
+                   (p.endUs - originUs) / 1000.0, (p.endUs - p.startUs) / 1000.0, p.worker ? "  (worker)" : "");
+        }
+    }
+
+    static int64_t nowUs(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    }
+
+private:
+    void add(const char *name, int64_t startUs, int64_t endUs, bool worker) {
+        if(count >= STARTUP_MAX_PHASES)
+            return;
+        Phase p = { name, startUs, endUs, worker };
+        phases[count++] = p;
+    }
+};
+#endif
@@ -0,0 +1,67 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include <stdint.h>
+
+#include "game_state.h"
+
+// The eight symmetries of the square board. Bit 0 mirrors x, bit 1 mirrors
+// y, bit 2 swaps x and y (applied last). Transform 0 is the identity.
+#define NUM_SYMMETRIES 8
+
+inline uint8_t transformSquare(uint8_t sq, int t) {
+    if(sq == NO_SQUARE)
+        return NO_SQUARE;
+    uint8_t x = squareX(sq), y = squareY(sq);
+    if(t & 1) x = BOARD_WIDTH - 1 - x;
+    if(t & 2) y = BOARD_WIDTH - 1 - y;
+    return (t & 4) ? squareIndex(y, x) : squareIndex(x, y);
+}
+
+// `state` seen through transform `t`. Each player's workers are put in
+// square order so the worker numbering doesn't tell positions apart.
+inline GameState transformState(const GameState &state, int t) {
+    GameState out = state;
+    for(int sq = 0; sq < NUM_SQUARES; sq++)
+        out.heights[transformSquare(sq, t)] = state.heights[sq];
+    out.occupied = 0;
+    for(int p = 0; p < MAX_PLAYERS; p++) {
+        uint8_t a = transformSquare(state.workers[p][0], t);
+        uint8_t b = transformSquare(state.workers[p][1], t);
+        out.workers[p][0] = (a < b) ? a : b;
+        out.workers[p][1] = (a < b) ? b : a;
+        for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+            if(out.workers[p][w] != NO_SQUARE)
+                out.occupied |= 1u << out.workers[p][w];
+    }
+    out.rehash();
+    return out;
+}
+
+// The same move after transform `t`, renumbered for the transformed state
+inline Move transformMove(const Move &m, const GameState &transformed, int t) {
+    Move out;
+    out.from = transformSquare(m.from, t);
+    out.to = transformSquare(m.to, t);
+    out.build = transformSquare(m.build, t);
+    out.worker = (transformed.workers[transformed.toMove][0] == out.from) ? 0 : 1;
+    return out;
+}
+
+// The symmetric copy with the smallest hash, so every copy of a position
+// maps to the same one. `transform` gets the transform that produced it.
+inline GameState canonicalState(const GameState &state, int *transform = NULL) {
+    GameState best = transformState(state, 0);
+    int bestT = 0;
+    for(int t = 1; t < NUM_SYMMETRIES; t++) {
+        GameState s = transformState(state, t);
+        if(s.hash < best.hash) {
+            best = s;
+            bestT = t;
+        }
+    }
+    if(transform)
+        *transform = bestT;
+    return best;
+}
+#endif
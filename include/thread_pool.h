@@ -0,0 +1,241 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker runs
+// its newest task first (LIFO keeps follow-up work hot in cache) and, when
+// its deque is empty, steals the oldest task from another worker. Tasks
+// submitted from outside the pool are dealt round robin.
+//
+// Subsystems in one process should share ThreadPool::shared() rather than
+// start their own threads, and wait for their own work with a TaskGroup:
+// waitIdle() waits for every task in the pool, including other users'.
+class ThreadPool
+{
+    struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskQueue[]> queues;
+    int numThreads;
+
+    std::atomic<bool> quit;
+    std::atomic<int> queued;        // submitted but not yet picked up
+    std::atomic<int> active;        // queued plus running
+    std::atomic<uint32_t> nextQueue;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+public:
+    // `count` <= 0 uses every hardware thread
+    ThreadPool(int count = 0) : quit(false), queued(0), active(0), nextQueue(0) {
+        if(count <= 0)
+            count = defaultThreads();
+        numThreads = count;
+        queues.reset(new TaskQueue[count]);
+        for(int i = 0; i < count; i++)
+            threads.push_back(std::thread(&ThreadPool::run, this, i));
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            quit = true;
+        }
+        wake.notify_all();
+        for(size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+    }
+
+    // The process wide pool, one thread per hardware thread, created on first use
+    static ThreadPool &shared(void) {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    static int defaultThreads(void) {
+        unsigned n = std::thread::hardware_concurrency();
+        return n ? (int)n : 1;
+    }
+
+    int size(void) const {
+        return numThreads;
+    }
+
+    // Index of this pool's thread making the call, -1 from any other thread
+    int currentIndex(void) const {
+        return (current().pool == this) ? current().index : -1;
+    }
+
+    void submit(std::function<void()> task) {
+        int self = currentIndex();
+        int target = (self >= 0) ? self : (int)(nextQueue.fetch_add(1) % numThreads);
+        active++;
+        {
+            std::lock_guard<std::mutex> guard(queues[target].lock);
+            queues[target].tasks.push_back(std::move(task));
+        }
+        queued++;
+        {
+            // A worker checks `queued` under this lock, so it cannot miss the wakeup
+            std::lock_guard<std::mutex> guard(sleepLock);
+        }
+        wake.notify_one();
+    }
+
+    // Block until every submitted task, including ones they submit, has run
+    void waitIdle(void) {
+        std::unique_lock<std::mutex> guard(sleepLock);
+        idle.wait(guard, [this] { return active == 0; });
+    }
+
+    // Called from a pool thread: run one queued task, its own or a stolen one.
+    // False if there was none, or when called from outside the pool.
+    bool runPending(void) {
+        int self = currentIndex();
+        std::function<void()> task;
+        if(self < 0 || !take(self, task))
+            return false;
+        execute(task);
+        return true;
+    }
+
+private:
+    struct Membership
+    {
+        const ThreadPool *pool;
+        int index;
+    };
+
+    static Membership &current(void) {
+        static thread_local Membership m = { NULL, -1 };
+        return m;
+    }
+
+    bool take(int self, std::function<void()> &task) {
+        {
+            TaskQueue &own = queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if(!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for(int i = 1; i < numThreads; i++) {
+            TaskQueue &victim = queues[(self + i) % numThreads];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if(!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(std::function<void()> &task) {
+        queued--;
+        task();
+        if(--active == 0) {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            idle.notify_all();
+        }
+    }
+
+    void run(int self) {
+        current().pool = this;
+        current().index = self;
+        for(;;) {
+            std::function<void()> task;
+            if(take(self, task)) {
+                execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return quit || queued > 0; });
+            if(quit)
+                return;
+        }
+    }
+};
+
+// Fork/join over a pool: run() forks a task, wait() joins every task forked
+// so far. A pool thread that waits keeps running queued tasks instead of
+// blocking, so tasks may fork and wait on nested groups without tying up
+// the pool; any other thread just sleeps until the group is done.
+class TaskGroup
+{
+    ThreadPool &pool;
+    std::atomic<int> pending;
+    std::mutex lock;
+    std::condition_variable done;
+
+public:
+    TaskGroup(ThreadPool &p = ThreadPool::shared()) : pool(p), pending(0) {}
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    void run(std::function<void()> task) {
+        pending++;
+        pool.submit([this, task] {
+            task();
+            // Decremented under the lock so wait() cannot return, and the
+            // group go away, while this thread still uses it
+            std::lock_guard<std::mutex> guard(lock);
+            if(--pending == 0)
+                done.notify_all();
+        });
+    }
+
+    void wait(void) {
+        while(pending > 0) {
+            if(pool.runPending())
+                continue;
+            // The rest is running on other threads; check back in case one
+            // of them forks more work this thread could help with
+            std::unique_lock<std::mutex> guard(lock);
+            done.wait_for(guard, std::chrono::microseconds(200), [this] { return pending == 0; });
+        }
+        std::lock_guard<std::mutex> guard(lock);
+    }
+};
+
+// Calls fn(begin, end) over [0, count) in slices of about `grain` items, on
+// the pool and the calling thread, and returns when all slices are done
+template<typename Fn>
+inline void parallelFor(ThreadPool &pool, size_t count, size_t grain, Fn fn) {
+    if(grain < 1)
+        grain = 1;
+    if(count <= grain) {
+        if(count)
+            fn((size_t)0, count);
+        return;
+    }
+    TaskGroup group(pool);
+    for(size_t begin = grain; begin < count; begin += grain) {
+        size_t end = (begin + grain < count) ? begin + grain : count;
+        group.run([&fn, begin, end] { fn(begin, end); });
+    }
+    fn((size_t)0, grain);
+    group.wait();
+}
+#endif
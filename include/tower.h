@@ -1,7 +1,8 @@
 #ifndef TOWER_H
 #define TOWER_H
 
-#include "stb_image.h"
+#include "game_defs.h"
+#include "assets.h"
 
 #define TOWER_TOP        1.0f
 #define TOWER_BOTTOM     0.0f
@@ -9,13 +10,14 @@
 #define TOWER_RIGHT      0.5f
 
 #define MAX_HEIGHT 3
+#define DOME_HEIGHT 4
+#define MARKER_HEIGHT 0.05f     // a tinted empty square is drawn this tall
 
 class Tower
 {
     uint8_t height;
-    Shader *towerShader;
+    const Assets *assets;
     unsigned int VAO, VBO;
-    unsigned int texture;
 
     const float vertices[36*5] = {
         TOWER_LEFT,   TOWER_BOTTOM, TOWER_LEFT,  0.0f, 0.0f,
@@ -64,7 +66,7 @@ class Tower
 public:
     Tower(void) {
         height = 0;
-        towerShader = new Shader("shaders/shader.vs", "shaders/shader.fs");
+        assets = NULL;
 
         glGenBuffers(1, &(VBO));
         glGenVertexArrays(1, &(VAO));
@@ -79,49 +81,49 @@ public:
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float)));
         glEnableVertexAttribArray(1);
+    }
 
-        glGenTextures(1, &(texture));
-        glBindTexture(GL_TEXTURE_2D, texture);
-        // set the texture wrapping/filtering options (on the currently bound texture object)
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // load and generate the texture
-        int width, height, nrChannels;
-        unsigned char *data = stbi_load("textures/awesomeface.png", &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        stbi_image_free(data);
+    // The shader and texture to draw with, shared by every piece
+    void useAssets(const Assets *shared) {
+        assets = shared;
     }
+
     uint8_t getHeight(void) {
         return height;
     }
     void incrementHeight(void) {
         height += (height < MAX_HEIGHT) ? 1 : 0;
     }
+    // Any level including a dome, e.g. when showing a loaded position
+    void setHeight(uint8_t newHeight) {
+        height = (newHeight > DOME_HEIGHT) ? DOME_HEIGHT : newHeight;
+    }
 
-    void drawTower(glm::mat4 model, glm::mat4 view, glm::mat4 projection) {
-        // Nothing to do if height is zero
-        if(!height)
+    void drawTower(glm::mat4 model, glm::mat4 view, glm::mat4 projection, glm::vec4 tint = glm::vec4(0.0f)) {
+        // Nothing to do if height is zero, unless the square is tinted
+        if(!height && tint.a == 0.0f)
             return;
 
         glActiveTexture(GL_TEXTURE0);
 
         switch(height) {
+            case 0:
+
             case 1:
 
             case 2:
 
             case 3:
-                glBindTexture(GL_TEXTURE_2D, texture);
-                towerShader->use();
-                towerShader->setMat4("model", model);
-                towerShader->setMat4("view", view);
-                towerShader->setMat4("projection", projection);
+
+            case 4:
+                // One unit block stretched to the number of levels
+                model = glm::scale(model, glm::vec3(1.0f, (height ? height * LEVEL_HEIGHT : MARKER_HEIGHT) / TOWER_TOP, 1.0f));
+                glBindTexture(GL_TEXTURE_2D, assets->texture(IMAGE_WORKER));
+                assets->shader()->use();
+                assets->shader()->setMat4("model", model);
+                assets->shader()->setMat4("view", view);
+                assets->shader()->setMat4("projection", projection);
+                assets->shader()->setVec4("tint", tint);
                 break;
 
             default: break;
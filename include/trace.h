@@ -0,0 +1,160 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Scoped-zone tracing. TRACE_ZONE("name") at the top of a block records
+// when the block was entered and left; TRACE_THREAD("name") labels the
+// calling thread; TRACE_SAVE("file.json") writes everything still held as a
+// Chrome trace (open it in chrome://tracing or ui.perfetto.dev).
+//
+// Tracing is compiled in only with -DSANTORINI_TRACE (make TRACE=1).
+// Without it the macros expand to nothing and TRACE_SAVE to 0, so zones can
+// stay in hot code. Names must be string literals or otherwise outlive the
+// trace.
+//
+// Each thread writes finished zones into its own ring buffer of
+// TRACE_BUFFER_EVENTS, so recording takes two clock reads and a few stores
+// and no lock; older zones are overwritten once a buffer wraps.
+
+#ifdef SANTORINI_TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#define TRACE_BUFFER_EVENTS (1 << 16)
+
+struct TraceEvent
+{
+    const char *name;
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+struct TraceBuffer
+{
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    std::atomic<uint64_t> written;
+    const char *threadName;
+    int id;
+
+    TraceBuffer(int tid) : written(0), threadName(NULL), id(tid) {}
+};
+
+class Tracer
+{
+    std::mutex lock;                                // guards `buffers` only
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    int64_t originNs;
+
+public:
+    Tracer() : originNs(nowNs()) {}
+
+    static Tracer &instance(void) {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    static int64_t nowNs(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    // This thread's buffer, made on its first zone
+    TraceBuffer &local(void) {
+        thread_local TraceBuffer *buffer = NULL;
+        if(!buffer) {
+            std::lock_guard<std::mutex> guard(lock);
+            buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer((int)buffers.size() + 1)));
+            buffer = buffers.back().get();
+        }
+        return *buffer;
+    }
+
+    void record(const char *name, int64_t startNs, int64_t endNs) {
+        TraceBuffer &b = local();
+        uint64_t n = b.written.load(std::memory_order_relaxed);
+        TraceEvent &e = b.events[n & (TRACE_BUFFER_EVENTS - 1)];
+        e.name = name;
+        e.startNs = startNs;
+        e.durationNs = endNs - startNs;
+        b.written.store(n + 1, std::memory_order_release);
+    }
+
+    // Writes the zones every thread still holds; -1 if the file could not be
+    // written. Threads may keep recording: zones their buffers overwrote
+    // while being copied are left out.
+    int save(const char *path) {
+        FILE *f = fopen(path, "w");
+        if(!f) {
+            std::cout<<"Failed to open trace file "<<path<<std::endl;
+            return -1;
+        }
+        fprintf(f, "{\"traceEvents\":[\n");
+        bool first = true;
+        std::vector<TraceEvent> copy(TRACE_BUFFER_EVENTS);
+        std::lock_guard<std::mutex> guard(lock);
+        for(size_t i = 0; i < buffers.size(); i++) {
+            TraceBuffer &b = *buffers[i];
+            if(b.threadName) {
+                fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        first ? "" : ",\n", b.id, b.threadName);
+                first = false;
+            }
+            uint64_t end = b.written.load(std::memory_order_acquire);
+            uint64_t copied = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS : 0;
+            for(uint64_t n = copied; n < end; n++)
+                copy[n - copied] = b.events[n & (TRACE_BUFFER_EVENTS - 1)];
+            // Slots the thread reused while we copied may be torn
+            uint64_t after = b.written.load(std::memory_order_acquire);
+            uint64_t begin = copied;
+            if(after > TRACE_BUFFER_EVENTS && after - TRACE_BUFFER_EVENTS > begin)
+                begin = after - TRACE_BUFFER_EVENTS < end ? after - TRACE_BUFFER_EVENTS : end;
+            for(uint64_t n = begin; n < end; n++) {
+                const TraceEvent &e = copy[n - copied];
+                fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        first ? "" : ",\n", e.name, b.id, (e.startNs - originNs) / 1000.0, e.durationNs / 1000.0);
+                first = false;
+            }
+        }
+        fprintf(f, "\n]}\n");
+        if(fclose(f)) {
+            std::cout<<"Failed to write trace file "<<path<<std::endl;
+            return -1;
+        }
+        return 0;
+    }
+};
+
+class TraceZone
+{
+    const char *name;
+    int64_t startNs;
+
+public:
+    TraceZone(const char *zone) : name(zone), startNs(Tracer::nowNs()) {}
+
+    ~TraceZone() {
+        Tracer::instance().record(name, startNs, Tracer::nowNs());
+    }
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD(name) (Tracer::instance().local().threadName = (name))
+#define TRACE_SAVE(path) Tracer::instance().save(path)
+
+#else
+
+#define TRACE_ZONE(name) do {} while(0)
+#define TRACE_THREAD(name) do {} while(0)
+#define TRACE_SAVE(path) 0
+
+#endif
+#endif
@@ -0,0 +1,94 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "game_state.h"
+
+#define TT_DEFAULT_MB 16
+
+enum TTBound {
+    TT_NONE  = 0,
+    TT_EXACT = 1,
+    TT_LOWER = 2,
+    TT_UPPER = 3
+};
+
+struct TTHit
+{
+    Move move;
+    int score;
+    int depth;
+    TTBound bound;
+};
+
+// Shared hash table for search results. Each slot is two atomics with the key
+// stored XORed against the data, so concurrent readers and writers never see
+// a torn entry as valid (they simply miss).
+class TranspositionTable
+{
+    struct Entry {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    Entry *entries;
+    uint64_t mask;
+
+public:
+    TranspositionTable(size_t megabytes = TT_DEFAULT_MB) {
+        uint64_t count = 1;
+        while(count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024)
+            count *= 2;
+        entries = new Entry[count];
+        mask = count - 1;
+        clear();
+    }
+
+    ~TranspositionTable() {
+        delete[] entries;
+    }
+
+    void clear(void) {
+        for(uint64_t i = 0; i <= mask; i++) {
+            entries[i].key.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t hash, TTHit &hit) const {
+        const Entry &e = entries[hash & mask];
+        uint64_t data = e.data.load(std::memory_order_relaxed);
+        uint64_t key = e.key.load(std::memory_order_relaxed);
+        if((key ^ data) != hash || !data)
+            return false;
+
+        hit.move.worker = data & 0xFF;
+        hit.move.from   = (data >> 8) & 0xFF;
+        hit.move.to     = (data >> 16) & 0xFF;
+        hit.move.build  = (data >> 24) & 0xFF;
+        hit.score = (int16_t)((data >> 32) & 0xFFFF);
+        hit.depth = (data >> 48) & 0xFF;
+        hit.bound = (TTBound)((data >> 56) & 0xFF);
+        return true;
+    }
+
+    void store(uint64_t hash, const Move &move, int score, int depth, TTBound bound) {
+        Entry &e = entries[hash & mask];
+
+        // Keep a deeper result for the same position unless this one is exact
+        uint64_t old = e.data.load(std::memory_order_relaxed);
+        if((e.key.load(std::memory_order_relaxed) ^ old) == hash &&
+           (int)((old >> 48) & 0xFF) > depth && bound != TT_EXACT)
+            return;
+
+        uint64_t data = (uint64_t)move.worker | ((uint64_t)move.from << 8) |
+                        ((uint64_t)move.to << 16) | ((uint64_t)move.build << 24) |
+                        ((uint64_t)(uint16_t)(int16_t)score << 32) |
+                        ((uint64_t)(depth & 0xFF) << 48) | ((uint64_t)bound << 56);
+        e.key.store(hash ^ data, std::memory_order_relaxed);
+        e.data.store(data, std::memory_order_relaxed);
+    }
+};
+#endif
@@ -4,8 +4,10 @@ out vec4 FragColor;
 in vec2 TexCoord;
 
 uniform sampler2D ourTexture;
+uniform vec4 tint;      // rgb blended over the texture by a; zero leaves it untouched
 
 void main()
 {
-    FragColor = texture(ourTexture, TexCoord);
+    vec4 color = texture(ourTexture, TexCoord);
+    FragColor = vec4(mix(color.rgb, tint.rgb, tint.a), color.a);
 }
@@ -0,0 +1,147 @@
+// Benchmark for batched static evaluation: positions per second through the
+// plain evaluate() loop and each evaluateBatch() kernel, checked for
+// agreement on the same set of positions. Given a network, also the
+// network the way search uses it: one accumulator update from the parent
+// and one evaluation per position, checked against a full refresh.
+//
+//   bench_eval [positions] [rounds] [network]
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<vector>
+
+#include"game_state.h"
+#include"evaluate.h"
+#include"eval_batch.h"
+#include"search.h"
+#include"nnue.h"
+
+#define BATCH_SIZE 64
+
+static uint64_t g_rng = 0x9E3779B97F4A7C15ULL;
+
+static uint32_t randomNumber(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 32);
+}
+
+// Positions from random playouts, so heights and worker spreads vary
+static void randomPositions(std::vector<GameState> &out, int count)
+{
+    GameState state;
+    state.reset(2);
+    while((int)out.size() < count) {
+        MoveList moves;
+        state.generateMoves(moves);
+        if(!moves.count || state.isOver()) {
+            state.reset(2 + randomNumber() % 3);
+            continue;
+        }
+        state.apply(moves.moves[randomNumber() % moves.count]);
+        if(!state.isOver())
+            out.push_back(state);
+    }
+}
+
+// Two player parents and one move each that does not end the game
+static void randomMoves(const std::vector<GameState> &positions, std::vector<GameState> &parents,
+                        std::vector<Move> &moves)
+{
+    for(size_t i = 0; i < positions.size(); i++) {
+        if(positions[i].numPlayers != NNUE_PERSPECTIVES)
+            continue;
+        MoveList list;
+        positions[i].generateMoves(list);
+        if(!list.count)
+            continue;
+        Move m = list.moves[randomNumber() % list.count];
+        if(m.isWin())
+            continue;
+        parents.push_back(positions[i]);
+        moves.push_back(m);
+    }
+}
+
+static void benchNetwork(const NnueNetwork &net, const std::vector<GameState> &positions, int rounds)
+{
+    std::vector<GameState> parents;
+    std::vector<Move> moves;
+    randomMoves(positions, parents, moves);
+    int count = (int)parents.size();
+    std::vector<NnueAccumulator> accs(count);
+    std::vector<int> scores(count);
+    for(int i = 0; i < count; i++)
+        net.refresh(parents[i], accs[i]);
+
+    int64_t start = nowMs();
+    long long checksum = 0;
+    for(int r = 0; r < rounds; r++)
+        for(int i = 0; i < count; i++) {
+            NnueAccumulator child;
+            net.update(accs[i], parents[i], moves[i], child);
+            scores[i] = net.evaluate(child, parents[i].toMove ^ 1);
+            checksum += scores[i];
+        }
+    int64_t elapsed = nowMs() - start;
+
+    int mismatches = 0;
+    for(int i = 0; i < count; i++) {
+        GameState child = parents[i];
+        child.apply(moves[i]);
+        mismatches += (net.evaluate(child) != scores[i]);
+    }
+    double rate = elapsed ? (double)count * rounds * 1000.0 / elapsed : 0.0;
+    printf("%-10s %14.0f positions/s   (checksum %lld), %d mismatches\n", "nnue", rate, checksum, mismatches);
+}
+
+int main(int argc, char **argv)
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 100000;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 50;
+
+    std::vector<GameState> positions;
+    randomPositions(positions, count);
+    std::vector<int> reference(count), scores(count);
+
+    int64_t start = nowMs();
+    long long checksum = 0;
+    for(int r = 0; r < rounds; r++)
+        for(int i = 0; i < count; i++) {
+            reference[i] = evaluate(positions[i]);
+            checksum += reference[i];
+        }
+    int64_t elapsed = nowMs() - start;
+    double baseline = elapsed ? (double)count * rounds * 1000.0 / elapsed : 0.0;
+    printf("%-10s %14.0f positions/s   (checksum %lld)\n", "evaluate", baseline, checksum);
+
+    for(int k = EVAL_KERNEL_SCALAR; k <= bestEvalKernel(); k++) {
+        EvalKernel kernel = (EvalKernel)k;
+        start = nowMs();
+        for(int r = 0; r < rounds; r++)
+            for(int i = 0; i < count; i += BATCH_SIZE) {
+                int n = (count - i < BATCH_SIZE) ? count - i : BATCH_SIZE;
+                evaluateBatch(&positions[i], n, &scores[i], kernel);
+            }
+        elapsed = nowMs() - start;
+
+        int mismatches = 0;
+        for(int i = 0; i < count; i++)
+            mismatches += (scores[i] != reference[i]);
+
+        double rate = elapsed ? (double)count * rounds * 1000.0 / elapsed : 0.0;
+        printf("%-10s %14.0f positions/s   %.2fx, %d mismatches\n",
+               evalKernelName(kernel), rate, baseline ? rate / baseline : 0.0, mismatches);
+    }
+
+    if(argc > 3) {
+        static NnueNetwork net;
+        if(net.load(argv[3]))
+            return 1;
+        benchNetwork(net, positions, rounds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+// Benchmark for 3 and 4 player search: raw speed of each algorithm and how
+// well each one plays against the others in self-play.
+//
+//   bench_multiplayer [games] [moveTimeMs]
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<iostream>
+
+#include"game_state.h"
+#include"multi_search.h"
+#include"transposition.h"
+
+#define NUM_ALGORITHMS 3
+#define MAX_GAME_PLIES 200
+#define OPENING_PLIES 2
+
+static uint64_t g_rng = 0x2545F4914F6CDD1DULL;
+
+static uint32_t randomNumber(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 32);
+}
+
+// A few random turns so the self-play games don't all repeat
+static void randomOpening(GameState &state)
+{
+    for(int i = 0; i < OPENING_PLIES * state.numPlayers; i++) {
+        MoveList moves;
+        state.generateMoves(moves);
+        int nonWinning = 0;
+        for(int j = 0; j < moves.count; j++)
+            if(!moves.moves[j].isWin())
+                moves.moves[nonWinning++] = moves.moves[j];
+        if(!nonWinning)
+            return;
+        state.apply(moves.moves[randomNumber() % nonWinning]);
+    }
+}
+
+struct AlgorithmStats
+{
+    uint64_t nodes;
+    int64_t timeMs;
+    uint64_t searches;
+    uint64_t depthSum;
+    int wins;
+    int games;
+};
+
+// Plays one game with seat p using algorithm seats[p]; returns the winner or NO_PLAYER
+static uint8_t playGame(uint8_t numPlayers, const MultiAlgorithm *seats, int64_t moveTimeMs,
+                        TranspositionTable &tt, AlgorithmStats *stats)
+{
+    GameState state;
+    state.reset(numPlayers);
+    randomOpening(state);
+
+    MultiSearch search(tt);
+    for(int ply = 0; ply < MAX_GAME_PLIES && !state.isOver(); ply++) {
+        if(!state.hasMoves()) {
+            state.eliminate();
+            continue;
+        }
+        MultiAlgorithm algo = seats[state.toMove];
+        search.setAlgorithm(algo);
+        SearchResult r = search.think(state, SearchLimits::timed(moveTimeMs));
+
+        stats[algo].nodes += r.nodes;
+        stats[algo].timeMs += r.timeMs;
+        stats[algo].searches++;
+        stats[algo].depthSum += r.depth;
+        state.apply(r.best);
+    }
+    return state.winner;
+}
+
+int main(int argc, char **argv)
+{
+    int games = (argc > 1) ? atoi(argv[1]) : 12;
+    int64_t moveTimeMs = (argc > 2) ? atoi(argv[2]) : 50;
+
+    TranspositionTable tt(64);
+
+    for(uint8_t numPlayers = 3; numPlayers <= 4; numPlayers++) {
+        AlgorithmStats stats[NUM_ALGORITHMS] = {};
+        int draws = 0;
+
+        for(int g = 0; g < games; g++) {
+            // Rotate algorithms through the seats so no one keeps the first move
+            MultiAlgorithm seats[MAX_PLAYERS];
+            for(int p = 0; p < numPlayers; p++) {
+                seats[p] = (MultiAlgorithm)((p + g) % NUM_ALGORITHMS);
+                stats[seats[p]].games++;
+            }
+
+            tt.clear();
+            uint8_t winner = playGame(numPlayers, seats, moveTimeMs, tt, stats);
+            if(winner == NO_PLAYER)
+                draws++;
+            else
+                stats[seats[winner]].wins++;
+        }
+
+        printf("%d players, %d games, %d ms per move, %d unfinished\n",
+               numPlayers, games, (int)moveTimeMs, draws);
+        printf("  %-12s %12s %10s %10s %10s\n", "algorithm", "nodes/s", "avg depth", "seats", "win %");
+        for(int a = 0; a < NUM_ALGORITHMS; a++) {
+            AlgorithmStats &s = stats[a];
+            double nps = s.timeMs ? 1000.0 * s.nodes / s.timeMs : 0.0;
+            double depth = s.searches ? (double)s.depthSum / s.searches : 0.0;
+            double winRate = s.games ? 100.0 * s.wins / s.games : 0.0;
+            printf("  %-12s %12.0f %10.2f %10d %9.1f%%\n",
+                   multiAlgorithmName((MultiAlgorithm)a), nps, depth, s.games, winRate);
+        }
+    }
+
+    return 0;
+}
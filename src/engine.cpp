@@ -0,0 +1,387 @@
+// Headless engine speaking a line based protocol on stdin/stdout, for match
+// runners that drive several engine processes at once. Commands:
+//
+//   sep                         identify; answered with id/option lines and "sepok"
+//   isready                     answered with "readyok"
+//   setoption name <Hash|Algorithm|Network> value <v>
+//   newgame [players N]         clear the hash table, start position for N players
+//   position startpos [players N] [moves m1 m2 ...]
+//   position text <position> [moves m1 m2 ...]
+//   go [depth D] [movetime T] [time1..time4 T] [inc1..inc4 T] [movestogo N] [infinite]
+//   stop                        end the search; its best move is still reported
+//   d                           print the current position
+//   quit
+//
+// Positions use notation.h and moves are "b2-c3,b4" or "b2-c3#". A search
+// answers with one line per finished iteration,
+//
+//   info depth D score S nodes N nps N time MS cpu MS pv m1 m2 ...
+//
+// then "bestmove m" ("bestmove none" if the side to move is stuck). `cpu` is
+// the process CPU time spent on this search, so runners can compare
+// builds per CPU-second rather than per wall-clock second. Searches always
+// end on their own once the result is proven, even with `infinite`.
+//
+// A go that is not infinite and has neither a movetime nor time left on the
+// side to move's clock searches MIN_MOVE_TIME_MS, unless it only sets a
+// depth. A go with an argument it does not know is refused.
+
+#include<stdarg.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<memory>
+#include<mutex>
+#include<thread>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+#include"search.h"
+#include"multi_search.h"
+#include"nnue.h"
+#include"transposition.h"
+
+#define ENGINE_NAME     "santorini"
+#define LINE_MAX_LENGTH 65536
+#define TIME_MARGIN_MS  20      // kept back from the clock for process and pipe overhead
+#define DEFAULT_MOVES_TO_GO 30
+#define MIN_MOVE_TIME_MS 10     // when the side to move has no clock or no time left
+
+static std::mutex g_outputLock;
+
+static void send(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+static void send(const char *format, ...)
+{
+    std::lock_guard<std::mutex> guard(g_outputLock);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    putchar('\n');
+    fflush(stdout);
+}
+
+static int64_t cpuMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct GoLimits
+{
+    int depth;
+    int64_t moveTime;
+    int64_t time[MAX_PLAYERS];
+    int64_t inc[MAX_PLAYERS];
+    int movesToGo;
+    bool clock;         // some time1..time4 was given
+    bool infinite;
+};
+
+class Engine
+{
+    std::unique_ptr<TranspositionTable> tt;
+    std::unique_ptr<Search> search;
+    std::unique_ptr<MultiSearch> multi;
+    std::unique_ptr<NnueNetwork> network;
+    MultiAlgorithm algorithm;
+    int hashMB;
+
+    GameState position;
+    std::thread worker;
+
+public:
+    Engine() : algorithm(MULTI_PARANOID), hashMB(TT_DEFAULT_MB) {
+        createTables();
+        position.reset(2);
+    }
+
+    ~Engine() {
+        stop();
+    }
+
+    void identify(void) {
+        send("id name " ENGINE_NAME);
+        send("option name Hash type spin default %d min 1 max 65536", TT_DEFAULT_MB);
+        send("option name Algorithm type combo default paranoid var maxn var paranoid var brs");
+        send("option name Network type string default <empty>");
+        send("sepok");
+    }
+
+    void setOption(const char *name, const char *value) {
+        stop();
+        if(!strcmp(name, "Hash")) {
+            int mb = atoi(value);
+            if(mb < 1) {
+                send("info string bad Hash value %s", value);
+                return;
+            }
+            hashMB = mb;
+            createTables();
+        }
+        else if(!strcmp(name, "Algorithm")) {
+            if(!strcmp(value, "maxn")) algorithm = MULTI_MAXN;
+            else if(!strcmp(value, "paranoid")) algorithm = MULTI_PARANOID;
+            else if(!strcmp(value, "brs")) algorithm = MULTI_BRS;
+            else {
+                send("info string unknown Algorithm %s", value);
+                return;
+            }
+            multi->setAlgorithm(algorithm);
+        }
+        else if(!strcmp(name, "Network")) {
+            if(!*value || !strcmp(value, "<empty>")) {
+                network.reset();
+                search->setNetwork(NULL);
+                return;
+            }
+            std::unique_ptr<NnueNetwork> net(new NnueNetwork());
+            if(net->load(value)) {
+                send("info string failed to load network %s", value);
+                return;
+            }
+            network = std::move(net);
+            search->setNetwork(network.get());
+        }
+        else
+            send("info string unknown option %s", name);
+    }
+
+    void newGame(int players) {
+        stop();
+        tt->clear();
+        position.reset(players);
+    }
+
+    // `text` is everything after "position"
+    void setPosition(const char *text) {
+        stop();
+        GameState state;
+        const char *p = skipSpaces(text);
+        if(!strncmp(p, "startpos", 8)) {
+            p = skipSpaces(p + 8);
+            int players = 2;
+            if(!strncmp(p, "players", 7)) {
+                players = (int)strtol(p + 7, (char **)&p, 10);
+                if(players < 2 || players > MAX_PLAYERS) {
+                    send("info string bad player count");
+                    return;
+                }
+            }
+            state.reset(players);
+        }
+        else if(!strncmp(p, "text", 4)) {
+            if(parsePosition(p + 4, state, &p)) {
+                send("info string bad position");
+                return;
+            }
+        }
+        else {
+            send("info string expected startpos or text");
+            return;
+        }
+
+        p = skipSpaces(p);
+        if(!strncmp(p, "moves", 5)) {
+            p = skipSpaces(p + 5);
+            while(*p) {
+                GameRecord::skipStuckPlayers(state);
+                Move m;
+                if(state.isOver() || parseMove(state, p, m, &p)) {
+                    send("info string illegal move %.12s", p);
+                    return;
+                }
+                state.apply(m);
+                p = skipSpaces(p);
+            }
+        }
+        GameRecord::skipStuckPlayers(state);
+        position = state;
+    }
+
+    void go(const GoLimits &go) {
+        stop();
+        SearchLimits limits = SearchLimits::infinite();
+        if(go.depth > 0)
+            limits.depth = go.depth;
+        // A depth on its own ends the search; anything else gets a time limit
+        if(!go.infinite && (go.moveTime > 0 || go.clock || go.depth <= 0))
+            limits.timeMs = allocateTime(go, position.toMove);
+
+        search->resetStop();
+        multi->resetStop();
+        worker = std::thread(&Engine::run, this, position, limits);
+    }
+
+    // Ends a running search and waits for its bestmove line
+    void stop(void) {
+        if(!worker.joinable())
+            return;
+        search->stop();
+        multi->stop();
+        worker.join();
+    }
+
+    void print(void) {
+        char text[POSITION_TEXT_MAX];
+        formatPosition(position, text, sizeof(text));
+        send("position %s", text);
+    }
+
+    static const char *skipSpaces(const char *p) {
+        while(*p == ' ' || *p == '\t')
+            p++;
+        return p;
+    }
+
+private:
+    void createTables(void) {
+        multi.reset();
+        search.reset();
+        tt.reset(new TranspositionTable(hashMB));
+        search.reset(new Search(*tt));
+        multi.reset(new MultiSearch(*tt, algorithm));
+        search->setNetwork(network.get());
+    }
+
+    // Think time for one move: an even share of the clock plus most of the
+    // increment, never running the clock below the safety margin, and never
+    // no limit at all
+    static int64_t allocateTime(const GoLimits &go, int player) {
+        if(go.moveTime > 0)
+            return go.moveTime;
+        int64_t left = go.time[player];
+        if(left <= 0) {
+            send("info string no time for player %d, searching %d ms", player + 1, MIN_MOVE_TIME_MS);
+            return MIN_MOVE_TIME_MS;
+        }
+        int64_t share = left / (go.movesToGo > 0 ? go.movesToGo : DEFAULT_MOVES_TO_GO) + go.inc[player] * 3 / 4;
+        int64_t most = left - TIME_MARGIN_MS;
+        if(share > most)
+            share = most;
+        return share > 1 ? share : 1;
+    }
+
+    static void sendInfo(const SearchResult &r, int64_t cpu) {
+        char pv[MAX_PLY * 9 + 1];
+        char *p = pv;
+        for(int i = 0; i < r.pvLength; i++) {
+            *p++ = ' ';
+            p = moveName(r.pv[i], p);
+        }
+        *p = 0;
+        send("info depth %d score %d nodes %llu nps %llu time %lld cpu %lld pv%s", r.depth, r.score,
+             (unsigned long long)r.nodes, (unsigned long long)(r.timeMs ? r.nodes * 1000 / r.timeMs : r.nodes),
+             (long long)r.timeMs, (long long)cpu, pv);
+    }
+
+    void run(GameState state, SearchLimits limits) {
+        int64_t cpuStart = cpuMs();
+        SearchCallback onIteration = [cpuStart](const SearchResult &r) {
+            sendInfo(r, cpuMs() - cpuStart);
+        };
+        SearchResult r = (state.numPlayers == 2) ? search->think(state, limits, onIteration)
+                                                 : multi->think(state, limits, onIteration);
+        if(r.best.isNull()) {
+            send("bestmove none");
+            return;
+        }
+        char move[16];
+        *moveName(r.best, move) = 0;
+        send("bestmove %s", move);
+    }
+};
+
+// Reads "go" arguments; -1 after reporting the first one it does not know
+static int parseGo(char *args, GoLimits &go)
+{
+    memset(&go, 0, sizeof(go));
+    char *save = NULL;
+    for(char *word = strtok_r(args, " \t", &save); word; word = strtok_r(NULL, " \t", &save)) {
+        if(!strcmp(word, "infinite")) {
+            go.infinite = true;
+            continue;
+        }
+        char *value = strtok_r(NULL, " \t", &save);
+        char *end = NULL;
+        long long v = value ? strtoll(value, &end, 10) : 0;
+        if(!value || *end) {
+            send("info string go %s needs a number", word);
+            return -1;
+        }
+        if(!strcmp(word, "depth")) go.depth = (int)v;
+        else if(!strcmp(word, "movetime")) go.moveTime = v;
+        else if(!strcmp(word, "movestogo")) go.movesToGo = (int)v;
+        else if(!strncmp(word, "time", 4) && word[4] >= '1' && word[4] < '1' + MAX_PLAYERS && !word[5]) {
+            go.time[word[4] - '1'] = v;
+            go.clock = true;
+        }
+        else if(!strncmp(word, "inc", 3) && word[3] >= '1' && word[3] < '1' + MAX_PLAYERS && !word[4])
+            go.inc[word[3] - '1'] = v;
+        else {
+            send("info string unknown go argument %s", word);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static char line[LINE_MAX_LENGTH];
+    Engine engine;
+
+    while(fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = 0;
+        char *p = (char *)Engine::skipSpaces(line);
+        char *args = p + strcspn(p, " \t");
+        if(*args)
+            *args++ = 0;
+
+        if(!strcmp(p, "sep"))
+            engine.identify();
+        else if(!strcmp(p, "isready"))
+            send("readyok");
+        else if(!strcmp(p, "setoption")) {
+            // setoption name <name> value <value>
+            char *name = strstr(args, "name ");
+            char *value = strstr(args, " value ");
+            if(!name || !value) {
+                send("info string expected setoption name <name> value <value>");
+                continue;
+            }
+            *value = 0;
+            engine.setOption(Engine::skipSpaces(name + 5), Engine::skipSpaces(value + 7));
+        }
+        else if(!strcmp(p, "newgame")) {
+            int players = 2;
+            if(!strncmp(Engine::skipSpaces(args), "players", 7))
+                players = atoi(Engine::skipSpaces(args) + 7);
+            if(players < 2 || players > MAX_PLAYERS)
+                send("info string bad player count");
+            else
+                engine.newGame(players);
+        }
+        else if(!strcmp(p, "position"))
+            engine.setPosition(args);
+        else if(!strcmp(p, "go")) {
+            GoLimits go;
+            if(!parseGo(args, go))
+                engine.go(go);
+        }
+        else if(!strcmp(p, "stop"))
+            engine.stop();
+        else if(!strcmp(p, "d"))
+            engine.print();
+        else if(!strcmp(p, "quit"))
+            break;
+        else if(*p)
+            send("info string unknown command %s", p);
+    }
+    engine.stop();
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Position database: builds a column store from game record files and runs
+// bitboard queries over it (see db_query.h for the query language).
+//
+//   santorini_db build <dir> <records>...
+//   santorini_db query <dir> <query | preset> [--limit N] [--export file] [--threads N]
+//   santorini_db presets
+//   santorini_db check <dir>     build a small database in <dir> and check
+//                                the presets against it
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<string>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"game_db.h"
+#include"db_query.h"
+#include"notation.h"
+#include"search.h"
+#include"thread_pool.h"
+
+// WIN: empty level 3 squares the side to move can step up onto, winning now.
+// THREAT: the same for the other workers, the squares they win on next turn.
+// REACH: squares the side to move can step to (ignoring climb limits), so
+// adj(REACH) is everywhere it could build a dome this turn.
+#define WIN    "(adj(mover & L2) & L3 & ~occ)"
+#define THREAT "(adj(opp & L2) & L3 & ~occ)"
+#define REACH  "(adj(mover) & empty)"
+
+struct Preset
+{
+    const char *name;
+    const char *description;
+    const char *query;
+};
+
+static const Preset g_presets[] = {
+    { "threat", "the side to move can step up onto level 3 and win",
+      "any" WIN },
+    { "unstoppable", "the other side threatens a level 3 square the side to move cannot dome, or two",
+      "any(" THREAT " & ~adj(" REACH ")) or count" THREAT " >= 2" },
+    { "double-threat", "the other side threatens two or more level 3 squares",
+      "count" THREAT " >= 2" },
+    { "trapped", "a side to move worker with no empty square next to it",
+      "any(mover & ~adj(empty)) and count(mover) == 2" },
+    { "domes", "four or more domes on the board",
+      "count(L4) >= 4" }
+};
+
+static const int g_numPresets = sizeof(g_presets) / sizeof(g_presets[0]);
+
+static int build(const char *dir, int count, char **paths)
+{
+    GameDbWriter writer;
+    if(writer.create(dir))
+        return 1;
+
+    static GameRecord record;
+    int64_t start = nowMs();
+    for(int i = 0; i < count; i++) {
+        FILE *f = fopen(paths[i], "rb");
+        if(!f || GameRecord::readFileHeader(f)) {
+            printf("Skipping %s: not a game record file\n", paths[i]);
+            if(f)
+                fclose(f);
+            continue;
+        }
+        int status;
+        while((status = record.read(f)) == 1)
+            if(writer.addGame(record)) {
+                printf("Failed to write to %s\n", dir);
+                fclose(f);
+                return 1;
+            }
+        if(status < 0)
+            printf("%s: stopped at a damaged game\n", paths[i]);
+        fclose(f);
+    }
+    uint64_t rows = writer.rowCount();
+    uint32_t games = writer.gameCount();
+    if(writer.close()) {
+        printf("Failed to finish %s\n", dir);
+        return 1;
+    }
+    printf("%s: %u games, %llu positions in %.1f s\n", dir, games, (unsigned long long)rows,
+           (nowMs() - start) / 1000.0);
+    return 0;
+}
+
+// One line per position: game, ply and the position in notation.h form
+static void exportPosition(FILE *f, const GameDb &db, uint64_t row)
+{
+    char text[POSITION_TEXT_MAX];
+    formatPosition(db.position(row), text, sizeof(text));
+    fprintf(f, "%u %u %s\n", (unsigned)db.value(DB_GAME, row), (unsigned)db.value(DB_PLY, row), text);
+}
+
+static int query(const char *dir, const char *text, int argc, char **argv)
+{
+    uint64_t limit = 10;
+    const char *exportPath = NULL;
+    int threads = 0;
+    for(int i = 0; i + 1 < argc; i += 2) {
+        if(!strcmp(argv[i], "--limit")) limit = strtoull(argv[i + 1], NULL, 10);
+        else if(!strcmp(argv[i], "--export")) exportPath = argv[i + 1];
+        else if(!strcmp(argv[i], "--threads")) threads = atoi(argv[i + 1]);
+        else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    for(int i = 0; i < g_numPresets; i++)
+        if(!strcmp(text, g_presets[i].name))
+            text = g_presets[i].query;
+
+    DbQuery q;
+    if(q.compile(text)) {
+        printf("Bad query: %s\n", q.errorText().c_str());
+        return 1;
+    }
+    GameDb db;
+    if(db.open(dir))
+        return 1;
+
+    ThreadPool pool(threads);
+    std::vector<uint64_t> matches;
+    int64_t start = nowMs();
+    uint64_t count = q.run(db, pool, &matches, exportPath ? ~0ull : limit);
+    int64_t elapsed = nowMs() - start;
+
+    printf("%llu of %llu positions match (%u games), %lld ms, %.0f M positions/s on %d threads\n",
+           (unsigned long long)count, (unsigned long long)db.rowCount(), db.gameCount(), (long long)elapsed,
+           elapsed ? db.rowCount() / 1000.0 / elapsed : 0.0, pool.size());
+
+    FILE *out = stdout;
+    if(exportPath && !(out = fopen(exportPath, "w"))) {
+        printf("Failed to create %s\n", exportPath);
+        return 1;
+    }
+    for(size_t i = 0; i < matches.size(); i++)
+        exportPosition(out, db, matches[i]);
+    if(out != stdout) {
+        fclose(out);
+        printf("%llu positions written to %s\n", (unsigned long long)matches.size(), exportPath);
+    }
+    return 0;
+}
+
+// Positions with the presets they must match, and must only match
+static const struct { const char *position; const char *presets; } g_checks[] = {
+    // Player 2 threatens d3; e1 can step to d2 and dome it
+    { "00000/00000/00230/00000/00000 e1a5/c3a1 1 -", "" },
+    // The same threat with player 1 out of reach
+    { "00000/00000/00230/00000/00000 a5a4/c3e1 1 -", "unstoppable" },
+    // Two threats, b3 and d3; either one can be domed, not both
+    { "00000/00000/03230/00000/00000 e1a1/c3e5 1 -", "unstoppable double-threat" },
+    // Player 1 wins on d3 now, which is no threat to it
+    { "00000/00000/00230/00000/00000 c3e5/a1a5 1 -", "threat" },
+    // The worker on a1 is walled in by domes
+    { "00000/00000/00000/DD000/0D000 a1e5/c3e1 1 -", "trapped" },
+};
+
+// Builds a database of g_checks in `dir` and runs every preset over it
+static int check(const char *dir)
+{
+    const int count = sizeof(g_checks) / sizeof(g_checks[0]);
+    GameDbWriter writer;
+    if(writer.create(dir))
+        return 1;
+    for(int i = 0; i < count; i++) {
+        GameState state;
+        if(parsePosition(g_checks[i].position, state) || writer.addPosition(state, i, 0)) {
+            printf("Failed to add %s\n", g_checks[i].position);
+            return 1;
+        }
+    }
+    GameDb db;
+    if(writer.close() || db.open(dir))
+        return 1;
+
+    ThreadPool pool(1);
+    int failed = 0;
+    for(int p = 0; p < g_numPresets; p++) {
+        DbQuery q;
+        if(q.compile(g_presets[p].query)) {
+            printf("%s: %s\n", g_presets[p].name, q.errorText().c_str());
+            failed++;
+            continue;
+        }
+        std::vector<uint64_t> matches;
+        q.run(db, pool, &matches, count);
+        size_t next = 0;
+        for(int i = 0; i < count; i++) {
+            bool matched = next < matches.size() && matches[next] == (uint64_t)i;
+            if(matched)
+                next++;
+            std::string expected = std::string(" ") + g_checks[i].presets + " ";
+            if(matched != (expected.find(std::string(" ") + g_presets[p].name + " ") != std::string::npos)) {
+                printf("%s %s %s\n", g_presets[p].name, matched ? "matches" : "misses", g_checks[i].position);
+                failed++;
+            }
+        }
+    }
+    printf("%d positions, %d presets, %d failures\n", count, g_numPresets, failed);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc >= 4 && !strcmp(argv[1], "build"))
+        return build(argv[2], argc - 3, argv + 3);
+    if(argc >= 4 && !strcmp(argv[1], "query"))
+        return query(argv[2], argv[3], argc - 4, argv + 4);
+    if(argc == 3 && !strcmp(argv[1], "check"))
+        return check(argv[2]);
+    if(argc == 2 && !strcmp(argv[1], "presets")) {
+        for(int i = 0; i < g_numPresets; i++)
+            printf("%-14s %s\n%14s %s\n", g_presets[i].name, g_presets[i].description, "", g_presets[i].query);
+        return 0;
+    }
+
+    printf("usage: santorini_db build <dir> <records>...\n"
+           "       santorini_db query <dir> <query | preset> [--limit N] [--export file] [--threads N]\n"
+           "       santorini_db presets\n"
+           "       santorini_db check <dir>\n");
+    return 1;
+}
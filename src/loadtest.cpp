@@ -0,0 +1,334 @@
+// Load generator for santorini_server: opens two connections per game,
+// pairs them with create/join and plays random legal moves as fast as the
+// server answers, starting a new game whenever one ends. Everything runs on
+// one epoll loop, so a single process can hold tens of thousands of games.
+//
+//   santorini_loadtest [--connect host:port | unix:/path] [--games N]
+//                      [--spectators N] [--slow-spectators N]
+//                      [--seconds T] [--seed N]
+//
+// Spectators watch every game and check each move they are sent; slow
+// spectators watch but never read, to load the server's backpressure path.
+// A move's latency is the round trip from sending "move" to reading the
+// server's "move" echo for it.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<time.h>
+#include<sys/epoll.h>
+#include<algorithm>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+#include"net.h"
+
+#define DEFAULT_CONNECT "127.0.0.1:7878"
+#define MAX_EVENTS      256
+#define MAX_SAMPLES     (1 << 22)   // latency samples kept; later ones replace random earlier ones
+
+static volatile sig_atomic_t g_interrupted = 0;
+
+static void onSignal(int)
+{
+    g_interrupted = 1;
+}
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t splitMix(uint64_t &x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+enum Role
+{
+    ROLE_CREATOR,           // seat 1, opens each game
+    ROLE_JOINER,            // seat 2
+    ROLE_SPECTATOR,
+    ROLE_SLOW_SPECTATOR     // never reads
+};
+
+// One simulated connection. Connections come in blocks, one per game: the
+// creator first, then the joiner, then the spectators.
+struct Player
+{
+    LineConnection conn;
+    Role role;
+    uint8_t seat;
+    GameState state;
+    bool playing;
+    int64_t sentAt;         // when our last move went out, 0 if none is pending
+    bool dirty;
+    bool watchingOutput;
+};
+
+struct LoadStats
+{
+    int64_t moves;
+    int64_t games;
+    int64_t errors;
+    int64_t watchedMoves;
+    int64_t snapshots;
+    int64_t samplesSeen;
+    std::vector<uint32_t> latencyUs;
+};
+
+class LoadTest
+{
+    int epfd;
+    std::vector<Player> players;
+    std::vector<int> byFd;
+    std::vector<int> dirty;
+    int blockSize;
+    uint64_t rng;
+
+public:
+    LoadStats stats;
+
+    LoadTest(uint64_t seed) : epfd(-1), blockSize(2), rng(seed) {
+        stats.moves = stats.games = stats.errors = stats.watchedMoves = stats.snapshots = stats.samplesSeen = 0;
+    }
+
+    int start(const char *address, int games, int spectators, int slowSpectators) {
+        epfd = epoll_create1(0);
+        if(epfd < 0) {
+            printf("Failed to create an epoll instance: %s\n", strerror(errno));
+            return -1;
+        }
+        blockSize = 2 + spectators + slowSpectators;
+        players.resize(games * blockSize);
+        for(int i = 0; i < (int)players.size(); i++) {
+            int fd = connectTo(address);
+            if(fd < 0)
+                return -1;
+            Player &p = players[i];
+            int slot = i % blockSize;
+            p.conn.fd = fd;
+            p.role = (slot == 0) ? ROLE_CREATOR : (slot == 1) ? ROLE_JOINER
+                   : (slot < 2 + spectators) ? ROLE_SPECTATOR : ROLE_SLOW_SPECTATOR;
+            p.seat = (slot == 1) ? 1 : 0;
+            p.playing = false;
+            p.sentAt = 0;
+            p.dirty = false;
+            p.watchingOutput = false;
+            if(fd >= (int)byFd.size())
+                byFd.resize(fd + 1, -1);
+            byFd[fd] = i;
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if(p.role != ROLE_SLOW_SPECTATOR)
+                epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+            if(p.role == ROLE_CREATOR)
+                send(i, "create");
+        }
+        flushDirty();
+        return 0;
+    }
+
+    // Returns -1 if a connection was lost
+    int poll(int timeoutMs) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeoutMs);
+        for(int i = 0; i < n; i++) {
+            int index = byFd[events[i].data.fd];
+            if(events[i].events & EPOLLOUT)
+                markDirty(index);
+            if(players[index].conn.receive([this, index](char *line, size_t) { handle(index, line); })) {
+                printf("Server closed connection %d\n", index);
+                return -1;
+            }
+        }
+        return flushDirty();
+    }
+
+private:
+    void markDirty(int index) {
+        if(!players[index].dirty) {
+            players[index].dirty = true;
+            dirty.push_back(index);
+        }
+    }
+
+    void send(int index, const char *line) {
+        players[index].conn.queueLine(line);
+        markDirty(index);
+    }
+
+    int flushDirty(void) {
+        for(size_t i = 0; i < dirty.size(); i++) {
+            Player &p = players[dirty[i]];
+            p.dirty = false;
+            int status = p.conn.flush();
+            if(status < 0)
+                return -1;
+            if(p.watchingOutput != (status > 0) && p.role != ROLE_SLOW_SPECTATOR) {
+                p.watchingOutput = status > 0;
+                struct epoll_event ev;
+                ev.events = p.watchingOutput ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+                ev.data.fd = p.conn.fd;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, p.conn.fd, &ev);
+            }
+        }
+        dirty.clear();
+        return 0;
+    }
+
+    void sample(int64_t ns) {
+        uint32_t us = (uint32_t)(ns / 1000);
+        stats.samplesSeen++;
+        if(stats.latencyUs.size() < MAX_SAMPLES)
+            stats.latencyUs.push_back(us);
+        else {
+            uint64_t slot = splitMix(rng) % stats.samplesSeen;
+            if(slot < MAX_SAMPLES)
+                stats.latencyUs[slot] = us;
+        }
+    }
+
+    void playIfToMove(int index) {
+        Player &p = players[index];
+        if(p.role == ROLE_SPECTATOR || !p.playing || p.state.isOver() || p.state.toMove != p.seat)
+            return;
+        MoveList list;
+        p.state.generateMoves(list);
+        char line[24] = "move ";
+        *moveName(list.moves[splitMix(rng) % list.count], line + 5) = 0;
+        p.sentAt = nowNs();
+        send(index, line);
+    }
+
+    void handle(int index, char *line) {
+        Player &p = players[index];
+        if(!strncmp(line, "move ", 5)) {
+            int seat = line[5] - '1';
+            Move m;
+            if(parseMove(p.state, line + 7, m)) {
+                stats.errors++;
+                return;
+            }
+            p.state.apply(m);
+            GameRecord::skipStuckPlayers(p.state);
+            if(p.role == ROLE_SPECTATOR)
+                stats.watchedMoves++;
+            else if(seat == p.seat && p.sentAt) {
+                sample(nowNs() - p.sentAt);
+                p.sentAt = 0;
+                stats.moves++;
+            }
+            playIfToMove(index);
+        }
+        else if(!strncmp(line, "start ", 6)) {
+            p.state.reset(2);
+            p.playing = true;
+            playIfToMove(index);
+        }
+        else if(!strncmp(line, "game ", 5)) {
+            if(p.role == ROLE_CREATOR) {
+                // Spectators first, so they see the game start
+                unsigned long id = strtoul(line + 5, NULL, 10);
+                char command[32];
+                snprintf(command, sizeof(command), "watch %lu", id);
+                for(int i = index + 2; i < index + blockSize; i++)
+                    send(i, command);
+                snprintf(command, sizeof(command), "join %lu", id);
+                send(index + 1, command);
+            }
+        }
+        else if(!strncmp(line, "position ", 9)) {
+            if(parsePosition(line + 9, p.state))
+                stats.errors++;
+            stats.snapshots++;
+        }
+        else if(!strncmp(line, "over", 4)) {
+            p.playing = false;
+            if(p.role == ROLE_CREATOR) {
+                stats.games++;
+                send(index, "create");
+            }
+        }
+        else if(!strncmp(line, "error", 5))
+            stats.errors++;
+    }
+};
+
+static void printLatency(std::vector<uint32_t> &us)
+{
+    if(us.empty())
+        return;
+    std::sort(us.begin(), us.end());
+    const double points[] = { 0.5, 0.9, 0.99, 0.999 };
+    printf("move round trip (us):");
+    for(int i = 0; i < 4; i++)
+        printf("  p%g %u", points[i] * 100, us[(size_t)(points[i] * (us.size() - 1))]);
+    printf("  max %u\n", us.back());
+}
+
+int main(int argc, char **argv)
+{
+    const char *address = DEFAULT_CONNECT;
+    int games = 100;
+    int spectators = 0;
+    int slowSpectators = 0;
+    int seconds = 10;
+    uint64_t seed = (uint64_t)time(NULL);
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 >= argc) {
+            printf("Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i - 1], "--connect")) address = value;
+        else if(!strcmp(argv[i - 1], "--games")) games = atoi(value);
+        else if(!strcmp(argv[i - 1], "--spectators")) spectators = atoi(value);
+        else if(!strcmp(argv[i - 1], "--slow-spectators")) slowSpectators = atoi(value);
+        else if(!strcmp(argv[i - 1], "--seconds")) seconds = atoi(value);
+        else if(!strcmp(argv[i - 1], "--seed")) seed = strtoull(value, NULL, 10);
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+    if(games < 1) {
+        printf("Need at least one game\n");
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    raiseFileLimit();
+    LoadTest test(seed);
+    int64_t connectStart = nowNs();
+    if(test.start(address, games, spectators, slowSpectators))
+        return 1;
+    printf("%d games (%d connections) open in %.0f ms\n", games, games * (2 + spectators + slowSpectators),
+           (nowNs() - connectStart) / 1e6);
+
+    int64_t start = nowNs(), end = start + seconds * 1000000000LL;
+    int status = 0;
+    while(!g_interrupted && nowNs() < end)
+        if(test.poll(100)) {
+            status = 1;
+            break;
+        }
+    double elapsed = (nowNs() - start) / 1e9;
+    printf("%lld moves, %lld games in %.1f s: %.0f moves/s, %.0f games/s, %lld errors\n",
+           (long long)test.stats.moves, (long long)test.stats.games, elapsed, test.stats.moves / elapsed,
+           test.stats.games / elapsed, (long long)test.stats.errors);
+    if(spectators)
+        printf("spectators: %lld moves, %lld positions\n", (long long)test.stats.watchedMoves,
+               (long long)test.stats.snapshots);
+    printLatency(test.stats.latencyUs);
+    return status;
+}
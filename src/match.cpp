@@ -0,0 +1,614 @@
+// Match runner for two engines speaking the santorini_engine protocol. Each
+// pool thread owns one process per engine and plays opening pairs: every
+// opening is played twice with the engines swapping seats, so a lopsided
+// opening cancels out. Clocks are kept here, measured from sending "go" to
+// reading "bestmove"; running out, crashing or an illegal move loses.
+//
+// With --sprt the match stops as soon as a sequential probability ratio test
+// accepts either elo0 (no gain) or elo1 (gain). The test runs on pair
+// results (pentanomial), which have less variance than single games.
+//
+//   santorini_match --engine1 CMD --engine2 CMD [--pairs N] [--concurrency N]
+//                   [--tc BASE+INC | --movetime MS | --depth D] [--margin MS]
+//                   [--book file | --random-plies N] [--seed N] [--hash MB]
+//                   [--sprt ELO0 ELO1 [ALPHA BETA]]
+//
+// Times are in milliseconds. A book has one position per line in notation.h
+// form, as written by `santorini_records positions`; two player positions
+// only.
+
+#include<errno.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<poll.h>
+#include<signal.h>
+#include<time.h>
+#include<unistd.h>
+#include<sys/wait.h>
+#include<atomic>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+#include"search.h"
+#include"thread_pool.h"
+
+#define MATCH_MAX_PLIES   RECORD_MAX_PLIES
+#define READY_TIMEOUT_MS  10000     // untimed handshakes
+#define DRAIN_TIMEOUT_MS  1000      // waiting for "bestmove" after a timeout
+#define NO_TIMEOUT        -1
+
+struct Options
+{
+    const char *engines[2];
+    int64_t pairs;
+    int concurrency;
+    int64_t baseMs;
+    int64_t incMs;
+    int64_t moveTimeMs;
+    int depth;
+    int64_t marginMs;
+    const char *book;
+    int randomPlies;
+    uint64_t seed;
+    int hashMB;
+    bool sprt;
+    double elo0, elo1, alpha, beta;
+};
+
+static volatile sig_atomic_t g_interrupted = 0;
+
+static void onSignal(int)
+{
+    if(g_interrupted)
+        _exit(1);
+    g_interrupted = 1;
+}
+
+static uint64_t splitMix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// One engine child process, talked to over a pair of pipes
+class EngineProcess
+{
+    std::string command;
+    pid_t pid;
+    int toEngine;
+    int fromEngine;
+    std::string buffer;
+
+public:
+    EngineProcess() : pid(-1), toEngine(-1), fromEngine(-1) {}
+
+    ~EngineProcess() {
+        kill();
+    }
+
+    // Starts `cmd` through the shell and waits for the protocol handshake
+    int start(const char *cmd, int hashMB) {
+        kill();
+        command = cmd;
+        int in[2], out[2];
+        if(pipe(in))
+            return -1;
+        if(pipe(out)) {
+            close(in[0]);
+            close(in[1]);
+            return -1;
+        }
+        pid = fork();
+        if(pid < 0)
+            return -1;
+        if(!pid) {
+            dup2(in[0], 0);
+            dup2(out[1], 1);
+            close(in[0]); close(in[1]);
+            close(out[0]); close(out[1]);
+            std::string exec = "exec " + command;
+            execl("/bin/sh", "sh", "-c", exec.c_str(), (char *)NULL);
+            _exit(127);
+        }
+        close(in[0]);
+        close(out[1]);
+        toEngine = in[1];
+        fromEngine = out[0];
+        buffer.clear();
+
+        std::string line;
+        if(send("sep") || waitFor("sepok", READY_TIMEOUT_MS, line))
+            return -1;
+        if(hashMB > 0) {
+            char option[64];
+            snprintf(option, sizeof(option), "setoption name Hash value %d", hashMB);
+            if(send(option))
+                return -1;
+        }
+        return ready();
+    }
+
+    int restart(int hashMB) {
+        std::string cmd = command;
+        return start(cmd.c_str(), hashMB);
+    }
+
+    void kill(void) {
+        if(pid > 0) {
+            ::kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        if(toEngine >= 0)
+            close(toEngine);
+        if(fromEngine >= 0)
+            close(fromEngine);
+        pid = -1;
+        toEngine = fromEngine = -1;
+    }
+
+    int send(const char *text) {
+        std::string line = std::string(text) + "\n";
+        size_t done = 0;
+        while(done < line.size()) {
+            ssize_t n = write(toEngine, line.data() + done, line.size() - done);
+            if(n <= 0)
+                return -1;
+            done += n;
+        }
+        return 0;
+    }
+
+    int ready(void) {
+        std::string line;
+        if(send("isready"))
+            return -1;
+        return waitFor("readyok", READY_TIMEOUT_MS, line);
+    }
+
+    // Reads lines until one starts with `prefix`; 0 on success, 1 on timeout,
+    // -1 if the engine went away. `timeoutMs` < 0 waits forever.
+    int waitFor(const char *prefix, int64_t timeoutMs, std::string &line) {
+        int64_t deadline = timeoutMs < 0 ? NO_DEADLINE : nowMs() + timeoutMs;
+        size_t length = strlen(prefix);
+        for(;;) {
+            int status = readLine(deadline, line);
+            if(status)
+                return status;
+            if(!line.compare(0, length, prefix))
+                return 0;
+        }
+    }
+
+private:
+    int readLine(int64_t deadline, std::string &line) {
+        for(;;) {
+            size_t end = buffer.find('\n');
+            if(end != std::string::npos) {
+                line = buffer.substr(0, end);
+                buffer.erase(0, end + 1);
+                return 0;
+            }
+            int wait = -1;
+            if(deadline != NO_DEADLINE) {
+                int64_t left = deadline - nowMs();
+                if(left <= 0)
+                    return 1;
+                wait = (int)left;
+            }
+            struct pollfd p = { fromEngine, POLLIN, 0 };
+            int ready = poll(&p, 1, wait);
+            if(ready < 0 && errno != EINTR)
+                return -1;
+            if(ready <= 0)
+                continue;
+            char chunk[4096];
+            ssize_t n = read(fromEngine, chunk, sizeof(chunk));
+            if(n <= 0)
+                return -1;
+            buffer.append(chunk, n);
+        }
+    }
+};
+
+// How a game ended, for the summary
+enum GameEnd {
+    END_NORMAL = 0,
+    END_TIME,
+    END_ILLEGAL,
+    END_CRASH,
+    END_PLY_LIMIT,
+    END_TYPES
+};
+
+static const char *g_endNames[END_TYPES] = { "normal", "time", "illegal move", "crash", "ply limit" };
+
+// Plays `start` with seats[p] moving for player p; returns the winning
+// player, or NO_PLAYER if the game hit the ply limit
+static uint8_t playGame(EngineProcess *seats[2], const GameState &start, const Options &o, GameEnd &end)
+{
+    char startText[POSITION_TEXT_MAX];
+    formatPosition(start, startText, sizeof(startText));
+    for(int p = 0; p < 2; p++) {
+        if(seats[p]->send("newgame") || seats[p]->ready()) {
+            // Nothing has been played yet; the seat that is down forfeits
+            seats[p]->restart(o.hashMB);
+            end = END_CRASH;
+            return 1 - p;
+        }
+    }
+
+    std::string moves;
+    std::string command, line;
+    int64_t clocks[2] = { o.baseMs, o.baseMs };
+    GameState state = start;
+    end = END_NORMAL;
+    for(int plies = 0; ; plies++) {
+        GameRecord::skipStuckPlayers(state);
+        if(state.isOver())
+            return state.winner;
+        if(plies == MATCH_MAX_PLIES) {
+            end = END_PLY_LIMIT;
+            return NO_PLAYER;
+        }
+
+        int side = state.toMove;
+        EngineProcess &engine = *seats[side];
+        char go[128];
+        int64_t allowed = NO_TIMEOUT;
+        if(o.depth > 0)
+            snprintf(go, sizeof(go), "go depth %d", o.depth);
+        else if(o.moveTimeMs > 0) {
+            snprintf(go, sizeof(go), "go movetime %lld", (long long)o.moveTimeMs);
+            allowed = o.moveTimeMs + o.marginMs;
+        }
+        else {
+            snprintf(go, sizeof(go), "go time1 %lld time2 %lld inc1 %lld inc2 %lld", (long long)clocks[0],
+                     (long long)clocks[1], (long long)o.incMs, (long long)o.incMs);
+            allowed = clocks[side] + o.marginMs;
+        }
+
+        command = std::string("position text ") + startText + (moves.empty() ? "" : " moves" + moves);
+        int64_t sent = nowMs();
+        int status = (engine.send(command.c_str()) || engine.send(go)) ? -1
+                     : engine.waitFor("bestmove", allowed, line);
+        int64_t used = nowMs() - sent;
+
+        if(status) {
+            end = (status > 0) ? END_TIME : END_CRASH;
+            // A late engine gets the chance to answer, otherwise it is replaced
+            if(status > 0 && !engine.send("stop") && !engine.waitFor("bestmove", DRAIN_TIMEOUT_MS, line))
+                return 1 - side;
+            engine.restart(o.hashMB);
+            return 1 - side;
+        }
+        if(o.depth <= 0 && o.moveTimeMs <= 0) {
+            clocks[side] -= used;
+            if(clocks[side] < -o.marginMs) {
+                end = END_TIME;
+                return 1 - side;
+            }
+            if(clocks[side] < 0)
+                clocks[side] = 0;
+            clocks[side] += o.incMs;
+        }
+
+        Move m;
+        const char *text = line.c_str() + 8;
+        while(*text == ' ')
+            text++;
+        if(parseMove(state, text, m)) {
+            end = END_ILLEGAL;
+            return 1 - side;
+        }
+        state.apply(m);
+        moves += ' ';
+        moves += text;
+    }
+}
+
+// Shared results; pair scores are engine 1's points out of the two games
+struct MatchStats
+{
+    std::mutex lock;
+    int64_t wins, losses, draws;
+    int64_t pentanomial[5];
+    int64_t ends[END_TYPES];
+    int64_t pairs;
+
+    MatchStats() : wins(0), losses(0), draws(0), pairs(0) {
+        memset(pentanomial, 0, sizeof(pentanomial));
+        memset(ends, 0, sizeof(ends));
+    }
+};
+
+static double eloToScore(double elo)
+{
+    return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+static double scoreToElo(double score)
+{
+    if(score <= 0.0) return -1000.0;
+    if(score >= 1.0) return 1000.0;
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+// Mean and variance of the pair score (0 to 1 per pair). Every outcome gets
+// half a count of prior so a short one-sided run is not taken as certain.
+static void pairMoments(const int64_t pentanomial[5], double &pairs, double &mean, double &variance)
+{
+    double counts[5];
+    pairs = 0.0;
+    mean = 0.0;
+    for(int i = 0; i < 5; i++) {
+        counts[i] = pentanomial[i] + 0.5;
+        pairs += counts[i];
+        mean += counts[i] * (i / 4.0);
+    }
+    mean /= pairs;
+    variance = 0.0;
+    for(int i = 0; i < 5; i++)
+        variance += counts[i] * (i / 4.0 - mean) * (i / 4.0 - mean);
+    variance /= pairs;
+}
+
+// Log likelihood ratio of elo1 against elo0, normal approximation on pairs
+static double sprtLLR(const int64_t pentanomial[5], double elo0, double elo1)
+{
+    double pairs, mean, variance;
+    pairMoments(pentanomial, pairs, mean, variance);
+    double s0 = eloToScore(elo0), s1 = eloToScore(elo1);
+    return pairs * (s1 - s0) * (2.0 * mean - s0 - s1) / (2.0 * variance);
+}
+
+static void printStatus(const MatchStats &s, const Options &o, double &llr)
+{
+    double pairs, mean, variance;
+    pairMoments(s.pentanomial, pairs, mean, variance);
+    double margin = 1.96 * sqrt(variance / pairs);
+    double elo = scoreToElo(mean);
+    double spread = (scoreToElo(mean + margin) - scoreToElo(mean - margin)) / 2.0;
+    printf("Pairs %lld: +%lld -%lld =%lld  Elo %.1f +/- %.1f  [%lld %lld %lld %lld %lld]",
+           (long long)s.pairs, (long long)s.wins, (long long)s.losses, (long long)s.draws, elo, spread,
+           (long long)s.pentanomial[0], (long long)s.pentanomial[1], (long long)s.pentanomial[2],
+           (long long)s.pentanomial[3], (long long)s.pentanomial[4]);
+    llr = 0.0;
+    if(o.sprt) {
+        llr = sprtLLR(s.pentanomial, o.elo0, o.elo1);
+        printf("  LLR %.2f (%.2f, %.2f)", llr, log(o.beta / (1.0 - o.alpha)), log((1.0 - o.beta) / o.alpha));
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static int parseOptions(int argc, char **argv, Options &o)
+{
+    memset(&o, 0, sizeof(o));
+    o.pairs = 100;
+    o.baseMs = 10000;
+    o.incMs = 100;
+    o.marginMs = 10;
+    o.randomPlies = 4;
+    o.seed = (uint64_t)time(NULL);
+    o.alpha = o.beta = 0.05;
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(!value) {
+            printf("Missing value for %s\n", arg);
+            return -1;
+        }
+        i++;
+        if(!strcmp(arg, "--engine1")) o.engines[0] = value;
+        else if(!strcmp(arg, "--engine2")) o.engines[1] = value;
+        else if(!strcmp(arg, "--pairs")) o.pairs = atoll(value);
+        else if(!strcmp(arg, "--concurrency")) o.concurrency = atoi(value);
+        else if(!strcmp(arg, "--tc")) {
+            char *rest;
+            o.baseMs = strtoll(value, &rest, 10);
+            o.incMs = (*rest == '+') ? atoll(rest + 1) : 0;
+        }
+        else if(!strcmp(arg, "--movetime")) o.moveTimeMs = atoll(value);
+        else if(!strcmp(arg, "--depth")) o.depth = atoi(value);
+        else if(!strcmp(arg, "--margin")) o.marginMs = atoll(value);
+        else if(!strcmp(arg, "--book")) o.book = value;
+        else if(!strcmp(arg, "--random-plies")) o.randomPlies = atoi(value);
+        else if(!strcmp(arg, "--seed")) o.seed = strtoull(value, NULL, 10);
+        else if(!strcmp(arg, "--hash")) o.hashMB = atoi(value);
+        else if(!strcmp(arg, "--sprt")) {
+            if(i + 1 >= argc) {
+                printf("--sprt needs ELO0 and ELO1\n");
+                return -1;
+            }
+            o.sprt = true;
+            o.elo0 = atof(value);
+            o.elo1 = atof(argv[++i]);
+            if(i + 2 < argc && argv[i + 1][0] != '-') {
+                o.alpha = atof(argv[++i]);
+                o.beta = atof(argv[++i]);
+            }
+        }
+        else {
+            printf("Unknown option %s\n", arg);
+            return -1;
+        }
+    }
+    if(!o.engines[0] || !o.engines[1]) {
+        printf("Need --engine1 and --engine2\n");
+        return -1;
+    }
+    if(o.sprt && (o.elo1 <= o.elo0 || o.alpha <= 0.0 || o.beta <= 0.0)) {
+        printf("--sprt needs ELO0 < ELO1 and positive error rates\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Book positions, or random openings from the start when there is no book
+static int loadOpenings(const Options &o, std::vector<GameState> &openings)
+{
+    if(o.book) {
+        FILE *f = fopen(o.book, "r");
+        if(!f) {
+            printf("Failed to open %s\n", o.book);
+            return -1;
+        }
+        char line[256];
+        int skipped = 0;
+        while(fgets(line, sizeof(line), f)) {
+            GameState state;
+            if(parsePosition(line, state) || state.numPlayers != 2 || state.isOver())
+                skipped++;
+            else
+                openings.push_back(state);
+        }
+        fclose(f);
+        if(skipped)
+            printf("%s: skipped %d lines that are not open two player positions\n", o.book, skipped);
+        if(openings.empty()) {
+            printf("%s has no usable positions\n", o.book);
+            return -1;
+        }
+        return 0;
+    }
+
+    uint64_t rng = o.seed;
+    for(int64_t i = 0; i < o.pairs; i++) {
+        GameState state;
+        state.reset(2);
+        for(int ply = 0; ply < o.randomPlies; ply++) {
+            MoveList list;
+            state.generateMoves(list);
+            int quiet = 0;
+            for(int j = 0; j < list.count; j++)
+                if(!list.moves[j].isWin())
+                    list.moves[quiet++] = list.moves[j];
+            if(!quiet)
+                break;
+            rng = splitMix(rng);
+            state.apply(list.moves[rng % quiet]);
+        }
+        openings.push_back(state);
+    }
+    return 0;
+}
+
+// The two engines of one pool thread
+struct EnginePair
+{
+    EngineProcess engines[2];
+    bool started;
+
+    EnginePair() : started(false) {}
+};
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if(parseOptions(argc, argv, o))
+        return 1;
+    std::vector<GameState> openings;
+    if(loadOpenings(o, openings))
+        return 1;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    ThreadPool pool(o.concurrency);
+    std::vector<std::unique_ptr<EnginePair>> pairs;
+    for(int i = 0; i < pool.size(); i++)
+        pairs.push_back(std::unique_ptr<EnginePair>(new EnginePair()));
+    if(o.depth > 0)
+        printf("%lld pairs at depth %d", (long long)o.pairs, o.depth);
+    else if(o.moveTimeMs > 0)
+        printf("%lld pairs at %lld ms per move", (long long)o.pairs, (long long)o.moveTimeMs);
+    else
+        printf("%lld pairs at %lld+%lld ms", (long long)o.pairs, (long long)o.baseMs, (long long)o.incMs);
+    printf(", %d games at a time, %zu openings\n", pool.size(), openings.size());
+
+    MatchStats stats;
+    std::atomic<int64_t> nextPair(0);
+    std::atomic<bool> decided(false);
+    std::atomic<bool> failed(false);
+    double llr = 0.0;
+
+    std::function<void()> task = [&] {
+        int64_t index = nextPair.fetch_add(1);
+        if(index >= o.pairs || decided || failed || g_interrupted)
+            return;
+        EnginePair &ep = *pairs[pool.currentIndex()];
+        if(!ep.started) {
+            for(int e = 0; e < 2; e++)
+                if(ep.engines[e].start(o.engines[e], o.hashMB)) {
+                    printf("Failed to start %s\n", o.engines[e]);
+                    failed = true;
+                    return;
+                }
+            ep.started = true;
+        }
+
+        const GameState &opening = openings[index % openings.size()];
+        int points = 0;         // engine 1's half points over the pair
+        GameEnd ends[2];
+        uint8_t winners[2];
+        for(int game = 0; game < 2; game++) {
+            // Game 0: engine 1 is player 0; game 1: seats swapped
+            EngineProcess *seats[2] = { &ep.engines[game], &ep.engines[1 - game] };
+            winners[game] = playGame(seats, opening, o, ends[game]);
+            if(winners[game] == NO_PLAYER)
+                points += 1;
+            else if(winners[game] == game)
+                points += 2;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(stats.lock);
+            for(int game = 0; game < 2; game++) {
+                if(winners[game] == NO_PLAYER) stats.draws++;
+                else if(winners[game] == game) stats.wins++;
+                else stats.losses++;
+                stats.ends[ends[game]]++;
+            }
+            stats.pentanomial[points]++;
+            stats.pairs++;
+            printStatus(stats, o, llr);
+            if(o.sprt && (llr <= log(o.beta / (1.0 - o.alpha)) || llr >= log((1.0 - o.beta) / o.alpha)))
+                decided = true;
+        }
+        pool.submit(task);
+    };
+    for(int i = 0; i < pool.size(); i++)
+        pool.submit(task);
+    pool.waitIdle();
+    pairs.clear();
+
+    if(failed)
+        return 1;
+    printf("Finished:");
+    for(int e = 0; e < END_TYPES; e++)
+        printf(" %s %lld%s", g_endNames[e], (long long)stats.ends[e], e + 1 < END_TYPES ? "," : "\n");
+    printStatus(stats, o, llr);
+    if(o.sprt) {
+        if(llr >= log((1.0 - o.beta) / o.alpha))
+            printf("SPRT: H1 accepted, engine 1 gains at least %.1f Elo\n", o.elo1);
+        else if(llr <= log(o.beta / (1.0 - o.alpha)))
+            printf("SPRT: H0 accepted, engine 1 does not gain %.1f Elo\n", o.elo1);
+        else
+            printf("SPRT: inconclusive after %lld pairs\n", (long long)stats.pairs);
+    }
+    if(g_interrupted)
+        printf("Interrupted\n");
+    return 0;
+}
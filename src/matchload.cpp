@@ -0,0 +1,225 @@
+// Load generator for the matchmaker in matchmaker.h. Several threads join
+// players with normally distributed ratings at a fixed total rate, some of
+// them leave again before they are paired, and every thread drains pairs
+// and ticks the matchmaker. At the end it reports the operation rate, how
+// long join and leave took, time to match and the rating gap of the pairs.
+//
+//   santorini_matchload [--threads N] [--seconds T] [--rate joins/s]
+//                       [--leave percent] [--tickets N] [--tick-ms N] [--seed N]
+//
+// --rate 0 joins as fast as the threads can, to measure the matchmaker's
+// own throughput; time to match is then mostly zero.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<math.h>
+#include<time.h>
+#include<atomic>
+#include<thread>
+#include<vector>
+
+#include"matchmaker.h"
+#include"histogram.h"
+
+#define RATING_MEAN   1500
+#define RATING_SPREAD 300
+#define RECENT_TICKETS 64       // a thread's own tickets it may leave again
+
+static volatile sig_atomic_t g_interrupted = 0;
+
+static void onSignal(int)
+{
+    g_interrupted = 1;
+}
+
+static uint64_t splitMix(uint64_t &x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double uniform(uint64_t &rng)
+{
+    return ((splitMix(rng) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static int randomRating(uint64_t &rng)
+{
+    double g = sqrt(-2.0 * log(uniform(rng))) * cos(2.0 * M_PI * uniform(rng));
+    return (int)(RATING_MEAN + RATING_SPREAD * g);
+}
+
+struct Options
+{
+    int threads;
+    int seconds;
+    int rate;
+    int leavePercent;
+    int tickets;
+    int tickMs;
+    uint64_t seed;
+};
+
+struct ThreadStats
+{
+    int64_t joins;
+    int64_t full;
+    int64_t leaves;
+    int64_t lateLeaves;     // the player had been paired already
+    int64_t matches;
+    Histogram joinNs;
+    Histogram leaveNs;
+    Histogram waitUs;
+    Histogram gap;
+};
+
+static void runThread(Matchmaker &mm, const Options &o, int index, int64_t startUs, int64_t endUs,
+                      std::atomic<int64_t> &nextTickUs, ThreadStats &stats)
+{
+    uint64_t rng = o.seed ^ (0x51ED27ull * (index + 1));
+    uint64_t recent[RECENT_TICKETS];
+    int recentCount = 0;
+    double perThreadRate = (double)o.rate / o.threads;
+    uint64_t player = (uint64_t)index << 40;
+
+    for(;;) {
+        int64_t now = Matchmaker::nowUs();
+        if(now >= endUs || g_interrupted)
+            break;
+
+        // One thread per period runs the widening pass
+        int64_t tickAt = nextTickUs.load(std::memory_order_relaxed);
+        if(now >= tickAt && nextTickUs.compare_exchange_strong(tickAt, now + o.tickMs * 1000LL))
+            mm.tick();
+
+        Match m;
+        while(mm.nextMatch(m)) {
+            stats.matches++;
+            stats.waitUs.record(m.waitedUs[0]);
+            stats.waitUs.record(m.waitedUs[1]);
+            stats.gap.record(abs(m.ratings[0] - m.ratings[1]));
+        }
+
+        if(o.rate > 0 && stats.joins + stats.full >= perThreadRate * (now - startUs) / 1e6) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            continue;
+        }
+
+        int64_t before = Matchmaker::nowUs();
+        uint64_t ticket = mm.join(player++, randomRating(rng));
+        int64_t after = Matchmaker::nowUs();
+        if(ticket == NO_TICKET) {
+            stats.full++;
+            continue;
+        }
+        stats.joins++;
+        stats.joinNs.record((after - before) * 1000);
+        if(recentCount < RECENT_TICKETS)
+            recent[recentCount++] = ticket;
+        else
+            recent[splitMix(rng) % RECENT_TICKETS] = ticket;
+
+        if((int)(splitMix(rng) % 100) < o.leavePercent) {
+            int pick = splitMix(rng) % recentCount;
+            before = Matchmaker::nowUs();
+            int left = mm.leave(recent[pick]);
+            stats.leaveNs.record((Matchmaker::nowUs() - before) * 1000);
+            if(left)
+                stats.lateLeaves++;
+            else
+                stats.leaves++;
+            recent[pick] = recent[--recentCount];
+        }
+    }
+}
+
+static int parseOptions(int argc, char **argv, Options &o)
+{
+    o.threads = std::thread::hardware_concurrency();
+    if(o.threads < 1)
+        o.threads = 1;
+    o.seconds = 10;
+    o.rate = 20000;
+    o.leavePercent = 10;
+    o.tickets = MATCH_DEFAULT_TICKETS;
+    o.tickMs = 2;
+    o.seed = (uint64_t)time(NULL);
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 >= argc) {
+            printf("Missing value for %s\n", argv[i]);
+            return -1;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i - 1], "--threads")) o.threads = atoi(value);
+        else if(!strcmp(argv[i - 1], "--seconds")) o.seconds = atoi(value);
+        else if(!strcmp(argv[i - 1], "--rate")) o.rate = atoi(value);
+        else if(!strcmp(argv[i - 1], "--leave")) o.leavePercent = atoi(value);
+        else if(!strcmp(argv[i - 1], "--tickets")) o.tickets = atoi(value);
+        else if(!strcmp(argv[i - 1], "--tick-ms")) o.tickMs = atoi(value);
+        else if(!strcmp(argv[i - 1], "--seed")) o.seed = strtoull(value, NULL, 10);
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            return -1;
+        }
+    }
+    if(o.threads < 1 || o.tickets < 2 || o.tickMs < 1 || o.rate < 0) {
+        printf("Need --threads >= 1, --tickets >= 2, --tick-ms >= 1 and --rate >= 0\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if(parseOptions(argc, argv, o))
+        return 1;
+    signal(SIGINT, onSignal);
+
+    Matchmaker mm(o.tickets);
+    std::vector<ThreadStats> stats(o.threads);
+    for(int i = 0; i < o.threads; i++)
+        stats[i].joins = stats[i].full = stats[i].leaves = stats[i].lateLeaves = stats[i].matches = 0;
+    int64_t start = Matchmaker::nowUs(), end = start + o.seconds * 1000000LL;
+    std::atomic<int64_t> nextTick(start);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < o.threads; i++)
+        threads.push_back(std::thread(runThread, std::ref(mm), std::cref(o), i, start, end, std::ref(nextTick),
+                                      std::ref(stats[i])));
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    double elapsed = (Matchmaker::nowUs() - start) / 1e6;
+    Match m;
+    while(mm.nextMatch(m)) {
+        stats[0].matches++;
+        stats[0].waitUs.record(m.waitedUs[0]);
+        stats[0].waitUs.record(m.waitedUs[1]);
+        stats[0].gap.record(abs(m.ratings[0] - m.ratings[1]));
+    }
+
+    ThreadStats total = stats[0];
+    for(int i = 1; i < o.threads; i++) {
+        total.joins += stats[i].joins;
+        total.full += stats[i].full;
+        total.leaves += stats[i].leaves;
+        total.lateLeaves += stats[i].lateLeaves;
+        total.matches += stats[i].matches;
+        total.joinNs.merge(stats[i].joinNs);
+        total.leaveNs.merge(stats[i].leaveNs);
+        total.waitUs.merge(stats[i].waitUs);
+        total.gap.merge(stats[i].gap);
+    }
+    printf("%d threads, %.1f s: %lld joins (%.0f/s), %lld leaves, %lld too late to leave, %lld pairs, "
+           "%lld still waiting, %lld turned away full\n", o.threads, elapsed, (long long)total.joins,
+           total.joins / elapsed, (long long)total.leaves, (long long)total.lateLeaves, (long long)total.matches,
+           (long long)(total.joins - total.leaves - 2 * total.matches), (long long)total.full);
+    total.joinNs.print("join", "us", 1000.0);
+    total.leaveNs.print("leave", "us", 1000.0);
+    total.waitUs.print("time to match", "ms", 1000.0);
+    total.gap.print("rating gap", "points");
+    return 0;
+}
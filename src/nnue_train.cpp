@@ -0,0 +1,361 @@
+// Trains the evaluation network. Positions come from lightly randomised
+// self-play, each labelled with a fixed depth search score, so the network
+// learns to predict what a deeper search would say. The float network is
+// then quantised into the int16/int8 layout NnueNetwork loads.
+//
+//   nnue_train [positions] [labelDepth] [epochs] [output] [positions file]
+//
+// Labelling is most of the work, so with a positions file the labelled
+// positions are kept there, one "<position> <score>" line each: a rerun
+// reads them back and only labels what is missing, at `labelDepth`.
+// The defaults are the settings santorini.nnue was trained with.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<math.h>
+#include<vector>
+
+#include"game_state.h"
+#include"notation.h"
+#include"evaluate.h"
+#include"search.h"
+#include"nnue.h"
+#include"symmetry.h"
+#include"transposition.h"
+
+#define LABEL_CLAMP      1200
+#define RANDOM_MOVE_PCT  20
+#define BATCH            256
+#define LEARNING_RATE    0.001f
+#define MAX_ACTIVE       (NUM_SQUARES + 2*WORKERS_PER_PLAYER)
+
+static uint64_t g_rng = 0xD1B54A32D192ED03ULL;
+
+static uint32_t randomNumber(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return (uint32_t)(g_rng >> 32);
+}
+
+static float randomUniform(float range)
+{
+    return ((randomNumber() & 0xFFFFFF) / (float)0xFFFFFF * 2.0f - 1.0f) * range;
+}
+
+struct Sample
+{
+    uint16_t features[NNUE_PERSPECTIVES][MAX_ACTIVE];   // side to move's seat first
+    float target;
+    float handcrafted;      // evaluate() on the same scale, for comparison
+};
+
+// Search never evaluates a position whose side to move can win at once, so
+// the network is not asked to learn them
+static bool trainable(const GameState &state)
+{
+    return !state.winningSquares(state.toMove);
+}
+
+static void addSample(std::vector<Sample> &out, const GameState &state, int score)
+{
+    Sample s;
+    for(int h = 0; h < NNUE_PERSPECTIVES; h++) {
+        int persp = h ? (state.toMove ^ 1) : state.toMove;
+        int n = 0;
+        for(uint8_t sq = 0; sq < NUM_SQUARES; sq++)
+            s.features[h][n++] = nnueHeightFeature(sq, state.heights[sq]);
+        for(int p = 0; p < NNUE_PERSPECTIVES; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++) {
+                uint8_t sq = state.workers[p][w];
+                s.features[h][n++] = nnueWorkerFeature(p == persp, sq, state.heights[sq]);
+            }
+    }
+    score = score > LABEL_CLAMP ? LABEL_CLAMP : (score < -LABEL_CLAMP ? -LABEL_CLAMP : score);
+    s.target = (float)score / NNUE_OUTPUT_SCALE;
+    s.handcrafted = (float)evaluate(state) / NNUE_OUTPUT_SCALE;
+    out.push_back(s);
+}
+
+// The same inputs seen through board symmetry `t`; the label does not change.
+// Training sees each position in a random one of the eight each epoch.
+static void transformSample(const Sample &in, Sample &out, int t)
+{
+    out = in;
+    for(int h = 0; h < NNUE_PERSPECTIVES; h++)
+        for(int f = 0; f < MAX_ACTIVE; f++) {
+            int x = in.features[h][f];
+            if(x < NNUE_HEIGHT_FEATURES) {
+                out.features[h][f] = nnueHeightFeature(transformSquare(x / (DOME_LEVEL+1), t), x % (DOME_LEVEL+1));
+                continue;
+            }
+            int base = (x < NNUE_OTHER_WORKER) ? NNUE_OWN_WORKER : NNUE_OTHER_WORKER;
+            int sq = (x - base) / DOME_LEVEL, level = (x - base) % DOME_LEVEL;
+            out.features[h][f] = base + transformSquare(sq, t) * DOME_LEVEL + level;
+        }
+}
+
+// Labelled positions already in `path`, up to `count`
+static void readSamples(std::vector<Sample> &out, int count, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if(!f)
+        return;
+    char line[POSITION_TEXT_MAX + 16];
+    while((int)out.size() < count && fgets(line, sizeof(line), f)) {
+        GameState state;
+        const char *end;
+        if(parsePosition(line, state, &end) || state.numPlayers != NNUE_PERSPECTIVES) {
+            printf("Skipping %s", line);
+            continue;
+        }
+        if(trainable(state))
+            addSample(out, state, atoi(end));
+    }
+    fclose(f);
+    printf("%d positions read from %s\n", (int)out.size(), path);
+}
+
+static void generateSamples(std::vector<Sample> &out, int count, int depth, FILE *save)
+{
+    TranspositionTable tt(32);
+    Search search(tt);
+
+    while((int)out.size() < count) {
+        GameState state;
+        state.reset(2);
+        tt.clear();
+
+        while(!state.isOver() && state.hasMoves() && (int)out.size() < count) {
+            SearchResult r = search.think(state, SearchLimits::fixedDepth(depth));
+            if(trainable(state))
+                addSample(out, state, r.score);
+            if(save) {
+                char line[POSITION_TEXT_MAX];
+                formatPosition(state, line, sizeof(line));
+                fprintf(save, "%s %d\n", line, r.score);
+            }
+
+            Move m = r.best;
+            if(!m.isWin() && (int)(randomNumber() % 100) < RANDOM_MOVE_PCT) {
+                MoveList moves;
+                state.generateMoves(moves);
+                m = moves.moves[randomNumber() % moves.count];
+            }
+            state.apply(m);
+        }
+        printf("\r%d / %d positions", (int)out.size(), count);
+        fflush(stdout);
+    }
+    printf("\n");
+}
+
+// Float copy of the network, trained with Adam
+struct Trainer
+{
+    enum { W1 = 0, B1, W2, B2, W3, B3, NUM_PARAMS };
+    std::vector<float> param[NUM_PARAMS], grad[NUM_PARAMS], m[NUM_PARAMS], v[NUM_PARAMS];
+    int step;
+
+    Trainer() : step(0) {
+        const size_t sizes[NUM_PARAMS] = { NNUE_INPUTS * NNUE_HIDDEN, NNUE_HIDDEN,
+                                           NNUE_L2 * NNUE_PERSPECTIVES * NNUE_HIDDEN, NNUE_L2, NNUE_L2, 1 };
+        for(int p = 0; p < NUM_PARAMS; p++) {
+            param[p].assign(sizes[p], 0.0f);
+            grad[p].assign(sizes[p], 0.0f);
+            m[p].assign(sizes[p], 0.0f);
+            v[p].assign(sizes[p], 0.0f);
+        }
+        for(size_t i = 0; i < param[W1].size(); i++) param[W1][i] = randomUniform(0.1f);
+        for(size_t i = 0; i < param[B1].size(); i++) param[B1][i] = 0.3f;
+        for(size_t i = 0; i < param[W2].size(); i++) param[W2][i] = randomUniform(0.15f);
+        for(size_t i = 0; i < param[W3].size(); i++) param[W3][i] = randomUniform(0.3f);
+    }
+
+    // Forward pass, plus gradients scaled by `gradScale` when non-zero
+    float forward(const Sample &s, float gradScale) {
+        float a[NNUE_PERSPECTIVES*NNUE_HIDDEN], z2[NNUE_L2], y2[NNUE_L2];
+        const float *w1 = &param[W1][0];
+
+        for(int h = 0; h < NNUE_PERSPECTIVES; h++)
+            for(int j = 0; j < NNUE_HIDDEN; j++) {
+                float sum = param[B1][j];
+                for(int f = 0; f < MAX_ACTIVE; f++)
+                    sum += w1[s.features[h][f] * NNUE_HIDDEN + j];
+                a[h*NNUE_HIDDEN + j] = sum;
+            }
+
+        float out = param[B3][0];
+        for(int o = 0; o < NNUE_L2; o++) {
+            const float *w2 = &param[W2][o * NNUE_PERSPECTIVES * NNUE_HIDDEN];
+            float sum = param[B2][o];
+            for(int i = 0; i < NNUE_PERSPECTIVES*NNUE_HIDDEN; i++)
+                sum += w2[i] * clamp01(a[i]);
+            z2[o] = sum;
+            y2[o] = clamp01(sum);
+            out += param[W3][o] * y2[o];
+        }
+
+        if(gradScale == 0.0f)
+            return out;
+
+        float dOut = 2.0f * (out - s.target) * gradScale;
+        float dA[NNUE_PERSPECTIVES*NNUE_HIDDEN] = {};
+        grad[B3][0] += dOut;
+        for(int o = 0; o < NNUE_L2; o++) {
+            grad[W3][o] += dOut * y2[o];
+            float dZ = (z2[o] > 0.0f && z2[o] < 1.0f) ? dOut * param[W3][o] : 0.0f;
+            if(dZ == 0.0f)
+                continue;
+            grad[B2][o] += dZ;
+            float *g2 = &grad[W2][o * NNUE_PERSPECTIVES * NNUE_HIDDEN];
+            const float *w2 = &param[W2][o * NNUE_PERSPECTIVES * NNUE_HIDDEN];
+            for(int i = 0; i < NNUE_PERSPECTIVES*NNUE_HIDDEN; i++) {
+                g2[i] += dZ * clamp01(a[i]);
+                dA[i] += dZ * w2[i];
+            }
+        }
+        for(int h = 0; h < NNUE_PERSPECTIVES; h++)
+            for(int j = 0; j < NNUE_HIDDEN; j++) {
+                float d = dA[h*NNUE_HIDDEN + j];
+                float x = a[h*NNUE_HIDDEN + j];
+                if(x <= 0.0f || x >= 1.0f || d == 0.0f)
+                    continue;
+                grad[B1][j] += d;
+                for(int f = 0; f < MAX_ACTIVE; f++)
+                    grad[W1][s.features[h][f] * NNUE_HIDDEN + j] += d;
+            }
+        return out;
+    }
+
+    void applyGradients(void) {
+        const float beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+        step++;
+        float c1 = 1.0f - powf(beta1, step), c2 = 1.0f - powf(beta2, step);
+        // Later layers are stored as int8 * 64, so keep them inside that range
+        const float limit = 127.0f / NNUE_WEIGHT_SCALE;
+        for(int p = 0; p < NUM_PARAMS; p++)
+            for(size_t i = 0; i < param[p].size(); i++) {
+                float g = grad[p][i];
+                grad[p][i] = 0.0f;
+                m[p][i] = beta1 * m[p][i] + (1.0f - beta1) * g;
+                v[p][i] = beta2 * v[p][i] + (1.0f - beta2) * g * g;
+                param[p][i] -= LEARNING_RATE * (m[p][i] / c1) / (sqrtf(v[p][i] / c2) + eps);
+                if(p == W2 || p == W3)
+                    param[p][i] = param[p][i] > limit ? limit : (param[p][i] < -limit ? -limit : param[p][i]);
+            }
+    }
+
+    void quantise(NnueNetwork &net) const {
+        for(int f = 0; f < NNUE_INPUTS; f++)
+            for(int j = 0; j < NNUE_HIDDEN; j++)
+                net.ftWeights[f][j] = (int16_t)lrintf(param[W1][f * NNUE_HIDDEN + j] * NNUE_FT_SCALE);
+        for(int j = 0; j < NNUE_HIDDEN; j++)
+            net.ftBias[j] = (int16_t)lrintf(param[B1][j] * NNUE_FT_SCALE);
+        for(int o = 0; o < NNUE_L2; o++) {
+            for(int i = 0; i < NNUE_PERSPECTIVES*NNUE_HIDDEN; i++)
+                net.l2Weights[o][i] = (int8_t)lrintf(param[W2][o * NNUE_PERSPECTIVES * NNUE_HIDDEN + i] * NNUE_WEIGHT_SCALE);
+            net.l2Bias[o] = (int32_t)lrintf(param[B2][o] * NNUE_FT_SCALE * NNUE_WEIGHT_SCALE);
+            net.outWeights[o] = (int8_t)lrintf(param[W3][o] * NNUE_WEIGHT_SCALE);
+        }
+        net.outBias = (int32_t)lrintf(param[B3][0] * NNUE_FT_SCALE * NNUE_WEIGHT_SCALE);
+        net.blockWeights();
+    }
+
+    static float clamp01(float x) {
+        return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+    }
+};
+
+int main(int argc, char **argv)
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 300000;
+    int depth = (argc > 2) ? atoi(argv[2]) : 4;
+    int epochs = (argc > 3) ? atoi(argv[3]) : 60;
+    const char *output = (argc > 4) ? argv[4] : NNUE_DEFAULT_PATH;
+    const char *positions = (argc > 5) ? argv[5] : NULL;
+
+    std::vector<Sample> samples;
+    FILE *save = NULL;
+    if(positions) {
+        readSamples(samples, count, positions);
+        if((int)samples.size() < count && !(save = fopen(positions, "a"))) {
+            printf("Failed to open %s\n", positions);
+            return 1;
+        }
+    }
+    generateSamples(samples, count, depth, save);
+    if(save)
+        fclose(save);
+
+    // Shuffle, then hold back a tenth to watch for overfitting
+    for(size_t i = samples.size() - 1; i > 0; i--) {
+        size_t j = randomNumber() % (i + 1);
+        Sample t = samples[i]; samples[i] = samples[j]; samples[j] = t;
+    }
+    size_t validation = samples.size() / 10;
+    size_t training = samples.size() - validation;
+
+    // What the network has to beat: the handcrafted evaluation on the same
+    // positions, scaled to fit the labels as well as it can
+    double dot = 0.0, square = 0.0, handLoss = 0.0;
+    for(size_t k = training; k < samples.size(); k++) {
+        dot += samples[k].handcrafted * samples[k].target;
+        square += samples[k].handcrafted * samples[k].handcrafted;
+    }
+    double fit = square ? dot / square : 0.0;
+    for(size_t k = training; k < samples.size(); k++) {
+        double d = fit * samples[k].handcrafted - samples[k].target;
+        handLoss += d * d;
+    }
+    printf("handcrafted evaluation: validation %.4f (scaled by %.2f)\n", validation ? handLoss / validation : 0.0, fit);
+
+    Trainer trainer;
+    for(int e = 0; e < epochs; e++) {
+        double trainLoss = 0.0;
+        for(size_t i = 0; i < training; i += BATCH) {
+            size_t end = (i + BATCH < training) ? i + BATCH : training;
+            for(size_t k = i; k < end; k++) {
+                Sample s;
+                transformSample(samples[k], s, randomNumber() % NUM_SYMMETRIES);
+                float d = trainer.forward(s, 1.0f / (end - i)) - s.target;
+                trainLoss += d * d;
+            }
+            trainer.applyGradients();
+        }
+
+        double validLoss = 0.0;
+        for(size_t k = training; k < samples.size(); k++) {
+            float d = trainer.forward(samples[k], 0.0f) - samples[k].target;
+            validLoss += d * d;
+        }
+        printf("epoch %2d  train %.4f  validation %.4f\n", e + 1,
+               trainLoss / training, validation ? validLoss / validation : 0.0);
+    }
+
+    static NnueNetwork net;
+    trainer.quantise(net);
+
+    // How far quantisation moved the answers, in evaluation units
+    double error = 0.0;
+    for(size_t k = training; k < samples.size(); k++) {
+        NnueAccumulator acc;
+        for(int h = 0; h < NNUE_PERSPECTIVES; h++) {
+            memcpy(acc.v[h], net.ftBias, sizeof(net.ftBias));
+            for(int f = 0; f < MAX_ACTIVE; f++)
+                for(int j = 0; j < NNUE_HIDDEN; j++)
+                    acc.v[h][j] += net.ftWeights[samples[k].features[h][f]][j];
+        }
+        float expected = trainer.forward(samples[k], 0.0f) * NNUE_OUTPUT_SCALE;
+        error += fabs(net.evaluate(acc, 0) - expected);
+    }
+    printf("mean quantisation error %.1f\n", validation ? error / validation : 0.0);
+
+    if(net.save(output)) {
+        printf("Failed to write %s\n", output);
+        return 1;
+    }
+    printf("wrote %s\n", output);
+    return 0;
+}
@@ -0,0 +1,279 @@
+// Puzzle generator: mines forced wins from recorded games. Every position
+// of every two player game is given to the bounded mate search in puzzle.h
+// on a work-stealing pool; positions whose shortest forced win is between
+// --min-mate and --max-mate turns and has exactly one winning first move
+// become puzzles. Puzzles are stored in their canonical symmetric form, so
+// a position reached mirrored or rotated in another game is only written
+// once. The output is a puzzle file for `santorini --puzzle`.
+//
+//   santorini_puzzles [--min-mate N] [--max-mate N] [--threads N]
+//                     [--report seconds] [--out file] <records.sgr>...
+//
+// Ctrl-C stops reading games; the games already queued are finished and
+// their puzzles written.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<unistd.h>
+#include<atomic>
+#include<chrono>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<unordered_set>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+#include"puzzle.h"
+#include"search.h"
+#include"symmetry.h"
+#include"thread_pool.h"
+
+#define GAMES_IN_FLIGHT_PER_THREAD 4
+
+struct Options
+{
+    int minMate;
+    int maxMate;
+    int threads;
+    int reportSeconds;
+    const char *out;
+    std::vector<const char *> inputs;
+};
+
+struct Totals
+{
+    std::atomic<int64_t> games;
+    std::atomic<int64_t> positions;
+    std::atomic<int64_t> mates[PUZZLE_MAX_MATE + 1];  // shortest win found, any number of solutions
+    std::atomic<int64_t> puzzles[PUZZLE_MAX_MATE + 1];
+    std::atomic<int64_t> duplicates;
+    std::atomic<uint64_t> nodes;
+
+    Totals() : games(0), positions(0), duplicates(0), nodes(0) {
+        for(int n = 0; n <= PUZZLE_MAX_MATE; n++)
+            mates[n] = puzzles[n] = 0;
+    }
+};
+
+// Found puzzles, shared by all pool threads
+class PuzzleWriter
+{
+    FILE *out;
+    std::mutex lock;
+    std::unordered_set<uint64_t> seen;
+
+public:
+    bool failed;
+
+    PuzzleWriter(FILE *f) : out(f), failed(false) {}
+
+    // Returns false if the position was already written
+    bool add(const Puzzle &puzzle) {
+        char line[PUZZLE_LINE_MAX];
+        formatPuzzle(puzzle, line, sizeof(line));
+        std::lock_guard<std::mutex> guard(lock);
+        if(!seen.insert(puzzle.state.hash).second)
+            return false;
+        if(fprintf(out, "%s\n", line) < 0)
+            failed = true;
+        return true;
+    }
+
+    void flush(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        fflush(out);
+    }
+
+    int64_t count(void) {
+        std::lock_guard<std::mutex> guard(lock);
+        return (int64_t)seen.size();
+    }
+};
+
+static volatile sig_atomic_t g_interrupted = 0;
+
+static void onSignal(int)
+{
+    if(g_interrupted)
+        _exit(1);
+    g_interrupted = 1;
+}
+
+static void scanGame(MateSearch &mate, const GameRecord &record, const Options &o, PuzzleWriter &writer,
+                     Totals &totals)
+{
+    GameState state;
+    state.reset(record.numPlayers);
+    uint64_t startNodes = mate.nodes;
+    for(int i = 0; ; i++) {
+        GameRecord::skipStuckPlayers(state);
+        if(state.isOver())
+            break;
+        totals.positions++;
+
+        int n = mate.mateIn(state, o.maxMate);
+        if(n)
+            totals.mates[n]++;
+        Puzzle puzzle;
+        puzzle.solution = NULL_MOVE;
+        if(n >= o.minMate && mate.winningMoves(state, n, puzzle.solution) == 1) {
+            int t;
+            puzzle.state = canonicalState(state, &t);
+            puzzle.solution = transformMove(puzzle.solution, puzzle.state, t);
+            puzzle.mate = n;
+            if(writer.add(puzzle))
+                totals.puzzles[n]++;
+            else
+                totals.duplicates++;
+        }
+        if(i == record.plies)
+            break;
+        state.apply(record.moves[i]);
+    }
+    totals.nodes += mate.nodes - startNodes;
+}
+
+static int parseOptions(int argc, char **argv, Options &o)
+{
+    o.minMate = 2;
+    o.maxMate = 3;
+    o.threads = 0;
+    o.reportSeconds = 10;
+    o.out = "puzzles.txt";
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if(arg[0] != '-' || arg[1] != '-') {
+            o.inputs.push_back(arg);
+            continue;
+        }
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(!value) {
+            printf("Missing value for %s\n", arg);
+            return -1;
+        }
+        i++;
+        if(!strcmp(arg, "--min-mate")) o.minMate = atoi(value);
+        else if(!strcmp(arg, "--max-mate")) o.maxMate = atoi(value);
+        else if(!strcmp(arg, "--threads")) o.threads = atoi(value);
+        else if(!strcmp(arg, "--report")) o.reportSeconds = atoi(value);
+        else if(!strcmp(arg, "--out")) o.out = value;
+        else {
+            printf("Unknown option %s\n", arg);
+            return -1;
+        }
+    }
+    if(o.minMate < 1 || o.maxMate < o.minMate || o.maxMate > PUZZLE_MAX_MATE) {
+        printf("Need 1 <= --min-mate <= --max-mate <= %d\n", PUZZLE_MAX_MATE);
+        return -1;
+    }
+    if(o.inputs.empty()) {
+        printf("No game record files given\n");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if(parseOptions(argc, argv, o))
+        return 1;
+
+    FILE *out = fopen(o.out, "w");
+    if(!out) {
+        printf("Failed to open %s\n", o.out);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    ThreadPool pool(o.threads);
+    std::vector<std::unique_ptr<MateSearch>> searches;
+    for(int i = 0; i < pool.size(); i++)
+        searches.push_back(std::unique_ptr<MateSearch>(new MateSearch()));
+    PuzzleWriter writer(out);
+    Totals totals;
+    std::atomic<int> inFlight(0);
+    int status = 0;
+
+    int64_t start = nowMs(), lastReport = start;
+    for(size_t f = 0; f < o.inputs.size() && !g_interrupted; f++) {
+        FILE *in = fopen(o.inputs[f], "rb");
+        if(!in) {
+            printf("Failed to open %s\n", o.inputs[f]);
+            status = 1;
+            continue;
+        }
+        if(GameRecord::readFileHeader(in)) {
+            printf("%s is not a game record file\n", o.inputs[f]);
+            fclose(in);
+            status = 1;
+            continue;
+        }
+
+        for(;;) {
+            std::shared_ptr<GameRecord> record(new GameRecord());
+            int read = record->read(in);
+            if(read != 1) {
+                if(read < 0) {
+                    printf("%s: bad game record after %lld games\n", o.inputs[f], (long long)totals.games.load());
+                    status = 1;
+                }
+                break;
+            }
+            if(record->numPlayers != 2)
+                continue;
+
+            // Keep a few games per thread queued so reading never runs far ahead
+            while(inFlight >= pool.size() * GAMES_IN_FLIGHT_PER_THREAD)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if(g_interrupted)
+                break;
+            inFlight++;
+            pool.submit([&, record] {
+                scanGame(*searches[pool.currentIndex()], *record, o, writer, totals);
+                totals.games++;
+                inFlight--;
+            });
+
+            int64_t now = nowMs();
+            if(o.reportSeconds > 0 && now - lastReport >= o.reportSeconds * 1000LL) {
+                lastReport = now;
+                writer.flush();
+                printf("%lld games, %lld positions, %.0f positions/s, %lld puzzles\n",
+                       (long long)totals.games.load(), (long long)totals.positions.load(),
+                       totals.positions * 1000.0 / (now - start), (long long)writer.count());
+                fflush(stdout);
+            }
+        }
+        fclose(in);
+    }
+    pool.waitIdle();
+    writer.flush();
+    fclose(out);
+
+    int64_t elapsed = nowMs() - start;
+    printf("%lld games, %lld positions in %.1f s: %.0f positions/s, %.0f nodes/position\n",
+           (long long)totals.games.load(), (long long)totals.positions.load(), elapsed / 1000.0,
+           elapsed ? totals.positions * 1000.0 / elapsed : 0.0,
+           totals.positions ? (double)totals.nodes / totals.positions : 0.0);
+    for(int n = 1; n <= o.maxMate; n++)
+        printf("mate in %d: %lld positions, %lld puzzles\n", n, (long long)totals.mates[n].load(),
+               (long long)totals.puzzles[n].load());
+    printf("%lld duplicates dropped, %lld puzzles written to %s\n", (long long)totals.duplicates.load(),
+           (long long)writer.count(), o.out);
+    if(writer.failed) {
+        printf("Failed to write to %s\n", o.out);
+        status = 1;
+    }
+    if(g_interrupted)
+        printf("Interrupted; puzzles from the games read so far were written\n");
+    return status;
+}
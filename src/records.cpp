@@ -0,0 +1,228 @@
+// Game record file utility.
+//
+//   santorini_records stats <file>          games, size and bits per turn
+//   santorini_records text <file>           one line of coordinates per game
+//   santorini_records positions <file>      every position, one per line
+//   santorini_records notation [file]       check position text round trips
+//
+// `stats` also sizes the same games as coordinate text, the way they would
+// be archived without the record format.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+
+static GameRecord g_record;
+
+static FILE *openRecords(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if(!f) {
+        printf("Failed to open %s\n", path);
+        return NULL;
+    }
+    if(GameRecord::readFileHeader(f)) {
+        printf("%s is not a game record file\n", path);
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+static int gameText(const GameRecord &r, char *out)
+{
+    char *p = out + sprintf(out, "%d %c", r.numPlayers, r.winner == NO_PLAYER ? '-' : '1' + r.winner);
+    for(int i = 0; i < r.plies; i++) {
+        *p++ = ' ';
+        p = moveName(r.moves[i], p);
+    }
+    *p++ = '\n';
+    *p = 0;
+    return p - out;
+}
+
+static int stats(const char *path)
+{
+    FILE *f = openRecords(path);
+    if(!f)
+        return 1;
+
+    static char line[16 + RECORD_MAX_PLIES * 10];
+    long long games = 0, turns = 0, textBytes = 0, unfinished = 0;
+    long long wins[MAX_PLAYERS] = {};
+    double choiceBits = 0.0;
+    int status;
+    while((status = g_record.read(f)) == 1) {
+        games++;
+        turns += g_record.plies;
+        textBytes += gameText(g_record, line);
+        if(g_record.winner == NO_PLAYER)
+            unfinished++;
+        else
+            wins[g_record.winner]++;
+
+        // Information content: log2 of the legal move count at each turn
+        GameState state;
+        state.reset(g_record.numPlayers);
+        for(int i = 0; i < g_record.plies; i++) {
+            GameRecord::skipStuckPlayers(state);
+            MoveList list;
+            state.generateMoves(list);
+            choiceBits += log2((double)list.count);
+            state.apply(g_record.moves[i]);
+        }
+    }
+    long bytes = ftell(f);
+    fclose(f);
+    if(status < 0)
+        printf("Stopped at a damaged game after %lld games\n", games);
+
+    printf("%s: %lld games, %lld turns, %lld unfinished\n", path, games, turns, unfinished);
+    printf("wins by seat: %lld %lld %lld %lld\n", wins[0], wins[1], wins[2], wins[3]);
+    printf("file       %10ld bytes  %6.2f bits/turn\n", bytes, turns ? bytes * 8.0 / turns : 0.0);
+    printf("choices    %10.0f bytes  %6.2f bits/turn\n", choiceBits / 8.0, turns ? choiceBits / turns : 0.0);
+    printf("as text    %10lld bytes  %6.2f bits/turn  (%.1fx the file)\n", textBytes,
+           turns ? textBytes * 8.0 / turns : 0.0, bytes ? (double)textBytes / bytes : 0.0);
+    return status < 0 ? 1 : 0;
+}
+
+static int text(const char *path)
+{
+    FILE *f = openRecords(path);
+    if(!f)
+        return 1;
+
+    static char line[16 + RECORD_MAX_PLIES * 10];
+    int status;
+    while((status = g_record.read(f)) == 1) {
+        gameText(g_record, line);
+        fputs(line, stdout);
+    }
+    fclose(f);
+    return status < 0 ? 1 : 0;
+}
+
+static int positions(const char *path)
+{
+    FILE *f = openRecords(path);
+    if(!f)
+        return 1;
+
+    char line[POSITION_TEXT_MAX];
+    int status;
+    while((status = g_record.read(f)) == 1) {
+        GameState state;
+        state.reset(g_record.numPlayers);
+        for(int i = 0; ; i++) {
+            GameRecord::skipStuckPlayers(state);
+            formatPosition(state, line, sizeof(line));
+            puts(line);
+            if(i == g_record.plies)
+                break;
+            state.apply(g_record.moves[i]);
+        }
+    }
+    fclose(f);
+    return status < 0 ? 1 : 0;
+}
+
+// Text that must not parse: not a position with at least two players
+static const char *g_badPositions[] = {
+    "00000/00000/00000/00000/00000 a1b1 1 -",
+    "00000/00000/00000/00000/00000 a1b1/a1c1 1 -",
+    "00000/00000/00000/00000/D0000 a1b1/c1d1 1 -",
+    "00000/00000/00000/00000/00000 a1b1/c1d1 3 -",
+    "00000/00000/00000/00000/00000 a1b1/-/c1d1 2 -",
+    "00000/00000/00000/00000/00000 a1b1/c1d1/e1a2/b2c2/d2e2 1 -",
+    "00000/00000/00000/00000 a1b1/c1d1 1 -",
+    "00000/00000/00000/00000/00004 a1b1/c1d1 1 -",
+};
+
+// Text that must parse and format back to itself
+static const char *g_goodPositions[] = {
+    "00000/00000/00000/00000/00000 b2d4/d2b4 1 -",
+    "0000D/01200/00300/01000/00000 b2d4/d2b4 2 -",
+    "00000/00000/00000/00000/00000 a1b1/-/c1d1 3 -",
+    "00000/00000/00000/00000/00300 a1c1/d1e1 2 -",
+    "00000/00000/00000/00000/00000 -/a1b1 2 -",
+};
+
+// 0 if `text` parses, formats back to `text` when `exact`, and the result
+// parses again to the same position
+static int roundTrip(const char *text, bool exact)
+{
+    GameState a, b;
+    char line[POSITION_TEXT_MAX];
+    if(parsePosition(text, a) || formatPosition(a, line, sizeof(line)) < 0 || (exact && strcmp(line, text)) ||
+       parsePosition(line, b) || b.hash != a.hash || b.numPlayers != a.numPlayers)
+        return -1;
+    return 0;
+}
+
+static int notation(const char *path)
+{
+    int failed = 0;
+    for(size_t i = 0; i < sizeof(g_badPositions) / sizeof(g_badPositions[0]); i++) {
+        GameState state;
+        if(!parsePosition(g_badPositions[i], state)) {
+            printf("Accepted %s\n", g_badPositions[i]);
+            failed++;
+        }
+    }
+    for(size_t i = 0; i < sizeof(g_goodPositions) / sizeof(g_goodPositions[0]); i++)
+        if(roundTrip(g_goodPositions[i], true)) {
+            printf("Failed to round trip %s\n", g_goodPositions[i]);
+            failed++;
+        }
+
+    long long checked = 0;
+    int status = 0;
+    if(path) {
+        FILE *f = openRecords(path);
+        if(!f)
+            return 1;
+        char line[POSITION_TEXT_MAX];
+        while((status = g_record.read(f)) == 1) {
+            GameState state;
+            state.reset(g_record.numPlayers);
+            for(int i = 0; ; i++) {
+                GameRecord::skipStuckPlayers(state);
+                formatPosition(state, line, sizeof(line));
+                checked++;
+                if(roundTrip(line, true)) {
+                    printf("Failed to round trip %s\n", line);
+                    failed++;
+                }
+                if(i == g_record.plies)
+                    break;
+                state.apply(g_record.moves[i]);
+            }
+        }
+        fclose(f);
+    }
+    printf("%lld positions checked, %d failures\n", checked, failed);
+    return (failed || status < 0) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc == 3 && !strcmp(argv[1], "stats"))
+        return stats(argv[2]);
+    if(argc == 3 && !strcmp(argv[1], "text"))
+        return text(argv[2]);
+    if(argc == 3 && !strcmp(argv[1], "positions"))
+        return positions(argv[2]);
+    if((argc == 2 || argc == 3) && !strcmp(argv[1], "notation"))
+        return notation(argc == 3 ? argv[2] : NULL);
+
+    printf("usage: santorini_records stats <file>\n"
+           "       santorini_records text <file>\n"
+           "       santorini_records positions <file>\n"
+           "       santorini_records notation [file]\n");
+    return 1;
+}
@@ -2,6 +2,11 @@
 #include<GLFW/glfw3.h>
 #include<math.h>
 #include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<unistd.h>
+#include<sys/wait.h>
 #include<iostream>
 #include<stdbool.h>
 #include<glm/glm.hpp>
@@ -11,10 +16,31 @@
 #include"shader.h"
 #include"camera.h"
 #include"board.h"
+#include"assets.h"
+#include"startup.h"
+#include"input.h"
+#include"frame_pacer.h"
+#include"picker.h"
+#include"game_state.h"
+#include"notation.h"
+#include"game_record.h"
+#include"ai_player.h"
+#include"dfpn.h"
+#include"puzzle.h"
+#include"net_client.h"
+#include"trace.h"
 
 #define SCR_WIDTH 1280
 #define SCR_HEIGHT 720
 #define GAME_NAME "Santorini"
+#define AI_PLAYER 1
+#define MAX_HISTORY 256
+#define SOLVE_TIME_MS 10000
+#define SOLVE_HASH_MB 64
+#define LOCAL_SERVER "./santorini_server"
+#define LOCAL_OPPONENT_TT_MB 4
+#define LOCAL_START_WAIT_MS 2000
+#define TRACE_FILE "santorini_trace.json"
 
 static float mixValue = 0.2f;
 static unsigned int newWidth = SCR_WIDTH;
@@ -28,15 +54,35 @@ Camera camera(glm::vec3(60.0f, 30.0f, 60.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 
-static bool g_updateTower = false;
+static int g_updateTower = 0;         // presses this frame
 static bool g_updatePlayer = false;
 static bool g_birdsEye = false;
+static int g_undoMove = 0;
+static int g_aiPlayer = AI_PLAYER;   // the seat the local AI plays
+static bool g_solvePosition = false;
 
 static bool g_cameraSpinLeft = false;
 static bool g_cameraSpinRight = false;
 static bool g_cameraSpinUp = false;
 static bool g_cameraSpinDown = false;
 
+static GameState g_game;
+static GameState g_history[MAX_HISTORY];
+static int g_historyLength = 0;
+
+// Mouse play. Picks use the matrices and position as last drawn, which is
+// what the player clicked on.
+static glm::mat4 g_view;
+static glm::mat4 g_projection;
+static BoardPicker g_picker;
+static double g_cursorX = -1.0, g_cursorY = -1.0;
+static bool g_cursorMoved = false;
+static bool g_mouseTurn = false;            // the side to move plays by mouse
+static uint8_t g_pickFrom = NO_SQUARE;      // worker picked for the move
+static uint8_t g_pickTo = NO_SQUARE;        // and the square it steps to
+static bool g_clickedMove = false;
+static Move g_clickMove;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -44,40 +90,298 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     newHeight = height;
 }
 
-void processInput(GLFWwindow *window)
+// What the keys do. A held key acts once, and again on the keyboard's own
+// repeats only where `repeat` is set
+enum Command
 {
-    bool cameraMoving = g_cameraSpinUp || g_cameraSpinDown || g_cameraSpinLeft || g_cameraSpinRight;
+    COMMAND_QUIT,
+    COMMAND_SPIN_LEFT,
+    COMMAND_SPIN_RIGHT,
+    COMMAND_SPIN_UP,
+    COMMAND_SPIN_DOWN,
+    COMMAND_RAISE_TOWERS,
+    COMMAND_MOVE_PLAYER,
+    COMMAND_UNDO,
+    COMMAND_SOLVE
+};
 
-    // Close window
-    if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+struct KeyBinding
+{
+    int key;
+    Command command;
+    bool repeat;
+};
+
+static const KeyBinding g_keyBindings[] = {
+    { GLFW_KEY_ESCAPE, COMMAND_QUIT,         false },
+    { GLFW_KEY_LEFT,   COMMAND_SPIN_LEFT,    true  },
+    { GLFW_KEY_RIGHT,  COMMAND_SPIN_RIGHT,   true  },
+    { GLFW_KEY_UP,     COMMAND_SPIN_UP,      true  },
+    { GLFW_KEY_DOWN,   COMMAND_SPIN_DOWN,    true  },
+    // Make tower or move player; moves are clicked on the board (clickSquare)
+    { GLFW_KEY_L,      COMMAND_RAISE_TOWERS, false },
+    { GLFW_KEY_P,      COMMAND_MOVE_PLAYER,  false },
+    { GLFW_KEY_U,      COMMAND_UNDO,         false },
+    { GLFW_KEY_S,      COMMAND_SOLVE,        false },
+};
 
-    // Move camera
-    else if(glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS && !cameraMoving) {
-        g_cameraSpinLeft = true;
+static void runCommand(GLFWwindow *window, Command command)
+{
+    bool cameraMoving = g_cameraSpinUp || g_cameraSpinDown || g_cameraSpinLeft || g_cameraSpinRight;
+
+    switch(command) {
+        case COMMAND_QUIT:
+            glfwSetWindowShouldClose(window, true);
+            break;
+        // One spin at a time; a held arrow starts the next on a repeat
+        case COMMAND_SPIN_LEFT:
+            if(!cameraMoving)
+                g_cameraSpinLeft = true;
+            break;
+        case COMMAND_SPIN_RIGHT:
+            if(!cameraMoving)
+                g_cameraSpinRight = true;
+            break;
+        case COMMAND_SPIN_UP:
+            if(!cameraMoving)
+                g_cameraSpinUp = true;
+            break;
+        case COMMAND_SPIN_DOWN:
+            if(!cameraMoving)
+                g_cameraSpinDown = true;
+            break;
+        case COMMAND_RAISE_TOWERS:
+            g_updateTower++;
+            break;
+        case COMMAND_MOVE_PLAYER:
+            g_updatePlayer = true;
+            break;
+        case COMMAND_UNDO:
+            g_undoMove++;
+            break;
+        case COMMAND_SOLVE:
+            g_solvePosition = true;
+            break;
     }
-    else if(glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS && !cameraMoving) {
-        g_cameraSpinRight = true;
+}
+
+static PickResult pickAt(GLFWwindow *window, double x, double y)
+{
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    glm::vec3 origin, direction;
+    BoardPicker::cursorRay(x, y, width, height, g_view, g_projection, origin, direction);
+    return g_picker.pick(origin, direction);
+}
+
+// Moves are clicked together: one of the mover's workers, the square to
+// step to, then the square to build on. Sets g_clickedMove once the clicks
+// make a legal move; a click that does not go on with one starts over.
+static void clickSquare(uint8_t sq)
+{
+    MoveList moves;
+    g_game.generateMoves(moves);
+    if(g_pickFrom != NO_SQUARE) {
+        bool steps = false;
+        for(int i = 0; i < moves.count; i++) {
+            const Move &m = moves.moves[i];
+            if(m.from != g_pickFrom)
+                continue;
+            bool done = (g_pickTo == NO_SQUARE) ? (m.to == sq && m.isWin()) : (m.to == g_pickTo && m.build == sq);
+            if(done) {
+                g_clickMove = m;
+                g_clickedMove = true;
+                g_pickFrom = g_pickTo = NO_SQUARE;
+                return;
+            }
+            steps |= (g_pickTo == NO_SQUARE && m.to == sq);
+        }
+        if(steps) {
+            g_pickTo = sq;
+            return;
+        }
     }
-    else if(glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS && !cameraMoving) {
-        g_cameraSpinUp = true;
+    g_pickFrom = g_pickTo = NO_SQUARE;
+    for(int i = 0; i < moves.count && sq != NO_SQUARE; i++)
+        if(moves.moves[i].from == sq)
+            g_pickFrom = sq;
+}
+
+// Runs the command bound to each key event that arrived since the last
+// frame, and follows the mouse. Returns when the first event that did
+// something arrived, 0 if none did.
+int64_t processInput(GLFWwindow *window, InputQueue &input)
+{
+    int64_t firstUs = 0;
+    InputEvent event;
+    while(input.pop(event)) {
+        if(event.type == INPUT_CURSOR) {
+            g_cursorX = event.x;
+            g_cursorY = event.y;
+            g_cursorMoved = true;
+            continue;
+        }
+        if(event.type == INPUT_MOUSE_BUTTON) {
+            if(event.action != GLFW_PRESS || !g_mouseTurn)
+                continue;
+            if(event.code == GLFW_MOUSE_BUTTON_LEFT)
+                clickSquare(pickAt(window, event.x, event.y).square);
+            else
+                g_pickFrom = g_pickTo = NO_SQUARE;
+            if(!firstUs)
+                firstUs = event.timeUs;
+            continue;
+        }
+        if(event.action == GLFW_RELEASE)
+            continue;
+        for(size_t i = 0; i < sizeof(g_keyBindings) / sizeof(g_keyBindings[0]); i++) {
+            const KeyBinding &binding = g_keyBindings[i];
+            if(binding.key == event.code && (event.action == GLFW_PRESS || binding.repeat)) {
+                runCommand(window, binding.command);
+                if(!firstUs)
+                    firstUs = event.timeUs;
+            }
+        }
     }
-    else if(glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS && !cameraMoving) {
-        g_cameraSpinDown = true;
+    return firstUs;
+}
+
+// Takes the display options out of argv, wherever they are:
+// --present vsync|adaptive|uncapped, --low-latency (one frame in flight,
+// input read just before the frame is built) and --latency (report input
+// to swap and to GPU done times on exit). -1 on a bad option.
+static int takeDisplayOptions(int &argc, char **argv, PresentMode &present, bool &lowLatency, bool &latency)
+{
+    int kept = 1;
+    for(int i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "--present")) {
+            if(i + 1 >= argc || parsePresentMode(argv[++i], present)) {
+                std::cout<<"--present takes vsync, adaptive or uncapped"<<std::endl;
+                return -1;
+            }
+        }
+        else if(!strcmp(argv[i], "--low-latency"))
+            lowLatency = true;
+        else if(!strcmp(argv[i], "--latency"))
+            latency = true;
+        else
+            argv[kept++] = argv[i];
     }
+    argc = kept;
+    argv[argc] = NULL;
+    return 0;
+}
 
-    // Move player or make tower (SHOULD EVENTUALLY BE MOUSE INPUT)
-    else {
-        if(glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
-            g_updateTower = true;
-        if(glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
-            g_updatePlayer = true;
+// Plays a networked seat with the AI: starts a search when it is the seat's
+// turn and sends the move when the search is done
+static void playSeat(NetPlay &seat, AiPlayer &ai)
+{
+    if(seat.myTurn() && !ai.isThinking())
+        ai.beginMove(seat.shown);
+    SearchResult result;
+    if(ai.pollMove(result) && !result.best.isNull())
+        seat.play(result.best);
+}
+
+// Runs santorini_server on a Unix socket for --local; 0 if it did not start
+static pid_t startLocalServer(const char *path)
+{
+    char address[128];
+    snprintf(address, sizeof(address), "unix:%s", path);
+    unlink(path);
+    pid_t pid = fork();
+    if(pid == 0) {
+        execl(LOCAL_SERVER, LOCAL_SERVER, "--listen", address, "--report", "0", (char *)NULL);
+        _exit(127);
     }
+    if(pid < 0) {
+        std::cout<<"Failed to start "<<LOCAL_SERVER<<std::endl;
+        return 0;
+    }
+    for(int waited = 0; access(path, F_OK) && waited < LOCAL_START_WAIT_MS; waited += 10)
+        usleep(10000);
+    return pid;
 }
 
-int main()
+// santorini [position]: start from a position in the notation of notation.h,
+// e.g. santorini "00000/01200/00300/01000/00000 b2d4/d2b4 1 -"
+// santorini --puzzle file [n]: start from puzzle n (default 1) of a puzzle
+// file written by santorini_puzzles
+// santorini --host host:port: open a game on santorini_server and wait for
+// an opponent; santorini --join host:port id: take seat 2 of game `id`
+// santorini --local: play against the AI through a santorini_server started
+// on a local socket
+// Networked, moves are typed in the terminal ("b2-c3,c4"), or played by the
+// AI with a trailing --ai
+// Any of these may also take --present, --low-latency and --latency; see
+// takeDisplayOptions
+int main(int argc, char **argv)
 {
+    StartupReport startup;
+    PresentMode present = PRESENT_DEFAULT;
+    bool lowLatency = false;
+    bool latency = false;
+    if(takeDisplayOptions(argc, argv, present, lowLatency, latency))
+        return -1;
+    NetPlay *net = NULL;
+    NetPlay *localOpponent = NULL;
+    pid_t localServer = 0;
+    char localPath[64];
+    bool netAi = argc > 2 && !strcmp(argv[argc - 1], "--ai");
+    if(argc > 1 && (!strcmp(argv[1], "--host") || !strcmp(argv[1], "--join") || !strcmp(argv[1], "--local"))) {
+        net = new NetPlay();
+        int status = -1;
+        if(!strcmp(argv[1], "--local")) {
+            snprintf(localPath, sizeof(localPath), "/tmp/santorini-%d.sock", (int)getpid());
+            localServer = startLocalServer(localPath);
+            char address[80];
+            snprintf(address, sizeof(address), "unix:%s", localPath);
+            if(localServer && !net->host(address, !netAi)) {
+                for(int waited = 0; !net->gameId && waited < LOCAL_START_WAIT_MS; waited++) {
+                    net->update();
+                    usleep(1000);
+                }
+                localOpponent = new NetPlay();
+                status = net->gameId ? localOpponent->join(address, net->gameId) : -1;
+            }
+        }
+        else if(!strcmp(argv[1], "--host") && argc > 2)
+            status = net->host(argv[2], !netAi);
+        else if(!strcmp(argv[1], "--join") && argc > 3)
+            status = net->join(argv[2], (uint32_t)strtoul(argv[3], NULL, 10), !netAi);
+        if(status) {
+            std::cout<<"Failed to start a network game"<<std::endl;
+            if(localServer)
+                kill(localServer, SIGTERM);
+            return -1;
+        }
+        g_game = net->shown;
+    }
+    else if(argc > 1 && !strcmp(argv[1], "--puzzle")) {
+        Puzzle puzzle;
+        if(argc < 3 || loadPuzzle(argv[2], argc > 3 ? atoi(argv[3]) : 1, puzzle))
+            return -1;
+        g_game = puzzle.state;
+        // The human solves it, whichever side that is; the AI defends
+        g_aiPlayer = (g_game.toMove + 1) % g_game.numPlayers;
+        std::cout<<"Player "<<g_game.toMove + 1<<" to move and win in "<<puzzle.mate<<std::endl;
+    }
+    else if(argc > 1) {
+        if(parsePosition(argv[1], g_game)) {
+            std::cout<<"Failed to read position "<<argv[1]<<std::endl;
+            return -1;
+        }
+    }
+    else
+        g_game.reset(2);
+    startup.mark("options");
+
+    // Textures decode on the pool while the window and context come up
+    Assets assets;
+    assets.startDecoding();
+
     glfwInit();
+    startup.mark("glfwInit");
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -89,23 +393,53 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    startup.mark("create window");
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout<<"Failed to initialize GLAD"<<std::endl;
         return -1;
     }
+    startup.mark("load GL");
+    applyPresentMode(present);
     glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
 
     // Window resizing
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    InputQueue input;
+    input.attach(window);
+    FramePacer pacer(lowLatency ? 1 : 0, latency);
 
     glEnable(GL_DEPTH_TEST);
 
-    Board board(2);
+    assets.loadShaders();
+    startup.mark("compile shaders");
+    // The board texture fills most of the screen, so the first frame waits
+    // for it; towers and workers draw plain until theirs is in
+    assets.waitCritical();
+    startup.mark("board texture");
+    Board board(assets, g_game.numPlayers);
+    board.loadPosition(g_game);
+    g_picker.load(g_game);
+    startup.mark("build board");
+    bool firstFrame = true;
+    bool startupReported = false;
+    uint64_t shownHash = g_game.hash;
+    // The searchers' tables are large; the AI comes up once the first frame
+    // is shown and the solver on the first request for a proof
+    AiPlayer *ai = NULL;
+    AiPlayer *opponentAi = NULL;
+    uint64_t promptedHash = 0;
+    DfpnAnalyzer *analyzer = NULL;
+    uint64_t solvedHash = 0;
 
     // Render loop
+    TRACE_THREAD("render");
     while(!glfwWindowShouldClose(window))
     {
+        TRACE_ZONE("frame");
+        // Low latency mode waits here for the GPU to finish the last frame
+        pacer.beginFrame();
+        assets.update();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
@@ -114,10 +448,16 @@ int main()
         glClearColor(0.8f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // Inputs
-        processInput(window);
+        // Inputs. In low latency mode they are read only now, after the
+        // wait for the GPU, so they are as fresh as can be
+        if(lowLatency)
+            glfwPollEvents();
+        g_mouseTurn = net ? !netAi && net->myTurn() : g_game.toMove != g_aiPlayer && !g_game.isOver();
+        if(!g_mouseTurn)
+            g_pickFrom = g_pickTo = NO_SQUARE;
+        int64_t inputUs = processInput(window, input);
 
-        if(g_updateTower) {
+        for(; g_updateTower > 0; g_updateTower--) {
             board.updateTower(0,0);
             board.updateTower(1,1);
             board.updateTower(2,2);
@@ -125,6 +465,73 @@ int main()
             board.updateTower(4,4);
         }
 
+        // Networked, the game is whatever the server and our own move in
+        // flight say; the I/O thread fills the queues read here
+        if(net) {
+            net->update();
+            if(netAi && ai)
+                playSeat(*net, *ai);
+            else {
+                Move typed;
+                if(net->myTurn() && promptedHash != net->shown.hash) {
+                    promptedHash = net->shown.hash;
+                    std::cout<<"Your move (e.g. b2-c3,c4):"<<std::endl;
+                }
+                if(net->readMove(typed))
+                    net->play(typed);
+            }
+            if(localOpponent) {
+                localOpponent->update();
+                if(opponentAi)
+                    playSeat(*localOpponent, *opponentAi);
+            }
+            g_game = net->shown;
+        }
+
+        // A move clicked together on the board
+        if(g_clickedMove && g_mouseTurn) {
+            if(net)
+                net->play(g_clickMove);
+            else {
+                if(g_historyLength < MAX_HISTORY)
+                    g_history[g_historyLength++] = g_game;
+                g_game.apply(g_clickMove);
+                GameRecord::skipStuckPlayers(g_game);
+            }
+        }
+        g_clickedMove = false;
+
+        // Take back to the human's previous turn, dropping any AI search in flight
+        for(; g_undoMove > 0; g_undoMove--) {
+            if(!g_historyLength || net)
+                continue;
+            if(ai)
+                ai->cancel();
+            do {
+                g_game = g_history[--g_historyLength];
+            } while(g_game.toMove == g_aiPlayer && g_historyLength);
+        }
+
+        // The AI thinks on its own thread; only start it and poll it here
+        if(ai && !net && g_game.toMove == g_aiPlayer && !g_game.isOver() && g_game.hasMoves() && !ai->isThinking())
+            ai->beginMove(g_game);
+
+        SearchResult aiResult;
+        if(ai && ai->pollProgress(aiResult))
+            std::cout<<"AI depth "<<aiResult.depth<<" score "<<aiResult.score<<" nodes "<<aiResult.nodes<<std::endl;
+
+        if(ai && !net && ai->pollMove(aiResult) && !aiResult.best.isNull()) {
+            if(g_historyLength < MAX_HISTORY)
+                g_history[g_historyLength++] = g_game;
+            g_game.apply(aiResult.best);
+            GameRecord::skipStuckPlayers(g_game);
+        }
+
+        // Think on the human's time while they turn the board over
+        if((g_cameraSpinLeft || g_cameraSpinRight || g_cameraSpinUp || g_cameraSpinDown) &&
+           g_game.toMove != g_aiPlayer && !net && ai)
+            ai->opponentTurn(g_game);
+
         // Process camera movement
         if(g_cameraSpinLeft) {
             if(!g_birdsEye) {
@@ -170,15 +577,121 @@ int main()
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 model = glm::mat4(1.0f);
 
-        g_updateTower = false;
+        // Follow the game whenever it changes, moved workers hopping over
+        bool changed = g_game.hash != shownHash;
+        if(changed) {
+            board.loadPosition(g_game, true);
+            g_picker.load(g_game);
+            g_pickFrom = g_pickTo = NO_SQUARE;
+            shownHash = g_game.hash;
+        }
+        board.advance(deltaTime);
+
+        // What is under the mouse, again whenever it or the board moved
+        g_view = view;
+        g_projection = projection;
+        bool cameraMoving = g_cameraSpinLeft || g_cameraSpinRight || g_cameraSpinUp || g_cameraSpinDown;
+        if(g_cursorMoved || changed || cameraMoving) {
+            PickResult hover = pickAt(window, g_cursorX, g_cursorY);
+            board.setHover(hover.square, hover.player, hover.worker);
+            g_cursorMoved = false;
+        }
+        int pickPlayer = -1, pickWorker = -1;
+        for(int p = 0; p < g_game.numPlayers && g_pickFrom != NO_SQUARE; p++)
+            for(int w = 0; w < WORKERS_PER_PLAYER; w++)
+                if(g_game.workers[p][w] == g_pickFrom) {
+                    pickPlayer = p;
+                    pickWorker = w;
+                }
+        board.setSelection(((g_pickFrom != NO_SQUARE) ? 1u << g_pickFrom : 0) |
+                           ((g_pickTo != NO_SQUARE) ? 1u << g_pickTo : 0), pickPlayer, pickWorker);
+
+        // Prove the shown position won or lost in the background
+        if(g_solvePosition && !analyzer)
+            analyzer = new DfpnAnalyzer(SOLVE_HASH_MB);
+        if(g_solvePosition && !analyzer->isBusy() && solvedHash != g_game.hash) {
+            solvedHash = g_game.hash;
+            analyzer->start(g_game, SOLVE_TIME_MS);
+        }
+        GameState solved;
+        DfpnReport proof;
+        if(analyzer && analyzer->poll(solved, proof)) {
+            if(proof.result == DFPN_UNKNOWN)
+                std::cout<<"Position not proven after "<<proof.nodes<<" nodes"<<std::endl;
+            else
+                std::cout<<"Position is a proven "<<dfpnResultName(proof.result)<<" for player "<<solved.toMove + 1
+                         <<" ("<<proof.nodes<<" nodes, proof tree "<<proof.proofSize<<", "<<proof.timeMs<<" ms)"<<std::endl;
+            if(solved.hash == g_game.hash && proof.result != DFPN_UNKNOWN)
+                board.setAnnotation(proof.result == DFPN_WIN ? PROVEN_WIN_TINT : PROVEN_LOSS_TINT);
+        }
+
         g_updatePlayer = false;
+        g_solvePosition = false;
         board.drawBoard(model, view, projection);
 
         // Check for events and swap buffers
-        glfwPollEvents();
+        if(!lowLatency)
+            glfwPollEvents();
         glfwSwapBuffers(window);
+        pacer.endFrame(inputUs);
+
+        // Report once the first frame is up and every texture is in
+        if(!startupReported) {
+            if(firstFrame) {
+                startup.mark("first frame");
+                // Both evaluate with the trained network when it is there
+                ai = new AiPlayer();
+                ai->loadNetwork(NNUE_DEFAULT_PATH);
+                if(localOpponent) {
+                    opponentAi = new AiPlayer(AI_MOVE_TIME_MS, false, LOCAL_OPPONENT_TT_MB);
+                    opponentAi->loadNetwork(NNUE_DEFAULT_PATH);
+                }
+                startup.mark("AI players");
+                firstFrame = false;
+            }
+            if(assets.ready()) {
+                startup.mark("remaining textures");
+                assets.reportDecoding(startup);
+                startup.print();
+                startupReported = true;
+            }
+        }
     }
 
+    if(ai) {
+        ai->cancel();
+        ai->printStats();
+    }
+    if(analyzer) {
+        analyzer->cancel();
+        delete analyzer;
+    }
+    if(latency)
+        pacer.printStats();
+    if(input.droppedEvents())
+        std::cout<<"Dropped "<<input.droppedEvents()<<" input events"<<std::endl;
+#ifdef SANTORINI_TRACE
+    if(!TRACE_SAVE(TRACE_FILE))
+        std::cout<<"Trace written to "<<TRACE_FILE<<std::endl;
+#endif
+    if(net) {
+        net->leave();
+        delete net;
+    }
+    if(localOpponent) {
+        if(opponentAi)
+            opponentAi->cancel();
+        localOpponent->leave();
+        delete localOpponent;
+        delete opponentAi;
+    }
+    delete ai;
+    if(localServer) {
+        kill(localServer, SIGTERM);
+        waitpid(localServer, NULL, 0);
+        unlink(localPath);
+    }
+    pacer.release();
     glfwTerminate();
 
     return 0;
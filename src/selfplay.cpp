@@ -0,0 +1,330 @@
+// Self-play game generator for training data and opening books. Games run
+// as tasks on a work-stealing pool, one search per pool thread; finished
+// games go through a lock-free queue to a single writer thread that appends
+// them to a game record file. Rerunning with the same output file resumes:
+// complete games already there are kept (a game cut off mid-write is
+// dropped) and generation carries on up to --games.
+//
+//   santorini_selfplay [--games N] [--players 2-4] [--depth D | --time-ms T]
+//                      [--threads N] [--random-plies N] [--hash MB]
+//                      [--network file] [--report seconds] [--out file]
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<time.h>
+#include<unistd.h>
+#include<atomic>
+#include<chrono>
+#include<functional>
+#include<memory>
+#include<thread>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"search.h"
+#include"multi_search.h"
+#include"nnue.h"
+#include"mpmc_queue.h"
+#include"thread_pool.h"
+#include"transposition.h"
+
+#define QUEUE_CAPACITY 256
+#define MAX_GAME_PLIES RECORD_MAX_PLIES
+
+struct Options
+{
+    int64_t games;
+    int players;
+    int depth;
+    int64_t timeMs;
+    int threads;
+    int randomPlies;
+    int hashMB;
+    int reportSeconds;
+    const char *network;
+    const char *out;
+};
+
+// Everything one pool thread needs to play a game
+struct WorkerContext
+{
+    TranspositionTable tt;
+    Search search;
+    MultiSearch multi;
+
+    WorkerContext(int hashMB) : tt(hashMB), search(tt), multi(tt) {}
+};
+
+static volatile sig_atomic_t g_interrupted = 0;
+
+// First signal: finish the games in progress and exit cleanly. Second: exit now,
+// the next run drops whatever game was half written.
+static void onSignal(int)
+{
+    if(g_interrupted)
+        _exit(1);
+    g_interrupted = 1;
+}
+
+static uint64_t splitMix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static int parseOptions(int argc, char **argv, Options &o)
+{
+    o.games = 1000;
+    o.players = 2;
+    o.depth = 4;
+    o.timeMs = 0;
+    o.threads = 0;
+    o.randomPlies = 4;
+    o.hashMB = TT_DEFAULT_MB;
+    o.reportSeconds = 10;
+    o.network = NULL;
+    o.out = "selfplay.sgr";
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(!value) {
+            printf("Missing value for %s\n", arg);
+            return -1;
+        }
+        i++;
+        if(!strcmp(arg, "--games")) o.games = atoll(value);
+        else if(!strcmp(arg, "--players")) o.players = atoi(value);
+        else if(!strcmp(arg, "--depth")) { o.depth = atoi(value); o.timeMs = 0; }
+        else if(!strcmp(arg, "--time-ms")) { o.timeMs = atoll(value); o.depth = 0; }
+        else if(!strcmp(arg, "--threads")) o.threads = atoi(value);
+        else if(!strcmp(arg, "--random-plies")) o.randomPlies = atoi(value);
+        else if(!strcmp(arg, "--hash")) o.hashMB = atoi(value);
+        else if(!strcmp(arg, "--network")) o.network = value;
+        else if(!strcmp(arg, "--report")) o.reportSeconds = atoi(value);
+        else if(!strcmp(arg, "--out")) o.out = value;
+        else {
+            printf("Unknown option %s\n", arg);
+            return -1;
+        }
+    }
+    if(o.players < 2 || o.players > MAX_PLAYERS || (o.depth <= 0 && o.timeMs <= 0)) {
+        printf("Need 2-%d players and a positive --depth or --time-ms\n", MAX_PLAYERS);
+        return -1;
+    }
+    return 0;
+}
+
+// Opens `path` for appending games, creating it if needed. Counts the complete
+// games already there and cuts off a partly written one at the end.
+static FILE *openForResume(const char *path, int64_t &existing)
+{
+    existing = 0;
+    FILE *f = fopen(path, "r+b");
+    if(!f) {
+        f = fopen(path, "w+b");
+        if(!f || GameRecord::writeFileHeader(f)) {
+            printf("Failed to create %s\n", path);
+            if(f)
+                fclose(f);
+            return NULL;
+        }
+        return f;
+    }
+
+    if(GameRecord::readFileHeader(f)) {
+        printf("%s is not a game record file\n", path);
+        fclose(f);
+        return NULL;
+    }
+
+    static GameRecord record;
+    long good = ftell(f);
+    int status;
+    while((status = record.read(f)) == 1) {
+        existing++;
+        good = ftell(f);
+    }
+    if(status < 0) {
+        printf("Dropping a partly written game at byte %ld\n", good);
+        fflush(f);
+        if(ftruncate(fileno(f), good)) {
+            printf("Failed to truncate %s\n", path);
+            fclose(f);
+            return NULL;
+        }
+    }
+    fseek(f, good, SEEK_SET);
+    return f;
+}
+
+// A few random non-winning turns so games don't all repeat
+static void randomOpening(GameState &state, GameRecord &record, uint64_t &rng, int plies)
+{
+    for(int i = 0; i < plies && !state.isOver(); i++) {
+        MoveList moves;
+        state.generateMoves(moves);
+        int nonWinning = 0;
+        for(int j = 0; j < moves.count; j++)
+            if(!moves.moves[j].isWin())
+                moves.moves[nonWinning++] = moves.moves[j];
+        if(!nonWinning)
+            return;
+        rng = splitMix(rng);
+        const Move &m = moves.moves[rng % nonWinning];
+        record.push(m);
+        state.apply(m);
+    }
+}
+
+static uint64_t playGame(WorkerContext &ctx, const Options &o, uint64_t seed, GameRecord &record)
+{
+    SearchLimits limits = o.timeMs ? SearchLimits::timed(o.timeMs) : SearchLimits::fixedDepth(o.depth);
+    GameState state;
+    state.reset(o.players);
+    record.clear(o.players);
+    ctx.tt.clear();
+
+    uint64_t rng = seed;
+    randomOpening(state, record, rng, o.randomPlies);
+
+    uint64_t nodes = 0;
+    while(!state.isOver() && record.plies < MAX_GAME_PLIES) {
+        if(!state.hasMoves()) {
+            state.eliminate();
+            continue;
+        }
+        SearchResult r = (o.players == 2) ? ctx.search.think(state, limits) : ctx.multi.think(state, limits);
+        nodes += r.nodes;
+        record.push(r.best);
+        state.apply(r.best);
+    }
+    record.winner = state.winner;
+    return nodes;
+}
+
+int main(int argc, char **argv)
+{
+    Options o;
+    if(parseOptions(argc, argv, o))
+        return 1;
+
+    static NnueNetwork network;
+    if(o.network && network.load(o.network))
+        return 1;
+
+    int64_t existing;
+    FILE *out = openForResume(o.out, existing);
+    if(!out)
+        return 1;
+    if(existing >= o.games) {
+        printf("%s already holds %lld games\n", o.out, (long long)existing);
+        fclose(out);
+        return 0;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    ThreadPool pool(o.threads);
+    std::vector<std::unique_ptr<WorkerContext>> contexts;
+    for(int i = 0; i < pool.size(); i++) {
+        contexts.push_back(std::unique_ptr<WorkerContext>(new WorkerContext(o.hashMB)));
+        if(o.network)
+            contexts.back()->search.setNetwork(&network);
+    }
+    printf("%s: %lld games to play on %d threads (%lld already done)\n", o.out,
+           (long long)(o.games - existing), pool.size(), (long long)existing);
+
+    // Seeds differ per run so a resumed run never replays the same games
+    uint64_t runSeed = splitMix((uint64_t)time(NULL) ^ ((uint64_t)existing << 32));
+    MpmcQueue<GameRecord> queue(QUEUE_CAPACITY);
+    std::atomic<int64_t> nextGame(existing);
+    std::atomic<uint64_t> totalNodes(0);
+    std::atomic<bool> writerDone(false);
+
+    // Writer: the only thread touching the file
+    std::atomic<int64_t> written(0), writtenPlies(0), unfinished(0);
+    std::atomic<int64_t> seatWins[MAX_PLAYERS];
+    for(int p = 0; p < MAX_PLAYERS; p++)
+        seatWins[p] = 0;
+    bool writeFailed = false;
+    std::thread writer([&] {
+        static GameRecord record;
+        for(;;) {
+            // Read before popping: once the pool is idle every game is
+            // queued, so an empty queue after that means there are no more
+            bool done = writerDone;
+            if(!queue.pop(record)) {
+                fflush(out);
+                if(done)
+                    return;
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            if(!writeFailed && record.write(out)) {
+                printf("Failed to write to %s\n", o.out);
+                writeFailed = true;
+                g_interrupted = 1;
+            }
+            if(record.winner == NO_PLAYER)
+                unfinished++;
+            else
+                seatWins[record.winner]++;
+            writtenPlies += record.plies;
+            written++;
+        }
+    });
+
+    // Each task plays one game, then queues the next on its own thread's deque
+    std::function<void()> task = [&] {
+        int64_t index = nextGame.fetch_add(1);
+        if(index >= o.games || g_interrupted)
+            return;
+        static thread_local GameRecord record;
+        totalNodes += playGame(*contexts[pool.currentIndex()], o, splitMix(runSeed + index), record);
+        while(!queue.push(record))
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        pool.submit(task);
+    };
+    for(int i = 0; i < pool.size(); i++)
+        pool.submit(task);
+
+    int64_t start = nowMs(), lastReport = start;
+    std::thread waiter([&] { pool.waitIdle(); writerDone = true; });
+    while(!writerDone) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        int64_t now = nowMs();
+        if(o.reportSeconds > 0 && now - lastReport >= o.reportSeconds * 1000LL) {
+            lastReport = now;
+            double hours = (now - start) / 3600000.0;
+            printf("%lld / %lld games, %.0f games/hour, %.0f nodes/s%s\n",
+                   (long long)(existing + written), (long long)o.games,
+                   hours > 0 ? written / hours : 0.0, (now > start) ? totalNodes * 1000.0 / (now - start) : 0.0,
+                   g_interrupted ? ", stopping" : "");
+            fflush(stdout);
+        }
+    }
+    waiter.join();
+    writer.join();
+
+    int64_t elapsed = nowMs() - start;
+    double hours = elapsed / 3600000.0;
+    printf("%lld games this run in %.1f s: %.0f games/hour, %.1f plies/game, %lld unfinished\n",
+           (long long)written.load(), elapsed / 1000.0, hours > 0 ? written / hours : 0.0,
+           written ? (double)writtenPlies / written : 0.0, (long long)unfinished.load());
+    printf("wins by seat:");
+    for(int p = 0; p < o.players; p++)
+        printf(" %lld", (long long)seatWins[p].load());
+    printf("\n");
+    if(g_interrupted)
+        printf("Interrupted; rerun with the same --out to resume\n");
+
+    fclose(out);
+    return writeFailed ? 1 : 0;
+}
@@ -0,0 +1,779 @@
+// Game server: holds many two player games in memory and serves them over
+// TCP or Unix sockets from one epoll event loop. Moves are checked with the
+// rules engine's move generator. Line protocol, one command per line:
+//
+//   create                  open a game and take seat 1; "game <id> seat 1"
+//   join <id>               take seat 2; "game <id> seat 2", then both
+//                           players get "start <position>"
+//   move <m>                play a move on your turn; both players get
+//                           "move <seat> <m>", and "over <seat>" with the
+//                           winner's seat when the game ends
+//   resign                  leave the game; the opponent gets "over <seat> resign"
+//   watch <id>              spectate; "watching <id>" and "position <text>",
+//                           then the game's "move" and "over" lines
+//   unwatch                 stop spectating
+//   position                "position <text>" for your game
+//   ping                    "pong"
+//   quit
+//
+// Positions use notation.h and moves are "b2-c3,b4" or "b2-c3#". Bad
+// commands answer "error <why>" and change nothing. A player who drops
+// loses the game ("over <seat> disconnect" to the opponent).
+//
+// Each move is formatted once into a shared buffer that every player and
+// spectator connection queues by reference. A spectator whose unsent output
+// passes SPECTATOR_BACKLOG stops getting moves: what it has not started
+// receiving is dropped, and once its socket drains it gets a fresh
+// "position" line (at most one per SNAPSHOT_INTERVAL_MS) and live moves
+// again. Slow spectators so cost a bounded amount of memory and never hold
+// up the game.
+//
+//   santorini_server [--listen host:port | --listen unix:/path]... [--report seconds]
+//                    [--metrics host:port]
+//
+// The report line gives open connections, games and spectators, moves per
+// second and the time spent handling each move, from reading its line to
+// queueing the replies.
+//
+// With --metrics, an HTTP GET of /metrics on that address returns counters,
+// gauges and histograms (move validation and handling time, ready events
+// per wakeup, output queue depth, bytes sent) as Prometheus text. SIGUSR1
+// prints the same text to stdout. Recording goes into metrics.h shards and
+// costs a few stores; the text is only built when asked for.
+
+#include<stdarg.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<signal.h>
+#include<time.h>
+#include<sys/epoll.h>
+#include<string>
+#include<vector>
+
+#include"game_state.h"
+#include"game_record.h"
+#include"notation.h"
+#include"net.h"
+#include"metrics.h"
+
+#define DEFAULT_LISTEN   "127.0.0.1:7878"
+#define MAX_EVENTS       256
+#define NO_GAME          0
+#define GAME_SLOT_BITS   20         // low bits of a game id; the rest counts reuse of the slot
+#define MAX_GAMES        (1 << GAME_SLOT_BITS)
+#define REPLY_MAX        (POSITION_TEXT_MAX + 32)
+#define SPECTATOR_BACKLOG    16384  // unsent bytes before a spectator falls back to snapshots
+#define SNAPSHOT_INTERVAL_MS 1000
+
+static volatile sig_atomic_t g_interrupted = 0;
+static volatile sig_atomic_t g_dumpMetrics = 0;
+
+static void onSignal(int)
+{
+    g_interrupted = 1;
+}
+
+static void onDumpSignal(int)
+{
+    g_dumpMetrics = 1;
+}
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+struct Client
+{
+    LineConnection conn;
+    uint32_t game;          // NO_GAME in the lobby
+    uint8_t seat;           // 0 or 1 while in a game
+    bool spectating;        // `game` is watched, not played
+    bool lagging;           // spectator skipping moves until its next snapshot
+    bool closing;           // close once the current read has been handled
+    bool dirty;             // has output queued since the last flush
+    bool watchingOutput;    // registered for EPOLLOUT because the socket was full
+    bool http;              // a metrics request, not a player
+    int httpStatus;         // 0 until the request line is read
+    bool closeWhenFlushed;
+    int64_t lastSnapshotNs;
+
+    Client(int fd) : conn(fd), game(NO_GAME), seat(0), spectating(false), lagging(false), closing(false),
+                     dirty(false), watchingOutput(false), http(false), httpStatus(0), closeWhenFlushed(false),
+                     lastSnapshotNs(0) {}
+};
+
+struct Game
+{
+    GameState state;
+    uint32_t id;            // the slot's latest id; a finished game's id stays until reuse
+    bool active;
+    int seats[2];           // client fds, -1 for an empty seat
+    std::vector<int> spectators;
+};
+
+struct ServerStats
+{
+    int64_t moves;
+    int64_t moveNs;
+    int64_t maxMoveNs;
+    int64_t gamesStarted;
+    int64_t gamesFinished;
+    int64_t broadcastBytes;     // bytes queued to all connections by reference
+    int64_t laggedSpectators;   // times a spectator fell back to snapshots
+    int64_t snapshots;
+};
+
+// Ids of the server's metrics in its Metrics table
+struct MetricIds
+{
+    int moves, gamesStarted, gamesFinished, snapshots, laggedSpectators, bytesSent, scrapes;
+    int connections, games, spectators, lagging;
+    int validateNs, moveNs, eventsPerWake, outputQueueBytes;
+};
+
+class Server
+{
+    int epfd;
+    std::vector<int> listeners;
+    int metricsListener;
+    std::vector<Client *> clients;      // by fd
+    std::vector<int> dirty;
+    std::vector<int> lagging;           // spectators waiting for a snapshot
+    std::vector<Game> games;
+    std::vector<uint32_t> freeSlots;
+    int connections;
+    int activeGames;
+    int spectators;
+
+public:
+    ServerStats stats;
+    Metrics metrics;
+    MetricIds ids;
+
+    Server() : epfd(-1), metricsListener(-1), connections(0), activeGames(0), spectators(0) {
+        memset(&stats, 0, sizeof(stats));
+        ids.moves = metrics.counter("santorini_moves_total", "Moves played");
+        ids.gamesStarted = metrics.counter("santorini_games_started_total", "Games with both seats taken");
+        ids.gamesFinished = metrics.counter("santorini_games_finished_total", "Games won, resigned or abandoned");
+        ids.snapshots = metrics.counter("santorini_snapshots_total", "Positions sent to lagging spectators");
+        ids.laggedSpectators = metrics.counter("santorini_spectator_lags_total",
+                                               "Times a spectator fell behind and lost live moves");
+        ids.bytesSent = metrics.counter("santorini_bytes_sent_total", "Bytes written to sockets");
+        ids.scrapes = metrics.counter("santorini_metrics_requests_total", "Metrics requests served");
+        ids.connections = metrics.gauge("santorini_connections", "Open connections");
+        ids.games = metrics.gauge("santorini_active_games", "Games open or in progress");
+        ids.spectators = metrics.gauge("santorini_spectators", "Spectator connections");
+        ids.lagging = metrics.gauge("santorini_lagging_spectators", "Spectators waiting for a snapshot");
+        ids.validateNs = metrics.histogram("santorini_move_validation_seconds",
+                                           "Time to parse a move and check it is legal", 1e-9, 100, 10000000);
+        ids.moveNs = metrics.histogram("santorini_move_seconds",
+                                       "Time to handle a move, from its line to queued replies", 1e-9, 100, 10000000);
+        ids.eventsPerWake = metrics.histogram("santorini_ready_events", "Ready sockets per event loop wakeup",
+                                              1.0, 1, MAX_EVENTS);
+        ids.outputQueueBytes = metrics.histogram("santorini_output_queue_bytes",
+                                                 "Bytes left queued on a connection after writing", 1.0, 1, 10000000);
+    }
+
+    ~Server() {
+        for(size_t fd = 0; fd < clients.size(); fd++)
+            if(clients[fd])
+                closeClient(fd);
+        for(size_t i = 0; i < listeners.size(); i++)
+            close(listeners[i]);
+        if(epfd >= 0)
+            close(epfd);
+    }
+
+    int init(void) {
+        epfd = epoll_create1(0);
+        if(epfd < 0) {
+            printf("Failed to create an epoll instance: %s\n", strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    int listen(const char *address) {
+        int fd = listenOn(address);
+        if(fd < 0)
+            return -1;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        listeners.push_back(fd);
+        printf("Listening on %s\n", address);
+        return 0;
+    }
+
+    // Serves Prometheus text over HTTP on `address`
+    int listenMetrics(const char *address) {
+        if(listen(address))
+            return -1;
+        metricsListener = listeners.back();
+        return 0;
+    }
+
+    // All metrics as Prometheus text
+    void formatMetrics(std::string &out) {
+        metrics.set(ids.moves, stats.moves);
+        metrics.set(ids.gamesStarted, stats.gamesStarted);
+        metrics.set(ids.gamesFinished, stats.gamesFinished);
+        metrics.set(ids.snapshots, stats.snapshots);
+        metrics.set(ids.laggedSpectators, stats.laggedSpectators);
+        metrics.set(ids.connections, connections);
+        metrics.set(ids.games, activeGames);
+        metrics.set(ids.spectators, spectators);
+        metrics.set(ids.lagging, (int64_t)lagging.size());
+        metrics.format(out);
+    }
+
+    int connectionCount(void) const {
+        return connections;
+    }
+
+    int gameCount(void) const {
+        return activeGames;
+    }
+
+    int spectatorCount(void) const {
+        return spectators;
+    }
+
+    int laggingCount(void) const {
+        return (int)lagging.size();
+    }
+
+    // Handles events for up to `timeoutMs`
+    void poll(int timeoutMs) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeoutMs);
+        if(n > 0)
+            metrics.record(ids.eventsPerWake, n);
+        for(int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if(isListener(fd)) {
+                acceptAll(fd);
+                continue;
+            }
+            Client *c = (fd < (int)clients.size()) ? clients[fd] : NULL;
+            if(!c)
+                continue;
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                if(c->conn.receive([this, c](char *line, size_t) {
+                        if(c->http)
+                            handleHttp(*c, line);
+                        else
+                            handle(*c, line);
+                    }))
+                    c->closing = true;
+            }
+            if((events[i].events & EPOLLOUT) && !c->dirty) {
+                c->dirty = true;
+                dirty.push_back(fd);
+            }
+            if(c->closing)
+                closeClient(fd);
+        }
+        flushDirty();
+        if(sendSnapshots())
+            flushDirty();
+    }
+
+private:
+    bool isListener(int fd) const {
+        for(size_t i = 0; i < listeners.size(); i++)
+            if(listeners[i] == fd)
+                return true;
+        return false;
+    }
+
+    void acceptAll(int listener) {
+        for(;;) {
+            int fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK);
+            if(fd < 0) {
+                if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    printf("accept failed: %s\n", strerror(errno));
+                return;
+            }
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            if(fd >= (int)clients.size())
+                clients.resize(fd + 1, NULL);
+            clients[fd] = new Client(fd);
+            clients[fd]->http = listener == metricsListener;
+            connections++;
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+
+    void closeClient(int fd) {
+        Client *c = clients[fd];
+        if(c->spectating)
+            unwatch(*c);
+        else if(c->game != NO_GAME) {
+            Game *g = findGame(c->game);
+            if(g && g->seats[1 - c->seat] >= 0)
+                finishGame(*g, 1 - c->seat, "disconnect");
+            else if(g)
+                releaseGame(*g);
+        }
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+        close(fd);
+        delete c;
+        clients[fd] = NULL;
+        connections--;
+    }
+
+    // Writes what each client has queued, and watches for writability only
+    // while a client's socket is full
+    void flushDirty(void) {
+        for(size_t i = 0; i < dirty.size(); i++) {
+            int fd = dirty[i];
+            Client *c = clients[fd];
+            if(!c)
+                continue;
+            c->dirty = false;
+            size_t queued = c->conn.pendingBytes();
+            int status = c->conn.flush();
+            if(status < 0) {
+                closeClient(fd);
+                continue;
+            }
+            metrics.add(ids.bytesSent, queued - c->conn.pendingBytes());
+            metrics.record(ids.outputQueueBytes, c->conn.pendingBytes());
+            if(status == 0 && c->closeWhenFlushed) {
+                closeClient(fd);
+                continue;
+            }
+            if(c->watchingOutput != (status > 0)) {
+                c->watchingOutput = status > 0;
+                struct epoll_event ev;
+                ev.events = c->watchingOutput ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+                ev.data.fd = fd;
+                epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+            }
+        }
+        dirty.clear();
+    }
+
+    __attribute__((format(printf, 3, 4)))
+    void reply(Client &c, const char *format, ...) {
+        char line[REPLY_MAX];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(line, sizeof(line) - 1, format, args);
+        va_end(args);
+        if(n < 0)
+            return;
+        if(n > (int)sizeof(line) - 2)
+            n = sizeof(line) - 2;
+        line[n++] = '\n';
+        c.conn.queue(line, n);
+        markDirty(c);
+    }
+
+    void markDirty(Client &c) {
+        if(!c.dirty) {
+            c.dirty = true;
+            dirty.push_back(c.conn.fd);
+        }
+    }
+
+    // Queues one line to both players and every spectator without copying it
+    void broadcast(Game &g, const char *line, int length) {
+        SharedBytes bytes = makeShared(line, length);
+        for(int s = 0; s < 2; s++)
+            if(g.seats[s] >= 0) {
+                Client &c = *clients[g.seats[s]];
+                c.conn.queueShared(bytes);
+                markDirty(c);
+            }
+        for(size_t i = 0; i < g.spectators.size(); i++) {
+            Client &c = *clients[g.spectators[i]];
+            if(c.lagging)
+                continue;
+            if(c.conn.pendingBytes() > SPECTATOR_BACKLOG) {
+                c.conn.dropUnsent();
+                c.lagging = true;
+                lagging.push_back(c.conn.fd);
+                stats.laggedSpectators++;
+                continue;
+            }
+            c.conn.queueShared(bytes);
+            markDirty(c);
+        }
+        stats.broadcastBytes += (int64_t)length * (2 + g.spectators.size());
+    }
+
+    // Lagging spectators whose sockets have drained get the current position
+    // and rejoin the live moves. Returns how many were sent.
+    int sendSnapshots(void) {
+        int sent = 0;
+        int64_t now = nowNs();
+        size_t kept = 0;
+        for(size_t i = 0; i < lagging.size(); i++) {
+            int fd = lagging[i];
+            Client *c = clients[fd];
+            if(!c || !c->lagging)
+                continue;
+            Game *g = findGame(c->game);
+            if(c->conn.hasOutput() || now - c->lastSnapshotNs < SNAPSHOT_INTERVAL_MS * 1000000LL || !g) {
+                lagging[kept++] = fd;
+                continue;
+            }
+            c->lagging = false;
+            c->lastSnapshotNs = now;
+            sendPosition(*c, *g);
+            stats.snapshots++;
+            sent++;
+        }
+        lagging.resize(kept);
+        return sent;
+    }
+
+    void sendPosition(Client &c, const Game &g) {
+        char text[POSITION_TEXT_MAX];
+        formatPosition(g.state, text, sizeof(text));
+        reply(c, "position %s", text);
+    }
+
+    Game *findGame(uint32_t id) {
+        uint32_t slot = id & (MAX_GAMES - 1);
+        if(id == NO_GAME || slot >= games.size() || games[slot].id != id || !games[slot].active)
+            return NULL;
+        return &games[slot];
+    }
+
+    Game *newGame(void) {
+        uint32_t slot;
+        if(!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            if(games.size() >= MAX_GAMES)
+                return NULL;
+            slot = games.size();
+            games.push_back(Game());
+            games.back().id = NO_GAME;
+        }
+        Game &g = games[slot];
+        // Bump the reuse count so ids of finished games never match again
+        uint32_t reuse = (g.id >> GAME_SLOT_BITS) + 1;
+        g.id = (reuse << GAME_SLOT_BITS) | slot;
+        if(g.id == NO_GAME)
+            g.id = (1u << GAME_SLOT_BITS) | slot;
+        g.state.reset(2);
+        g.active = true;
+        g.seats[0] = g.seats[1] = -1;
+        g.spectators.clear();
+        activeGames++;
+        return &g;
+    }
+
+    void releaseGame(Game &g) {
+        for(int s = 0; s < 2; s++)
+            if(g.seats[s] >= 0)
+                clients[g.seats[s]]->game = NO_GAME;
+        for(size_t i = 0; i < g.spectators.size(); i++) {
+            Client &c = *clients[g.spectators[i]];
+            c.game = NO_GAME;
+            c.spectating = false;
+            c.lagging = false;
+        }
+        spectators -= (int)g.spectators.size();
+        g.spectators.clear();
+        freeSlots.push_back(g.id & (MAX_GAMES - 1));
+        g.active = false;
+        activeGames--;
+    }
+
+    void finishGame(Game &g, int winner, const char *reason) {
+        // Lagging spectators get the final position first, so they end in step
+        for(size_t i = 0; i < g.spectators.size(); i++) {
+            Client &c = *clients[g.spectators[i]];
+            if(c.lagging) {
+                c.conn.dropUnsent();
+                c.lagging = false;
+                sendPosition(c, g);
+            }
+        }
+        char line[REPLY_MAX];
+        int n = snprintf(line, sizeof(line), "over %d%s%s\n", winner + 1, reason ? " " : "", reason ? reason : "");
+        broadcast(g, line, n);
+        stats.gamesFinished++;
+        releaseGame(g);
+    }
+
+    // A minimal HTTP/1.0 exchange: the request line picks the answer, which
+    // goes out after the blank line ending the headers, then the
+    // connection closes
+    void handleHttp(Client &c, char *line) {
+        if(!c.httpStatus) {
+            c.httpStatus = (!strncmp(line, "GET /metrics ", 13) || !strncmp(line, "GET / ", 6)) ? 200 : 404;
+            return;
+        }
+        if(*line || c.closeWhenFlushed)
+            return;
+        std::string body;
+        if(c.httpStatus == 200) {
+            metrics.add(ids.scrapes);
+            formatMetrics(body);
+        }
+        else
+            body = "Not found\n";
+        char header[160];
+        int n = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                         "Connection: close\r\n\r\n", c.httpStatus == 200 ? "200 OK" : "404 Not Found",
+                         c.httpStatus == 200 ? "text/plain; version=0.0.4" : "text/plain", body.size());
+        c.conn.queue(header, n);
+        c.conn.queue(body.data(), body.size());
+        c.closeWhenFlushed = true;
+        markDirty(c);
+    }
+
+    void handle(Client &c, char *line) {
+        char *p = line;
+        while(*p == ' ' || *p == '\t')
+            p++;
+        char *args = p + strcspn(p, " \t");
+        if(*args)
+            *args++ = 0;
+        while(*args == ' ' || *args == '\t')
+            args++;
+
+        if(!strcmp(p, "move"))
+            move(c, args);
+        else if(!strcmp(p, "create"))
+            create(c);
+        else if(!strcmp(p, "join"))
+            join(c, args);
+        else if(!strcmp(p, "resign"))
+            resign(c);
+        else if(!strcmp(p, "watch"))
+            watch(c, args);
+        else if(!strcmp(p, "unwatch"))
+            unwatch(c);
+        else if(!strcmp(p, "position"))
+            position(c);
+        else if(!strcmp(p, "ping"))
+            reply(c, "pong");
+        else if(!strcmp(p, "quit"))
+            c.closing = true;
+        else if(*p)
+            reply(c, "error unknown command %.32s", p);
+    }
+
+    void create(Client &c) {
+        if(c.game != NO_GAME) {
+            reply(c, "error already in a game");
+            return;
+        }
+        Game *g = newGame();
+        if(!g) {
+            reply(c, "error server full");
+            return;
+        }
+        g->seats[0] = c.conn.fd;
+        c.game = g->id;
+        c.seat = 0;
+        reply(c, "game %u seat 1", g->id);
+    }
+
+    void join(Client &c, const char *args) {
+        if(c.game != NO_GAME) {
+            reply(c, "error already in a game");
+            return;
+        }
+        Game *g = findGame((uint32_t)strtoul(args, NULL, 10));
+        if(!g || g->seats[1] >= 0) {
+            reply(c, "error no open game %.16s", args);
+            return;
+        }
+        g->seats[1] = c.conn.fd;
+        c.game = g->id;
+        c.seat = 1;
+        reply(c, "game %u seat 2", g->id);
+        stats.gamesStarted++;
+
+        char line[REPLY_MAX];
+        int n = sprintf(line, "start ");
+        n += formatPosition(g->state, line + n, sizeof(line) - n);
+        line[n++] = '\n';
+        broadcast(*g, line, n);
+    }
+
+    void move(Client &c, const char *args) {
+        int64_t start = nowNs();
+        Game *g = findGame(c.game);
+        if(!g || g->seats[1] < 0 || c.spectating) {
+            reply(c, "error not in a started game");
+            return;
+        }
+        if(g->state.toMove != c.seat) {
+            reply(c, "error not your turn");
+            return;
+        }
+        Move m;
+        const char *end;
+        bool illegal = parseMove(g->state, args, m, &end) || *end;
+        metrics.record(ids.validateNs, nowNs() - start);
+        if(illegal) {
+            reply(c, "error illegal move %.16s", args);
+            return;
+        }
+        g->state.apply(m);
+        GameRecord::skipStuckPlayers(g->state);
+
+        char line[24];
+        char *p = line + sprintf(line, "move %d ", c.seat + 1);
+        p = moveName(m, p);
+        *p++ = '\n';
+        broadcast(*g, line, p - line);
+        if(g->state.isOver())
+            finishGame(*g, g->state.winner, NULL);
+
+        int64_t ns = nowNs() - start;
+        metrics.record(ids.moveNs, ns);
+        stats.moves++;
+        stats.moveNs += ns;
+        if(ns > stats.maxMoveNs)
+            stats.maxMoveNs = ns;
+    }
+
+    void resign(Client &c) {
+        Game *g = findGame(c.game);
+        if(!g || c.spectating) {
+            reply(c, "error not in a game");
+            return;
+        }
+        if(g->seats[1] < 0) {
+            releaseGame(*g);
+            reply(c, "over 1 resign");
+            return;
+        }
+        finishGame(*g, 1 - c.seat, "resign");
+    }
+
+    void position(Client &c) {
+        Game *g = findGame(c.game);
+        if(!g) {
+            reply(c, "error not in a game");
+            return;
+        }
+        sendPosition(c, *g);
+    }
+
+    void watch(Client &c, const char *args) {
+        if(c.game != NO_GAME) {
+            reply(c, "error already in a game");
+            return;
+        }
+        Game *g = findGame((uint32_t)strtoul(args, NULL, 10));
+        if(!g) {
+            reply(c, "error no game %.16s", args);
+            return;
+        }
+        g->spectators.push_back(c.conn.fd);
+        c.game = g->id;
+        c.spectating = true;
+        c.lagging = false;
+        spectators++;
+        reply(c, "watching %u", g->id);
+        sendPosition(c, *g);
+    }
+
+    void unwatch(Client &c) {
+        Game *g = findGame(c.game);
+        if(!c.spectating || !g) {
+            reply(c, "error not watching");
+            return;
+        }
+        for(size_t i = 0; i < g->spectators.size(); i++)
+            if(g->spectators[i] == c.conn.fd) {
+                g->spectators[i] = g->spectators.back();
+                g->spectators.pop_back();
+                break;
+            }
+        c.game = NO_GAME;
+        c.spectating = false;
+        c.lagging = false;
+        spectators--;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    std::vector<const char *> addresses;
+    int reportSeconds = 10;
+    const char *metricsAddress = NULL;
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 >= argc) {
+            printf("Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i - 1], "--listen")) addresses.push_back(value);
+        else if(!strcmp(argv[i - 1], "--report")) reportSeconds = atoi(value);
+        else if(!strcmp(argv[i - 1], "--metrics")) metricsAddress = value;
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+    if(addresses.empty())
+        addresses.push_back(DEFAULT_LISTEN);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGUSR1, onDumpSignal);
+    raiseFileLimit();
+
+    Server server;
+    if(server.init())
+        return 1;
+    for(size_t i = 0; i < addresses.size(); i++)
+        if(server.listen(addresses[i]))
+            return 1;
+    if(metricsAddress && server.listenMetrics(metricsAddress))
+        return 1;
+
+    int64_t lastReport = nowNs();
+    ServerStats last = server.stats;
+    while(!g_interrupted) {
+        server.poll(200);
+        if(g_dumpMetrics) {
+            g_dumpMetrics = 0;
+            std::string text;
+            server.formatMetrics(text);
+            fputs(text.c_str(), stdout);
+            fflush(stdout);
+        }
+        int64_t now = nowNs();
+        if(reportSeconds > 0 && now - lastReport >= reportSeconds * 1000000000LL) {
+            const ServerStats &s = server.stats;
+            int64_t moves = s.moves - last.moves;
+            printf("%d connections, %d games, %d spectators (%d lagging), %.0f moves/s, %.1f us/move (max %.1f), "
+                   "%.1f MB/s broadcast, %lld snapshots, %lld games finished\n",
+                   server.connectionCount(), server.gameCount(), server.spectatorCount(), server.laggingCount(),
+                   moves * 1e9 / (now - lastReport), moves ? (s.moveNs - last.moveNs) / 1000.0 / moves : 0.0,
+                   s.maxMoveNs / 1000.0, (s.broadcastBytes - last.broadcastBytes) * 1e3 / (now - lastReport),
+                   (long long)s.snapshots, (long long)s.gamesFinished);
+            fflush(stdout);
+            server.stats.maxMoveNs = 0;
+            last = server.stats;
+            lastReport = now;
+        }
+    }
+    printf("%lld games started, %lld finished, %lld moves\n", (long long)server.stats.gamesStarted,
+           (long long)server.stats.gamesFinished, (long long)server.stats.moves);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Proves positions won or lost with the proof-number solver in dfpn.h.
+//
+//   santorini_solve [--hash MB] [--threads N] [--nodes N] [--time-ms T] [position...]
+//
+// Positions are in notation.h form; with none on the command line they are
+// read from stdin, one per line. Each answer is one line:
+//
+//   <position> win b2-c3#  nodes 1234  proof 56  time 7 ms
+//
+// The result is for the side to move. The table is kept between positions,
+// so related positions (e.g. from one game) get faster as they go.
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<vector>
+
+#include"game_state.h"
+#include"notation.h"
+#include"dfpn.h"
+#include"thread_pool.h"
+
+struct Options
+{
+    int hashMB;
+    int threads;
+    uint64_t nodes;
+    int64_t timeMs;
+};
+
+static int solveLine(const char *text, DfpnTable &table, ThreadPool &pool, const Options &o)
+{
+    GameState state;
+    if(parsePosition(text, state)) {
+        printf("Bad position: %s\n", text);
+        return -1;
+    }
+    char position[POSITION_TEXT_MAX];
+    formatPosition(state, position, sizeof(position));
+    if(state.numPlayers != 2) {
+        printf("%s unknown (the solver handles two player positions only)\n", position);
+        return 0;
+    }
+
+    DfpnReport r = dfpnSolve(state, table, pool, o.nodes, o.timeMs);
+    char move[16] = "";
+    if(!r.best.isNull())
+        *moveName(r.best, move) = 0;
+    printf("%s %s%s%s  nodes %llu  proof %llu", position, dfpnResultName(r.result), *move ? " " : "", move,
+           (unsigned long long)r.nodes, (unsigned long long)r.proofSize);
+    if(r.proofMissing)
+        printf(" (%llu evicted)", (unsigned long long)r.proofMissing);
+    printf("  time %lld ms  %.0f nodes/s\n", (long long)r.timeMs, r.timeMs ? r.nodes * 1000.0 / r.timeMs : 0.0);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options o = { DFPN_DEFAULT_MB, 0, 0, 0 };
+    std::vector<const char *> positions;
+    for(int i = 1; i < argc; i++) {
+        if(argv[i][0] != '-' || argv[i][1] != '-') {
+            positions.push_back(argv[i]);
+            continue;
+        }
+        if(i + 1 >= argc) {
+            printf("Missing value for %s\n", argv[i]);
+            return 1;
+        }
+        const char *value = argv[++i];
+        if(!strcmp(argv[i - 1], "--hash")) o.hashMB = atoi(value);
+        else if(!strcmp(argv[i - 1], "--threads")) o.threads = atoi(value);
+        else if(!strcmp(argv[i - 1], "--nodes")) o.nodes = strtoull(value, NULL, 10);
+        else if(!strcmp(argv[i - 1], "--time-ms")) o.timeMs = atoll(value);
+        else {
+            printf("Unknown option %s\n", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    DfpnTable table(o.hashMB);
+    ThreadPool pool(o.threads);
+    int status = 0;
+    if(!positions.empty()) {
+        for(size_t i = 0; i < positions.size(); i++)
+            status |= solveLine(positions[i], table, pool, o);
+    }
+    else {
+        char line[256];
+        while(fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = 0;
+            if(*line)
+                status |= solveLine(line, table, pool, o);
+        }
+    }
+    return status ? 1 : 0;
+}